@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+#
+# MiT License :: Copyright (C) 2023 Toby Benjamin Clark. All hail Gallaxhar!
+#
+# Generates wjson_pow5.h, the table of 128-bit truncated powers of five used by wJson's number parser
+# (Eisel-Lemire) and number formatter. Run from the repository root: python3 scripts/wjson_pow5.py > wjson_pow5.h
+
+SMALLEST_POWER = -342
+LARGEST_POWER = 341
+
+
+def power_of_five(q):
+    """Returns 5^q normalised so its most significant bit is bit 127, truncated (q >= 0) or rounded up (q < 0)."""
+    if q >= 0:
+        value = 5 ** q
+        while value < (1 << 127):
+            value *= 2
+        while value >= (1 << 128):
+            value //= 2
+        return value
+
+    power5 = 5 ** -q
+    z = power5.bit_length()
+    if q >= -27:
+        value = 2 ** (z + 127) // power5 + 1
+    else:
+        value = 2 ** (2 * z + 128) // power5 + 1
+    while value >= (1 << 128):
+        value //= 2
+    return value
+
+
+def main():
+    print("/*")
+    print(" * MiT License :: Copyright (C) 2023 Toby Benjamin Clark. All hail Gallaxhar!")
+    print(" * Generated by scripts/wjson_pow5.py - do not edit.")
+    print(" */")
+    print()
+    print("#ifndef WJSON_POW5_H")
+    print("#define WJSON_POW5_H")
+    print()
+    print("#include <stdint.h>")
+    print()
+    print("#define WJSON_POW5_SMALLEST %d" % SMALLEST_POWER)
+    print("#define WJSON_POW5_LARGEST %d" % LARGEST_POWER)
+    print()
+    print("/*")
+    print(" * @brief 5^q for q in [WJSON_POW5_SMALLEST, WJSON_POW5_LARGEST], normalised to 128 bits.")
+    print(" *")
+    print(" * Entry 2 * (q - WJSON_POW5_SMALLEST) holds the high 64 bits and the entry after it the low 64 bits.")
+    print(" */")
+    print("static const uint64_t wjson_pow5_table[%d] = {" % (2 * (LARGEST_POWER - SMALLEST_POWER + 1)))
+    for q in range(SMALLEST_POWER, LARGEST_POWER + 1):
+        value = power_of_five(q)
+        print("    UINT64_C(0x%016x), UINT64_C(0x%016x)," % (value >> 64, value & ((1 << 64) - 1)))
+    print("};")
+    print()
+    print("#endif")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,1672 @@
+/*
+ * Self-checking regression tests for the wjson library.
+ *
+ * Every check compares the library against an independent reference or a known answer. Random inputs come from
+ * a fixed-seed generator, so a failure reproduces on every run. The program prints each failed check and exits
+ * with a non-zero status if there was one.
+ */
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "wjson.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#define WJSON_TEST_PIPES 1
+#endif
+
+#define WJSON_TEST_FILE "wjson_tests.tmp"
+#define WJSON_TEST_NUMBERS 200000
+
+static int failures = 0;
+static struct wjson_arena* scratch = NULL;
+
+/**
+ * @brief Reports a failed check, with a printf style description of the case.
+ *
+ * @param line Line of the check.
+ * @param format Format of the description, followed by its arguments.
+ */
+static void fail(int line, const char* format, ...)
+{
+    va_list arguments;
+
+    fprintf(stderr, "%s:%d: check failed: ", __FILE__, line);
+    va_start(arguments, format);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+    fputc('\n', stderr);
+    failures++;
+}
+
+/**
+ * @brief Returns the next value of a xorshift64 generator.
+ *
+ * @param state Generator state, never 0.
+ * @return Next pseudo-random value.
+ */
+static uint64_t random_next(uint64_t* state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/**
+ * @brief Checks that two keys or strings are both absent or hold the same text.
+ */
+static int same_string(const wjson_char* a, const wjson_char* b)
+{
+    if (a == NULL || b == NULL) return a == b;
+    return wjson_string_length(a) == wjson_string_length(b)
+           && memcmp(a, b, wjson_string_length(a) * sizeof(wjson_char)) == 0;
+}
+
+/**
+ * @brief Checks that two wjson containers hold the same members and values, in the same order, and with the same
+ *        keys unless they are lists.
+ */
+static int same_members(const struct wjson* a, const struct wjson* b, int keys)
+{
+    if (a == NULL || b == NULL) return a == b;
+
+    for (; a != NULL && b != NULL; a = a->next, b = b->next)
+    {
+        if (a->type != b->type || (keys && !same_string(a->key, b->key))) return 0;
+
+        switch (a->type)
+        {
+            case WJSON_TYPE_STRING:
+                if (!same_string(a->data_string, b->data_string)) return 0;
+                break;
+            case WJSON_TYPE_NUMERICAL:
+                if (a->data_numerical != b->data_numerical) return 0;
+                break;
+            case WJSON_TYPE_BOOLEAN:
+                if (a->data_bool != b->data_bool) return 0;
+                break;
+            case WJSON_TYPE_OBJECT:
+            case WJSON_TYPE_LIST:
+                if (!same_members(a->data_object, b->data_object, a->type == WJSON_TYPE_OBJECT)) return 0;
+                break;
+            default:
+                break;
+        }
+    }
+    return a == NULL && b == NULL;
+}
+
+/**
+ * @brief Checks that two parsed objects hold the same members, keys and values, in the same order.
+ */
+static int same_tree(const struct wjson* a, const struct wjson* b)
+{
+    return same_members(a, b, 1);
+}
+
+/**
+ * @brief Checks that a node is a string holding the expected text.
+ */
+static int has_string(const struct wjson* node, const wchar_t* expected)
+{
+    wchar_t buffer[64];
+
+    return node != NULL && node->type == WJSON_TYPE_STRING
+           && wjson_get_string_wide(node, buffer, 64) == wcslen(expected) && wcscmp(buffer, expected) == 0;
+}
+
+/**
+ * @brief Serializes a document compactly into a newly allocated buffer, or returns NULL for a NULL document.
+ */
+static char* serialize(struct wjson* document)
+{
+    return (document == NULL) ? NULL : wjson_serialize_alloc(document, NULL);
+}
+
+/**
+ * @brief Checks that two serializations are both present and equal.
+ */
+static int same_text(const char* a, const char* b)
+{
+    return a != NULL && b != NULL && strcmp(a, b) == 0;
+}
+
+static const char* file_document = "{\"name\":\"file\",\"count\":3,\"list\":[true,null,\"x\"],\"nested\":{\"k\":[]}}\n";
+
+/**
+ * @brief Writes bytes to the scratch file, replacing whatever it held.
+ */
+static int write_file(const char* data, size_t length)
+{
+    FILE* file = fopen(WJSON_TEST_FILE, "wb");
+    int written;
+
+    if (file == NULL) return 0;
+    written = fwrite(data, 1, length, file) == length;
+    return (fclose(file) == 0) && written;
+}
+
+/**
+ * @brief Checks that wjson_parse reads regular files, which are memory mapped, and pipes and empty files, which
+ *        are read instead, into the same tree as wjson_parse_buffer.
+ */
+static void test_parse_file(void)
+{
+    size_t length = strlen(file_document);
+    struct wjson* expected = wjson_parse_buffer(file_document, length);
+    struct wjson* document;
+
+    if (expected == NULL) fail(__LINE__, "file document failed to parse");
+
+    if (!write_file(file_document, length))
+    {
+        fail(__LINE__, "could not write %s", WJSON_TEST_FILE);
+        wjson_free(expected);
+        return;
+    }
+    document = wjson_parse(WJSON_TEST_FILE);
+    if (!same_tree(document, expected)) fail(__LINE__, "mapped file parsed differently");
+    wjson_free(document);
+
+    /* An empty file cannot be mapped and holds no document */
+    write_file("", 0);
+    if (wjson_parse(WJSON_TEST_FILE) != NULL) fail(__LINE__, "empty file parsed");
+    remove(WJSON_TEST_FILE);
+
+#ifdef WJSON_TEST_PIPES
+    {
+        int descriptors[2];
+        char name[32];
+
+        /* The document fits in the pipe's buffer, so it can be written before the pipe is read */
+        if (pipe(descriptors) != 0 || write(descriptors[1], file_document, length) != (ssize_t)length)
+        {
+            fail(__LINE__, "could not fill a pipe");
+            wjson_free(expected);
+            return;
+        }
+        close(descriptors[1]);
+        sprintf(name, "/dev/fd/%d", descriptors[0]);
+        document = wjson_parse(name);
+        if (!same_tree(document, expected)) fail(__LINE__, "piped document parsed differently");
+        wjson_free(document);
+        close(descriptors[0]);
+    }
+#endif
+    wjson_free(expected);
+}
+
+/**
+ * @brief Parses documents into a small-block arena over and over, checking each against a heap parse and that
+ *        resetting the arena hands the same memory out again.
+ */
+static void test_arena(void)
+{
+    struct wjson_arena* arena = wjson_arena_create(256);
+    size_t length = strlen(file_document);
+    struct wjson* expected = wjson_parse_buffer(file_document, length);
+    struct wjson* first = NULL;
+    int round;
+
+    for (round = 0; round < 8; round++)
+    {
+        struct wjson* document = wjson_parse_buffer_arena(file_document, length, arena);
+        void* extra = wjson_arena_alloc(arena, 1000);
+
+        if (!same_tree(document, expected)) fail(__LINE__, "arena parse %d differs", round);
+        if (document != NULL && !(document->flags & WJSON_FLAG_ARENA)) fail(__LINE__, "arena node not flagged");
+        if (((size_t)extra % 16) != 0) fail(__LINE__, "arena allocation misaligned");
+
+        /* Every round starts again from the first block */
+        if (round == 0) first = document;
+        else if (document != first) fail(__LINE__, "round %d did not reuse the arena", round);
+        wjson_arena_reset(arena);
+    }
+
+    wjson_arena_destroy(arena);
+    wjson_free(expected);
+}
+
+/**
+ * @brief Checks indexed access to lists that were appended to and parsed, in the heap and in an arena.
+ */
+static void test_list_index(void)
+{
+    const char* text = "[[],[1],0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29]";
+    struct wjson_arena* arena = wjson_arena_create(0);
+    struct wjson* lists[3];
+    size_t i;
+    int which;
+
+    lists[0] = wjson_initialize_list();
+    lists[1] = wjson_arena_initialize_list(arena);
+    for (i = 0; i < 1000; i++)
+    {
+        wjson_list_append_numerical(lists[0], (double)i);
+        wjson_list_append_numerical(lists[1], (double)i);
+    }
+    lists[2] = wjson_parse_buffer(text, strlen(text));
+
+    for (which = 0; which < 3; which++)
+    {
+        size_t size = (which == 2) ? 32 : 1000;
+        size_t first = (which == 2) ? 2 : 0;
+
+        if (wjson_list_size(lists[which]) != size)
+            fail(__LINE__, "list %d has %lu elements", which, (unsigned long)wjson_list_size(lists[which]));
+        for (i = first; i < size; i++)
+        {
+            struct wjson* element = wjson_list_get(lists[which], i);
+            if (element == NULL || element->data_numerical != (double)(i - first))
+                fail(__LINE__, "list %d element %lu is wrong", which, (unsigned long)i);
+        }
+        if (wjson_list_get(lists[which], size) != NULL) fail(__LINE__, "list %d reads past its end", which);
+    }
+
+    /* Nested lists report their own sizes, an empty one included */
+    if (wjson_list_size(wjson_list_get(lists[2], 0)->data_list) != 0
+        || wjson_list_size(wjson_list_get(lists[2], 1)->data_list) != 1)
+        fail(__LINE__, "nested list sizes are wrong");
+
+    wjson_free(lists[0]);
+    wjson_free(lists[2]);
+    wjson_arena_destroy(arena);
+}
+
+/**
+ * @brief Counts the members of an object or list by walking its chain.
+ */
+static size_t count_members(const struct wjson* head)
+{
+    size_t count = 0;
+
+    for (; head != NULL; head = head->next)
+        if (head->type != WJSON_TYPE_EMPTY) count++;
+    return count;
+}
+
+/**
+ * @brief Checks wjson_get and the wjson_set_* setters on objects on both sides of the size at which they are
+ *        indexed, and that duplicate keys always resolve to the first member with the key.
+ */
+static void test_keys(void)
+{
+    static const size_t sizes[] = {1, 7, 8, 9, 40};
+    size_t which;
+
+    for (which = 0; which < sizeof(sizes) / sizeof(sizes[0]); which++)
+    {
+        size_t size = sizes[which];
+        struct wjson* object = wjson_initialize();
+        struct wjson* member;
+        wchar_t key[16];
+        size_t i;
+
+        for (i = 0; i < size; i++)
+        {
+            swprintf(key, 16, L"k%lu", (unsigned long)i);
+            wjson_append_numerical(object, key, (double)i);
+        }
+        for (i = 0; i < size; i++)
+        {
+            swprintf(key, 16, L"k%lu", (unsigned long)i);
+            member = wjson_get(object, key);
+            if (member == NULL || member->data_numerical != (double)i)
+                fail(__LINE__, "%lu members: k%lu not found", (unsigned long)size, (unsigned long)i);
+        }
+        if (wjson_get(object, L"missing") != NULL)
+            fail(__LINE__, "%lu members: missing key found", (unsigned long)size);
+
+        /* Setting an existing key replaces its value in place; a new key is appended and found */
+        wjson_set_string(object, L"k0", L"replaced");
+        wjson_set_boolean(object, L"new", true);
+        wjson_set_numerical(object, L"new", 2.5);
+        if (!has_string(wjson_get(object, L"k0"), L"replaced") || count_members(object) != size + 1)
+            fail(__LINE__, "%lu members: set did not replace", (unsigned long)size);
+        member = wjson_get(object, L"new");
+        if (member == NULL || member->type != WJSON_TYPE_NUMERICAL || member->data_numerical != 2.5)
+            fail(__LINE__, "%lu members: set did not append", (unsigned long)size);
+
+        /* Duplicates, whether parsed or appended, resolve to the first member with the key */
+        wjson_append_string(object, L"k0", L"duplicate");
+        wjson_append_string(object, L"new", L"duplicate");
+        member = wjson_get(object, L"new");
+        if (!has_string(wjson_get(object, L"k0"), L"replaced") || member->type != WJSON_TYPE_NUMERICAL)
+            fail(__LINE__, "%lu members: duplicate key shadowed the first", (unsigned long)size);
+        wjson_set_string(object, L"new", L"set");
+        if (!has_string(wjson_get(object, L"new"), L"set") || count_members(object) != size + 3)
+            fail(__LINE__, "%lu members: set on a duplicate key", (unsigned long)size);
+        wjson_free(object);
+    }
+
+    {
+        const char* text = "{\"d\":1,\"a\":0,\"b\":0,\"c\":0,\"e\":0,\"f\":0,\"g\":0,\"h\":0,\"i\":0,\"d\":2}";
+        struct wjson* document = wjson_parse_buffer(text, strlen(text));
+        struct wjson* member = (document != NULL) ? wjson_get(document, L"d") : NULL;
+
+        if (member == NULL || member->data_numerical != 1) fail(__LINE__, "parsed duplicate key shadowed the first");
+        wjson_free(document);
+    }
+}
+
+/**
+ * @brief Checks that non-ASCII keys and strings, parsed or appended, read back as the same wide characters in
+ *        either storage mode, and that lengths count code units of the storage.
+ */
+static void test_storage(void)
+{
+    const char* text = "{\"cl\xc3\xa9\":\"na\xc3\xafve \xe2\x98\x83\"}";
+    const wchar_t* key = L"cl" L"\x00e9";
+    const wchar_t* value = L"na" L"\x00ef" L"ve " L"\x2603";
+    struct wjson* document = wjson_parse_buffer(text, strlen(text));
+    struct wjson* built = wjson_initialize();
+    struct wjson* nodes[2];
+    wchar_t buffer[16];
+    int which;
+
+    wjson_append_string(built, (wchar_t*)key, (wchar_t*)value);
+    nodes[0] = document;
+    nodes[1] = built;
+
+    for (which = 0; which < 2; which++)
+    {
+        struct wjson* node = nodes[which];
+
+        if (node == NULL || wjson_get_key_wide(node, buffer, 16) != 3 || wcscmp(buffer, key) != 0)
+        {
+            fail(__LINE__, "key of node %d did not read back", which);
+            continue;
+        }
+        if (!has_string(node, value) || !has_string(wjson_get(node, key), value))
+            fail(__LINE__, "string of node %d did not read back", which);
+
+        /* Lengths count bytes of UTF-8 storage, and wide characters otherwise */
+        if (wjson_string_length(node->key) != (sizeof(wjson_char) == 1 ? 4 : 3)
+            || wjson_string_length(node->data_string) != (sizeof(wjson_char) == 1 ? 10 : 7))
+            fail(__LINE__, "stored lengths of node %d are wrong", which);
+
+        /* A short buffer receives as much as fits, and the whole length is still returned */
+        if (wjson_get_string_wide(node, buffer, 3) != 7 || wcscmp(buffer, L"na") != 0)
+            fail(__LINE__, "truncated copy of node %d is wrong", which);
+    }
+
+    if (!same_tree(document, built)) fail(__LINE__, "parsed and appended nodes differ");
+    wjson_free(document);
+    wjson_free(built);
+}
+
+/**
+ * @brief Checks that escape sequences decode correctly wherever they fall in strings of every length up to a few
+ *        vector widths, and that malformed strings are rejected.
+ */
+static void test_strings(void)
+{
+    static const char* escapes[] = {"\\n", "\\\"", "\\\\", "\\/", "\\u00e9", "\\t", "\xc3\xa9"};
+    static const wchar_t decoded[] = {L'\n', L'"', L'\\', L'/', 0x00e9, L'\t', 0x00e9};
+    static const char* invalid[] = {"[\"a\\x\"]", "[\"tab\tinside\"]", "[\"\\u12\"]", "[\"unterminated]"};
+    const char* pair = "[\"\\ud83d\\ude00\",\"\xf0\x9f\x98\x80\"]";
+    struct wjson* list;
+    size_t which;
+    int length;
+
+    for (which = 0; which < sizeof(escapes) / sizeof(escapes[0]); which++)
+    {
+        for (length = 0; length < 80; length++)
+        {
+            char text[128];
+            wchar_t expected[128];
+            wchar_t buffer[128];
+            int used = 0;
+            int i;
+
+            /* A run of plain characters, the escape, then a shorter run */
+            text[used++] = '[';
+            text[used++] = '"';
+            for (i = 0; i < length; i++)
+            {
+                text[used++] = 'a';
+                expected[i] = L'a';
+            }
+            used += sprintf(text + used, "%s", escapes[which]);
+            expected[length] = decoded[which];
+            for (i = 0; i < length % 7; i++)
+            {
+                text[used++] = 'b';
+                expected[length + 1 + i] = L'b';
+            }
+            expected[length + 1 + i] = L'\0';
+            text[used++] = '"';
+            text[used++] = ']';
+
+            list = wjson_parse_buffer(text, (size_t)used);
+            if (list == NULL || wjson_get_string_wide(list, buffer, 128) != wcslen(expected)
+                || wcscmp(buffer, expected) != 0)
+                fail(__LINE__, "escape %lu after %d characters decoded wrongly", (unsigned long)which, length);
+            wjson_free(list);
+        }
+    }
+
+    /* A surrogate pair escape decodes to the same character as its UTF-8 encoding */
+    list = wjson_parse_buffer(pair, strlen(pair));
+    if (list == NULL || !same_string(list->data_string, list->next->data_string))
+        fail(__LINE__, "surrogate pair decoded wrongly");
+    wjson_free(list);
+
+    for (which = 0; which < sizeof(invalid) / sizeof(invalid[0]); which++)
+        if (wjson_parse_buffer(invalid[which], strlen(invalid[which])) != NULL)
+            fail(__LINE__, "invalid string %lu parsed", (unsigned long)which);
+}
+
+/**
+ * @brief Parses the only element of a one-element list in the scratch arena, returning 0 if the parse fails.
+ */
+static int parse_number(const char* text, double* value)
+{
+    char buffer[128];
+    struct wjson* list;
+    int length = sprintf(buffer, "[%s]", text);
+
+    wjson_arena_reset(scratch);
+    list = wjson_parse_buffer_arena(buffer, (size_t)length, scratch);
+    if (list == NULL) return 0;
+    *value = wjson_list_get(list, 0)->data_numerical;
+    return 1;
+}
+
+/**
+ * @brief Appends a run of random decimal digits to a buffer.
+ */
+static char* random_digits(uint64_t* state, char* out, int count, int leading_zero)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        int digit = (int)(random_next(state) % 10);
+        if (i == 0 && !leading_zero && digit == 0) digit = 1 + (int)(random_next(state) % 9);
+        *out++ = (char)('0' + digit);
+    }
+    return out;
+}
+
+/**
+ * @brief Parses random decimal numbers and checks each against strtod, bit for bit.
+ *
+ * The inputs cover short and long significands, including ones past 19 digits that Eisel-Lemire cannot decide
+ * alone, and exponents from subnormals through overflow.
+ */
+static void test_parse_numbers(void)
+{
+    static const char* invalid[] = {"01", "00", "1.", ".5", "-", "+1", "1e", "1e+", "1.e5", "0x10", "NaN", "Infinity"};
+    uint64_t state = 0x9E3779B97F4A7C15ULL;
+    double value = 0;
+    size_t which;
+    int i;
+
+    for (i = 0; i < WJSON_TEST_NUMBERS; i++)
+    {
+        char text[96];
+        char* out = text;
+        double expected;
+        int shape = (int)(random_next(&state) % 4);
+
+        if (random_next(&state) % 2) *out++ = '-';
+        if (shape == 0)
+        {
+            *out++ = '0';
+        }
+        else
+        {
+            out = random_digits(&state, out, 1 + (int)(random_next(&state) % (shape == 3 ? 30 : 19)), 0);
+        }
+        if (shape != 1)
+        {
+            *out++ = '.';
+            out = random_digits(&state, out, 1 + (int)(random_next(&state) % 20), 1);
+        }
+        if (random_next(&state) % 4 != 0)
+        {
+            *out++ = (random_next(&state) % 2) ? 'e' : 'E';
+            if (random_next(&state) % 2) *out++ = (random_next(&state) % 2) ? '-' : '+';
+            out += sprintf(out, "%d", (int)(random_next(&state) % 340));
+        }
+        *out = '\0';
+
+        expected = strtod(text, NULL);
+        if (!parse_number(text, &value) || memcmp(&value, &expected, sizeof(double)) != 0)
+            fail(__LINE__, "%s parsed as %.17g, strtod gives %.17g", text, value, expected);
+    }
+
+    /* Anything outside the JSON number grammar is rejected */
+    for (which = 0; which < sizeof(invalid) / sizeof(invalid[0]); which++)
+        if (parse_number(invalid[which], &value)) fail(__LINE__, "%s parsed as a number", invalid[which]);
+}
+
+/**
+ * @brief Checks that compact serialization reproduces minified documents exactly, through every output, and
+ *        that containers nested far deeper than the C stack could recurse are written out.
+ */
+static void test_serialize(void)
+{
+    const char* text = "{\"s\":\"q\\\"b\\\\n\\n\\u0001\xc3\xa9\",\"n\":[0,-2.5,1e100],\"l\":[true,false],"
+                       "\"o\":{\"e\":{},\"f\":[]}}";
+    size_t length = strlen(text);
+    size_t depth = 200000;
+    struct wjson* document = wjson_parse_buffer(text, length);
+    struct wjson* deep = wjson_initialize_list();
+    struct wjson* inner = deep;
+    char buffer[16];
+    char* written;
+    FILE* file;
+    size_t i;
+
+    written = serialize(document);
+    if (!same_text(written, text)) fail(__LINE__, "serialized as %s", written ? written : "NULL");
+    free(written);
+
+    /* A short buffer takes a truncated copy, and the full length is returned */
+    if (wjson_serialize(document, buffer, sizeof(buffer)) != length || strncmp(buffer, text, sizeof(buffer) - 1) != 0
+        || buffer[sizeof(buffer) - 1] != '\0')
+        fail(__LINE__, "truncated serialization is wrong");
+
+    file = tmpfile();
+    if (file == NULL || !wjson_serialize_to_FILE(document, file))
+    {
+        fail(__LINE__, "could not serialize to a file");
+    }
+    else
+    {
+        written = (char*)calloc(length + 2, 1);
+        rewind(file);
+        if (fread(written, 1, length + 1, file) != length || strcmp(written, text) != 0)
+            fail(__LINE__, "file holds %s", written);
+        free(written);
+    }
+    if (file != NULL) fclose(file);
+
+    /* Nesting is bounded only by memory */
+    for (i = 1; i < depth; i++)
+    {
+        struct wjson* list = wjson_initialize_list();
+        wjson_list_append_list(inner, list);
+        inner = list;
+    }
+    written = serialize(deep);
+    if (written == NULL || strlen(written) != 2 * depth || written[depth - 1] != '[' || written[depth] != ']')
+        fail(__LINE__, "deep list serialized wrongly");
+    free(written);
+    wjson_free(deep);
+    wjson_free(document);
+}
+
+/**
+ * @brief Serializes random doubles and checks that the text reads back, with strtod and the parser, as the
+ *        same double, and that known values are written in their shortest form.
+ */
+static void test_format_numbers(void)
+{
+    static const double values[] = {0.1, 100, 1e21, 5e-324, 1.7976931348623157e308, 0.000025, 1e-7};
+    static const char* shortest[] = {"[0.1]", "[100]", "[1e21]", "[5e-324]", "[1.7976931348623157e308]",
+                                     "[0.000025]", "[1e-7]"};
+    uint64_t state = 0xD1B54A32D192ED03ULL;
+    char text[64];
+    size_t which;
+    int i;
+
+    for (i = 0; i < WJSON_TEST_NUMBERS; i++)
+    {
+        uint64_t bits = random_next(&state);
+        struct wjson* list;
+        double value;
+        double reread = 0;
+        double reparsed = 0;
+
+        /* Half the inputs are drawn from a narrower range of exponents, where most real data lies */
+        if (i % 2) bits = (bits & 0x800FFFFFFFFFFFFFULL) | ((uint64_t)(1023 - 60 + (int)(bits % 120)) << 52);
+        memcpy(&value, &bits, sizeof(double));
+        if (value != value || value - value != 0) value = (double)i;
+
+        wjson_arena_reset(scratch);
+        list = wjson_arena_initialize_list(scratch);
+        wjson_list_append_numerical(list, value);
+        wjson_serialize(list, text, sizeof(text));
+
+        text[strlen(text) - 1] = '\0';
+        reread = strtod(text + 1, NULL);
+        if (memcmp(&reread, &value, sizeof(double)) != 0 || !parse_number(text + 1, &reparsed)
+            || memcmp(&reparsed, &value, sizeof(double)) != 0)
+            fail(__LINE__, "%.17g serialized as %s", value, text + 1);
+    }
+
+    for (which = 0; which < sizeof(values) / sizeof(values[0]); which++)
+    {
+        struct wjson* list;
+
+        wjson_arena_reset(scratch);
+        list = wjson_arena_initialize_list(scratch);
+        wjson_list_append_numerical(list, values[which]);
+        wjson_serialize(list, text, sizeof(text));
+        if (strcmp(text, shortest[which]) != 0) fail(__LINE__, "%.17g serialized as %s", values[which], text);
+    }
+}
+
+/**
+ * @brief Event parser client that logs one character per event and stops once it has seen a set number.
+ */
+struct event_log
+{
+    char events[64];
+    int count;
+    int limit;
+};
+
+static int log_event(void* context, char event)
+{
+    struct event_log* log = (struct event_log*)context;
+
+    if (log->count < (int)sizeof(log->events) - 1) log->events[log->count] = event;
+    log->count++;
+    log->events[log->count < (int)sizeof(log->events) ? log->count : (int)sizeof(log->events) - 1] = '\0';
+    return log->count < log->limit;
+}
+
+static int log_object_start(void* context) { return log_event(context, '{'); }
+static int log_object_end(void* context) { return log_event(context, '}'); }
+static int log_array_start(void* context) { return log_event(context, '['); }
+static int log_array_end(void* context) { return log_event(context, ']'); }
+static int log_null(void* context) { return log_event(context, '0'); }
+
+static int log_key(void* context, const char* key, size_t length)
+{
+    return log_event(context, (length == 1 && *key == 'k') ? 'k' : '?');
+}
+
+static int log_string(void* context, const char* value, size_t length)
+{
+    return log_event(context, (length == 2 && memcmp(value, "\xc3\xa9", 2) == 0) ? 's' : '?');
+}
+
+static int log_number(void* context, double value)
+{
+    return log_event(context, (value == 1.5) ? 'n' : '?');
+}
+
+static int log_bool(void* context, bool value)
+{
+    return log_event(context, value ? 't' : 'f');
+}
+
+static const struct wjson_events log_events = {log_object_start, log_object_end, log_array_start, log_array_end,
+                                               log_key, log_string, log_number, log_bool, log_null,
+                                               NULL, NULL, NULL};
+static const char* event_document = "{\"k\":[\"\\u00e9\",1.5,true,false,null,{}],\"k\":[[]]}";
+static const char* event_sequence = "{k[sntf0{}]k[[]]}";
+
+/**
+ * @brief Checks the events reported for a document, that a callback returning 0 stops the parse straight away
+ *        at every point, and that the tree built from the events round trips.
+ */
+static void test_events(void)
+{
+    static const struct wjson_events none = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+    const char* text = event_document;
+    const char* expected = event_sequence;
+    struct wjson* document;
+    struct event_log log;
+    char* written;
+    int status;
+    int limit;
+
+    log.count = 0;
+    log.limit = 1000;
+    status = wjson_parse_events(text, strlen(text), &log_events, &log);
+    if (status != WJSON_PARSE_COMPLETE || strcmp(log.events, expected) != 0)
+        fail(__LINE__, "events were %s, status %d", log.events, status);
+
+    /* Stopping at any event reports no further events */
+    for (limit = 1; limit < (int)strlen(expected); limit++)
+    {
+        log.count = 0;
+        log.limit = limit;
+        status = wjson_parse_events(text, strlen(text), &log_events, &log);
+        if (status != WJSON_PARSE_ABORTED || log.count != limit || strncmp(log.events, expected, limit) != 0)
+            fail(__LINE__, "stopping after %d events gave %s, status %d", limit, log.events, status);
+    }
+
+    if (wjson_parse_events(text, strlen(text), &none, NULL) != WJSON_PARSE_COMPLETE)
+        fail(__LINE__, "parse without callbacks failed");
+    if (wjson_parse_events(text, strlen(text) - 1, &none, NULL) != WJSON_PARSE_ERROR)
+        fail(__LINE__, "truncated document did not fail");
+
+    document = wjson_parse_buffer(text, strlen(text));
+    written = serialize(document);
+    if (!same_text(written, "{\"k\":[\"\xc3\xa9\",1.5,true,false,null,{}],\"k\":[[]]}"))
+        fail(__LINE__, "event built tree serialized as %s", written ? written : "NULL");
+    free(written);
+    wjson_free(document);
+}
+
+/**
+ * @brief Checks that the push parser builds the same tree as wjson_parse_buffer however the document is split,
+ *        including inside strings, escape sequences and numbers, and rejects truncated documents.
+ */
+static void test_push(void)
+{
+    const char* text = "{\"s\":\"a\\u00e9\\\"b\\ud83d\\ude00\",\"n\":[-12.5e-3,0,1e100,true,false,null],"
+                       "\"o\":{\"x\":{}}}";
+    size_t length = strlen(text);
+    struct wjson* expected = wjson_parse_buffer(text, length);
+    struct wjson_push_parser* parser;
+    struct event_log log;
+    size_t split;
+    int status;
+
+    if (expected == NULL) fail(__LINE__, "push document failed to parse");
+    for (split = 0; split <= length && expected != NULL; split++)
+    {
+        wjson_arena_reset(scratch);
+        parser = wjson_push_parser_create_tree(scratch);
+        status = wjson_push_parser_feed(parser, text, split);
+        if (status != WJSON_PARSE_INCOMPLETE && split < length)
+            fail(__LINE__, "first %u bytes gave status %d", (unsigned)split, status);
+        status = wjson_push_parser_feed(parser, text + split, length - split);
+        if (status != WJSON_PARSE_COMPLETE || wjson_push_parser_finish(parser) != WJSON_PARSE_COMPLETE
+            || !same_tree(wjson_push_parser_root(parser), expected))
+            fail(__LINE__, "split at %u gave a different tree", (unsigned)split);
+        wjson_push_parser_destroy(parser);
+    }
+
+    /* Byte at a time; every prefix of the document is incomplete and none is accepted by finish */
+    for (split = 0; split < length; split++)
+    {
+        size_t fed;
+
+        wjson_arena_reset(scratch);
+        parser = wjson_push_parser_create_tree(scratch);
+        for (fed = 0, status = WJSON_PARSE_INCOMPLETE; fed < split && status == WJSON_PARSE_INCOMPLETE; fed++)
+            status = wjson_push_parser_feed(parser, text + fed, 1);
+        if (status != WJSON_PARSE_INCOMPLETE || wjson_push_parser_finish(parser) != WJSON_PARSE_ERROR
+            || wjson_push_parser_root(parser) != NULL)
+            fail(__LINE__, "truncation after %u bytes was accepted", (unsigned)split);
+        wjson_push_parser_destroy(parser);
+    }
+
+    /* A number cut by the end of a chunk only ends at the next delimiter */
+    wjson_arena_reset(scratch);
+    parser = wjson_push_parser_create_tree(scratch);
+    if (wjson_push_parser_feed(parser, "[12", 3) != WJSON_PARSE_INCOMPLETE
+        || wjson_push_parser_feed(parser, "5", 1) != WJSON_PARSE_INCOMPLETE
+        || wjson_push_parser_feed(parser, "]", 1) != WJSON_PARSE_COMPLETE
+        || wjson_list_get(wjson_push_parser_root(parser), 0)->data_numerical != 125)
+        fail(__LINE__, "number split across chunks was not completed");
+    wjson_push_parser_destroy(parser);
+
+    /* Events fed a byte at a time match the one shot event parser, and errors are sticky */
+    log.count = 0;
+    log.limit = 1000;
+    parser = wjson_push_parser_create(&log_events, &log);
+    for (split = 0, status = WJSON_PARSE_INCOMPLETE; event_document[split] != '\0'; split++)
+        status = wjson_push_parser_feed(parser, event_document + split, 1);
+    if (status != WJSON_PARSE_COMPLETE || strcmp(log.events, event_sequence) != 0)
+        fail(__LINE__, "pushed events were %s, status %d", log.events, status);
+    if (wjson_push_parser_feed(parser, "]", 1) != WJSON_PARSE_ERROR
+        || wjson_push_parser_feed(parser, " ", 1) != WJSON_PARSE_ERROR)
+        fail(__LINE__, "error after the document was not sticky");
+    wjson_push_parser_destroy(parser);
+    wjson_arena_reset(scratch);
+    wjson_free(expected);
+}
+
+#define WJSON_TEST_RECORDS 40000
+
+/**
+ * @brief Generated NDJSON input and what the callbacks saw of each record.
+ */
+struct ndjson_run
+{
+    size_t offsets[WJSON_TEST_RECORDS];
+    unsigned char seen[WJSON_TEST_RECORDS];
+    unsigned char wrong[WJSON_TEST_RECORDS];
+    size_t delivered;
+    size_t last;
+    size_t stop;
+    int ordered;
+};
+
+/**
+ * @brief NDJSON callback that finds the record by its offset and checks its contents. Records are marked in
+ *        separate slots, so the unordered callbacks running concurrently do not race.
+ */
+static int check_record(void* context, size_t offset, struct wjson* document)
+{
+    struct ndjson_run* run = (struct ndjson_run*)context;
+    size_t low = 0;
+    size_t high = WJSON_TEST_RECORDS;
+    int malformed;
+
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (run->offsets[middle] <= offset) low = middle;
+        else high = middle;
+    }
+    malformed = (low % 9973) == 5000;
+    run->seen[low]++;
+    if (run->offsets[low] != offset || (document == NULL) != malformed
+        || (document != NULL && wjson_get(document, L"id")->data_numerical != (double)low))
+        run->wrong[low] = 1;
+    if (run->ordered)
+    {
+        if (run->delivered > 0 && low != run->last + 1) run->wrong[low] = 1;
+        run->last = low;
+        run->delivered++;
+        return run->delivered != run->stop;
+    }
+    return 1;
+}
+
+/**
+ * @brief Checks that several megabytes of NDJSON, which splits into blocks for several threads, delivers every
+ *        record exactly once, in order when asked, with malformed records passed as NULL.
+ */
+static void test_ndjson(void)
+{
+    struct ndjson_run* run = (struct ndjson_run*)calloc(1, sizeof(struct ndjson_run));
+    const char* padding = "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz";
+    char* text = (char*)malloc((size_t)WJSON_TEST_RECORDS * 128);
+    size_t length = 0;
+    size_t record;
+    unsigned int threads;
+    int status;
+    int ordered;
+
+    if (run == NULL || text == NULL)
+    {
+        fail(__LINE__, "out of memory");
+        free(run);
+        free(text);
+        return;
+    }
+    for (record = 0; record < WJSON_TEST_RECORDS; record++)
+    {
+        if (record % 1000 == 0) text[length++] = '\n';
+        run->offsets[record] = length;
+        if (record % 9973 == 5000)
+            length += (size_t)sprintf(text + length, "{\"id\":%u,\"pad\":}\n", (unsigned)record);
+        else
+            length += (size_t)sprintf(text + length, "{\"id\":%u,\"pad\":\"%.*s\",\"list\":[1,2.5,null]}\n",
+                                      (unsigned)record, (int)(record % 64), padding);
+    }
+
+    for (ordered = 0; ordered <= 1; ordered++)
+    {
+        for (threads = 1; threads <= 4; threads += 3)
+        {
+            memset(run->seen, 0, sizeof(run->seen));
+            memset(run->wrong, 0, sizeof(run->wrong));
+            run->ordered = ordered;
+            run->delivered = 0;
+            run->stop = 0;
+            status = wjson_parse_ndjson(text, length, threads, ordered ? WJSON_NDJSON_ORDERED : 0, check_record, run);
+            if (status != WJSON_PARSE_ERROR)
+                fail(__LINE__, "input with malformed records gave status %d", status);
+            for (record = 0; record < WJSON_TEST_RECORDS; record++)
+            {
+                if (run->seen[record] != 1 || run->wrong[record])
+                {
+                    fail(__LINE__, "record %u was delivered %d times, %s with %u threads%s", (unsigned)record,
+                         run->seen[record], run->wrong[record] ? "wrongly" : "correctly", threads,
+                         ordered ? " in order" : "");
+                    break;
+                }
+            }
+        }
+    }
+
+    /* Stopping from an ordered callback delivers nothing after it */
+    memset(run->seen, 0, sizeof(run->seen));
+    run->ordered = 1;
+    run->delivered = 0;
+    run->stop = 100;
+    status = wjson_parse_ndjson(text, length, 4, WJSON_NDJSON_ORDERED, check_record, run);
+    if (status != WJSON_PARSE_ABORTED || run->delivered != 100)
+        fail(__LINE__, "stopping after 100 records delivered %u, status %d", (unsigned)run->delivered, status);
+
+    /* Without the malformed records the file parse completes */
+    length = run->offsets[5000];
+    run->delivered = 0;
+    run->stop = 0;
+    if (!write_file(text, length)
+        || wjson_parse_ndjson_file(WJSON_TEST_FILE, 2, WJSON_NDJSON_ORDERED, check_record, run) != WJSON_PARSE_COMPLETE
+        || run->delivered != 5000)
+        fail(__LINE__, "NDJSON file delivered %u records", (unsigned)run->delivered);
+    remove(WJSON_TEST_FILE);
+    free(run);
+    free(text);
+}
+
+/**
+ * @brief Checks that the structural index parser builds the same tree as wjson_parse_buffer_arena on a
+ *        document large enough to be indexed in parallel, whatever the chunk boundaries fall on, and that
+ *        every thread count rejects a corrupted copy.
+ */
+static void test_indexed(void)
+{
+    static const char* const strings[] = {"plain", "\\\"{[,:]}\\\\", "\\\\\\\\\\\\\\\"", "\\u00e9\\n\\t", ""};
+    struct wjson_arena* reference = wjson_arena_create(0);
+    char* text = (char*)malloc(6 * 1048576);
+    struct wjson* expected;
+    struct wjson* document;
+    char* corrupt;
+    size_t length = 0;
+    unsigned int threads;
+    unsigned int record;
+
+    if (reference == NULL || text == NULL)
+    {
+        fail(__LINE__, "out of memory");
+        wjson_arena_destroy(reference);
+        free(text);
+        return;
+    }
+    text[length++] = '[';
+    for (record = 0; length < 5 * 1048576; record++)
+        length += (size_t)sprintf(text + length, "%s{\"id\":%u,\"s\":\"%s\",\"flag\":%s,\"n\":[-1.5e3,%u]}\n",
+                                  record ? "," : "", record, strings[record % 5], (record % 3) ? "true" : "null",
+                                  record * 7919);
+    text[length++] = ']';
+    text[length] = '\0';
+
+    expected = wjson_parse_buffer_arena(text, length, reference);
+    if (expected == NULL) fail(__LINE__, "indexed document failed to parse");
+    for (threads = 1; threads <= 4 && expected != NULL; threads++)
+    {
+        wjson_arena_reset(scratch);
+        document = wjson_parse_indexed(text, length, threads, scratch);
+        if (!same_tree(document, expected)) fail(__LINE__, "indexed parse on %u threads differs", threads);
+    }
+    wjson_arena_reset(scratch);
+    document = wjson_parse_indexed(file_document, strlen(file_document), 0, scratch);
+    if (!same_tree(document, wjson_parse_buffer_arena(file_document, strlen(file_document), scratch)))
+        fail(__LINE__, "small indexed parse differs");
+
+    /* A bad value in the middle of the document */
+    corrupt = strstr(text + length / 2, "\"flag\":");
+    corrupt[7] = '#';
+    for (threads = 1; threads <= 4; threads++)
+    {
+        wjson_arena_reset(scratch);
+        if (wjson_parse_indexed(text, length, threads, scratch) != NULL)
+            fail(__LINE__, "corrupt document parsed on %u threads", threads);
+    }
+    wjson_arena_reset(scratch);
+    wjson_arena_destroy(reference);
+    free(text);
+}
+
+/**
+ * @brief Checks navigation of a lazy document by key, position and iteration, decoding of its keys and scalars,
+ *        and that materializing a container gives the same tree as parsing it.
+ */
+static void test_lazy(void)
+{
+    const char* text = "{\"skip\":[{\"a\":\"}]\"},[[]]],\"n\":-2.5e2,\"l\\u0069st\":[true,false,null,\"x\\u00e9y\"],"
+                       "\"o\":{\"k\":{\"deep\":[1,2,3]},\"e\":{}}}";
+    const char* members[] = {"skip", "n", "list", "o"};
+    const char* deep = "{\"k\":{\"deep\":[1,2,3]},\"e\":{}}";
+    struct wjson_lazy root;
+    struct wjson_lazy value;
+    struct wjson_lazy member;
+    char buffer[16];
+    double number = 0;
+    bool flag = false;
+    int count;
+
+    if (!wjson_lazy_open(&root, text, strlen(text)) || wjson_lazy_type(&root) != WJSON_TYPE_OBJECT)
+    {
+        fail(__LINE__, "lazy document failed to open");
+        return;
+    }
+    for (count = 0, wjson_lazy_at(&root, 0, &member); count < 4; count++)
+    {
+        if (wjson_lazy_key(&member, buffer, sizeof(buffer)) != strlen(members[count])
+            || strcmp(buffer, members[count]) != 0)
+            fail(__LINE__, "member %d has key %s", count, buffer);
+        if (!wjson_lazy_next(&member, &member)) break;
+    }
+    if (count != 3) fail(__LINE__, "iteration visited %d members", count + 1);
+
+    if (!wjson_lazy_get(&root, "n", &value) || !wjson_lazy_number(&value, &number) || number != -250)
+        fail(__LINE__, "lazy number was %g", number);
+    if (!wjson_lazy_get(&root, "list", &value) || wjson_lazy_type(&value) != WJSON_TYPE_LIST
+        || !wjson_lazy_at(&value, 1, &member) || !wjson_lazy_bool(&member, &flag) || flag
+        || !wjson_lazy_at(&value, 2, &member) || wjson_lazy_type(&member) != WJSON_TYPE_NULL
+        || !wjson_lazy_at(&value, 3, &member) || wjson_lazy_at(&value, 4, &member))
+        fail(__LINE__, "lazy list navigation failed");
+    if (wjson_lazy_string(&member, buffer, sizeof(buffer)) != 4 || strcmp(buffer, "x\xc3\xa9y") != 0
+        || wjson_lazy_string(&member, buffer, 3) != 4 || strcmp(buffer, "x\xc3") != 0)
+        fail(__LINE__, "lazy string decoded as %s", buffer);
+    if (wjson_lazy_get(&root, "a", &value) || wjson_lazy_get(&root, "lis", &value))
+        fail(__LINE__, "lazy lookup matched a nested or partial key");
+
+    if (!wjson_lazy_get(&root, "o", &value)
+        || !same_tree(wjson_lazy_materialize(&value, scratch), wjson_parse_buffer_arena(deep, strlen(deep), scratch)))
+        fail(__LINE__, "materialized object differs");
+    if (!wjson_lazy_get(&value, "k", &member) || !wjson_lazy_get(&member, "deep", &member)
+        || !wjson_lazy_at(&member, 2, &member) || !wjson_lazy_number(&member, &number) || number != 3)
+        fail(__LINE__, "nested lazy lookup failed");
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief Path stream callback collecting the numbers matched, stopping once it has a set number of them.
+ */
+struct path_matches
+{
+    double numbers[8];
+    size_t count;
+    size_t limit;
+};
+
+static int collect_match(void* context, const struct wjson_lazy* match)
+{
+    struct path_matches* matches = (struct path_matches*)context;
+
+    if (matches->count < 8 && !wjson_lazy_number(match, &matches->numbers[matches->count]))
+        matches->numbers[matches->count] = -1;
+    matches->count++;
+    return matches->count < matches->limit;
+}
+
+/**
+ * @brief Checks escaped tokens, indices and wildcards in compiled paths against a tree and streamed straight
+ *        from the text, and that malformed pointers are rejected.
+ */
+static void test_paths(void)
+{
+    const char* text = "{\"a/b\":1,\"m~n\":2,\"users\":[{\"name\":\"x\",\"id\":1},{\"name\":\"y\",\"id\":2},"
+                       "{\"id\":3}],\"\":{\"\":5}}";
+    static const char* const pointers[] = {"/a~1b", "/m~0n", "/users/*/id", "//", "/users/1/id", "/users/3/id", "/*/*"};
+    static const size_t counts[] = {1, 1, 3, 1, 1, 0, 4};
+    static const double firsts[] = {1, 2, 1, 5, 2, 0, -1};
+    struct wjson* document = wjson_parse_buffer_arena(text, strlen(text), scratch);
+    struct wjson* found[8];
+    struct path_matches matches;
+    struct wjson_path* path;
+    size_t which;
+
+    for (which = 0; which < sizeof(pointers) / sizeof(pointers[0]); which++)
+    {
+        path = wjson_path_compile(pointers[which]);
+        if (path == NULL)
+        {
+            fail(__LINE__, "%s failed to compile", pointers[which]);
+            continue;
+        }
+        if (wjson_path_eval_all(document, path, found, 8) != counts[which]
+            || wjson_path_eval(document, path) != (counts[which] ? found[0] : NULL)
+            || (counts[which] && firsts[which] >= 0 && found[0]->data_numerical != firsts[which]))
+            fail(__LINE__, "%s evaluated wrongly", pointers[which]);
+        matches.count = 0;
+        matches.limit = 100;
+        if (wjson_path_stream(text, strlen(text), path, collect_match, &matches) != WJSON_PARSE_COMPLETE
+            || matches.count != counts[which] || (counts[which] && matches.numbers[0] != firsts[which]))
+            fail(__LINE__, "%s streamed %u matches", pointers[which], (unsigned)matches.count);
+        wjson_path_free(path);
+    }
+
+    path = wjson_path_compile("/users/*/id");
+    matches.count = 0;
+    matches.limit = 2;
+    if (wjson_path_stream(text, strlen(text), path, collect_match, &matches) != WJSON_PARSE_ABORTED
+        || matches.count != 2 || matches.numbers[1] != 2)
+        fail(__LINE__, "stopped stream reported %u matches", (unsigned)matches.count);
+    if (wjson_path_eval_all(document, path, found, 1) != 3 || found[0]->data_numerical != 1)
+        fail(__LINE__, "eval_all did not count matches past its capacity");
+    wjson_path_free(path);
+
+    path = wjson_path_compile("");
+    if (path == NULL || wjson_path_eval(document, path) != document) fail(__LINE__, "empty pointer is not the root");
+    wjson_path_free(path);
+    path = wjson_path_compile("/users/0/name");
+    if (!has_string(wjson_path_eval(document, path), L"x")) fail(__LINE__, "string member not found");
+    wjson_path_free(path);
+    if (wjson_path_compile("users") != NULL || wjson_path_compile("/a~2") != NULL || wjson_path_compile("/~") != NULL)
+        fail(__LINE__, "malformed pointer compiled");
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief Checks tape navigation, lookup and replay, and that converting between tapes and trees loses nothing,
+ *        including for nesting far deeper than the C stack could recurse.
+ */
+static void test_tapes(void)
+{
+    const char* text = "{\"a\":[1,{\"b\":true},[]],\"c\":\"s\\u00e9\",\"d\":null,\"e\":-0.5}";
+    struct wjson_tape* tape = wjson_tape_parse(text, strlen(text));
+    struct wjson_tape* copy;
+    struct wjson* document;
+    struct event_log log;
+    size_t depth = 200000;
+    const char* string;
+    size_t length;
+    size_t index;
+    size_t end;
+    char* deep;
+    char* written;
+    int count;
+
+    if (tape == NULL)
+    {
+        fail(__LINE__, "tape failed to parse");
+        return;
+    }
+    if (wjson_tape_type(tape, 0) != WJSON_TYPE_OBJECT) fail(__LINE__, "tape root is not an object");
+    for (count = 0, index = 1, end = wjson_tape_end(tape, 0); index < end; index = wjson_tape_next(tape, index))
+        count++;
+    if (count != 8) fail(__LINE__, "root holds %d entries, keys included", count);
+    index = wjson_tape_get(tape, 0, "a");
+    if (wjson_tape_type(tape, index) != WJSON_TYPE_LIST || wjson_tape_get_number(tape, index + 1) != 1
+        || !wjson_tape_get_bool(tape, wjson_tape_get(tape, wjson_tape_next(tape, index + 1), "b")))
+        fail(__LINE__, "tape list navigation failed");
+    string = wjson_tape_get_string(tape, wjson_tape_get(tape, 0, "c"), &length);
+    if (string == NULL || length != 3 || memcmp(string, "s\xc3\xa9", 3) != 0) fail(__LINE__, "tape string is wrong");
+    if (wjson_tape_type(tape, wjson_tape_get(tape, 0, "d")) != WJSON_TYPE_NULL || wjson_tape_get(tape, 0, "b") != 0
+        || wjson_tape_get_number(tape, wjson_tape_get(tape, 0, "e")) != -0.5)
+        fail(__LINE__, "tape lookup failed");
+
+    document = wjson_tape_to_tree(tape, scratch);
+    copy = wjson_tape_from_tree(document);
+    if (!same_tree(document, wjson_parse_buffer_arena(text, strlen(text), scratch))
+        || !same_tree(wjson_tape_to_tree(copy, scratch), document))
+        fail(__LINE__, "tape and tree conversions differ");
+    wjson_tape_free(copy);
+    wjson_tape_free(tape);
+
+    tape = wjson_tape_parse(event_document, strlen(event_document));
+    log.count = 0;
+    log.limit = 1000;
+    if (wjson_tape_replay(tape, &log_events, &log) != WJSON_PARSE_COMPLETE || strcmp(log.events, event_sequence) != 0)
+        fail(__LINE__, "replayed events were %s", log.events);
+    wjson_tape_free(tape);
+
+    deep = (char*)malloc(2 * depth + 1);
+    memset(deep, '[', depth);
+    memset(deep + depth, ']', depth);
+    deep[2 * depth] = '\0';
+    tape = wjson_tape_parse(deep, 2 * depth);
+    copy = wjson_tape_from_tree(wjson_tape_to_tree(tape, scratch));
+    written = serialize(wjson_tape_to_tree(copy, scratch));
+    if (tape == NULL || wjson_tape_end(tape, 0) != 2 * depth - 1 || !same_text(written, deep))
+        fail(__LINE__, "deep tape did not round trip");
+    free(written);
+    free(deep);
+    wjson_tape_free(copy);
+    wjson_tape_free(tape);
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief NDJSON callback that checks every key of a record is interned.
+ */
+static int check_interned(void* context, size_t offset, struct wjson* document)
+{
+    struct wjson* member;
+
+    (void)offset;
+    for (member = document; member != NULL; member = member->next)
+        if (!(member->flags & WJSON_FLAG_INTERNED)) *(int*)context = 0;
+    return 1;
+}
+
+/**
+ * @brief Checks that equal keys share one interned copy within and across documents of an arena, that the pool
+ *        outlives an arena reset, and that the default pool covers arenas and threads without a pool of their own.
+ */
+static void test_interning(void)
+{
+    const char* first = "[{\"id\":1,\"name\":\"a\"},{\"id\":2,\"name\":\"b\"},{\"name\":{\"id\":3}}]";
+    const char* second = "{\"id\":4,\"other\":5}";
+    const char* records = "{\"id\":1,\"x\":2}\n{\"x\":3,\"y\":4}\n";
+    struct wjson_intern* pool = wjson_intern_create(0);
+    struct wjson_intern* shared = wjson_intern_create(WJSON_INTERN_SHARED);
+    struct wjson_arena* arena = wjson_arena_create(0);
+    struct wjson* document;
+    struct wjson* a;
+    struct wjson* b;
+    int interned = 1;
+
+    wjson_arena_set_intern(arena, pool);
+    document = wjson_parse_buffer_arena(first, strlen(first), arena);
+    a = wjson_list_get(document, 0)->data_object;
+    b = wjson_list_get(document, 1)->data_object;
+    if (a->key != b->key || a->next->key != b->next->key || !(a->flags & WJSON_FLAG_INTERNED)
+        || wjson_list_get(document, 2)->data_object->data_object->key != a->key || wjson_intern_count(pool) != 2)
+        fail(__LINE__, "keys of one document were not shared");
+
+    /* The pool keeps its keys when the arena is reset */
+    wjson_arena_reset(arena);
+    document = wjson_parse_buffer_arena(second, strlen(second), arena);
+    if (document->key != wjson_intern_key(pool, L"id") || wjson_intern_count(pool) != 3
+        || !same_string(document->next->key, wjson_intern_key(pool, L"other")))
+        fail(__LINE__, "keys were not reused after a reset, %u interned", (unsigned)wjson_intern_count(pool));
+    if (wjson_intern_key(pool, L"id") != document->key || wjson_intern_count(pool) != 3)
+        fail(__LINE__, "interning an existing key added a new one");
+
+    /* The default pool serves arenas without a pool, including the NDJSON workers' */
+    wjson_intern_set_default(shared);
+    document = wjson_parse_buffer_arena(second, strlen(second), scratch);
+    if (document->key != wjson_intern_key(shared, L"id") || wjson_intern_count(shared) != 2)
+        fail(__LINE__, "default pool was not used");
+    if (wjson_parse_ndjson(records, strlen(records), 4, 0, check_interned, &interned) != WJSON_PARSE_COMPLETE
+        || !interned || wjson_intern_count(shared) != 4)
+        fail(__LINE__, "NDJSON keys were not interned, %u in the pool", (unsigned)wjson_intern_count(shared));
+    wjson_intern_set_default(NULL);
+    wjson_arena_reset(scratch);
+    document = wjson_parse_buffer_arena(second, strlen(second), scratch);
+    if (document->flags & WJSON_FLAG_INTERNED) fail(__LINE__, "key interned without a pool");
+
+    wjson_arena_reset(scratch);
+    wjson_arena_destroy(arena);
+    wjson_intern_destroy(shared);
+    wjson_intern_destroy(pool);
+}
+
+/**
+ * @brief Checks that every member of a container and its descendants links back to the member before it.
+ */
+static int linked_back(const struct wjson* head)
+{
+#ifdef WJSON_NODE_PREV
+    const struct wjson* member;
+
+    if (head->prev != NULL) return 0;
+    for (member = head; member != NULL; member = member->next)
+    {
+        if (member->next != NULL && member->next->prev != member) return 0;
+        if ((member->type == WJSON_TYPE_OBJECT || member->type == WJSON_TYPE_LIST) && !linked_back(member->data_object))
+            return 0;
+    }
+#else
+    (void)head;
+#endif
+    return 1;
+}
+
+/**
+ * @brief Checks the node size and, with WJSON_NODE_PREV, the prev links of trees built by each parser, by
+ *        conversion and by the append and set functions.
+ */
+static void test_node_layout(void)
+{
+    const char* text = "{\"a\":[1,2,{\"x\":[],\"y\":{}},3],\"b\":\"s\",\"c\":{\"d\":true,\"e\":null},\"f\":[[[]]]}";
+    struct wjson_push_parser* parser = wjson_push_parser_create_tree(scratch);
+    struct wjson* object = wjson_initialize();
+    struct wjson* list = wjson_initialize_list();
+    struct wjson_tape* tape = wjson_tape_parse(text, strlen(text));
+    struct wjson_lazy lazy;
+    int i;
+
+#ifdef WJSON_NODE_PREV
+    if (sizeof(void*) == 8 && sizeof(struct wjson) != 40)
+#else
+    if (sizeof(void*) == 8 && sizeof(struct wjson) != 32)
+#endif
+        fail(__LINE__, "node is %u bytes", (unsigned)sizeof(struct wjson));
+
+    wjson_push_parser_feed(parser, text, strlen(text));
+    wjson_lazy_open(&lazy, text, strlen(text));
+    if (!linked_back(wjson_parse_buffer_arena(text, strlen(text), scratch))
+        || !linked_back(wjson_parse_indexed(text, strlen(text), 1, scratch))
+        || !linked_back(wjson_push_parser_root(parser)) || !linked_back(wjson_tape_to_tree(tape, scratch))
+        || !linked_back(wjson_lazy_materialize(&lazy, scratch)))
+        fail(__LINE__, "parsed tree has broken prev links");
+    wjson_push_parser_destroy(parser);
+    wjson_tape_free(tape);
+
+    for (i = 0; i < 12; i++)
+    {
+        wchar_t key[8];
+
+        swprintf(key, 8, L"k%d", i % 10);
+        if (i < 10) wjson_append_numerical(object, key, i);
+        else wjson_set_numerical(object, key, i);
+    }
+    wjson_list_append_boolean(list, true);
+    wjson_list_append_string(list, L"t");
+    wjson_append_list(object, L"l", list);
+    if (!linked_back(object) || count_members(object) != 11) fail(__LINE__, "built tree has broken prev links");
+    wjson_free(object);
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief Checks whether a string is stored straight after its node. Strings allocated separately from an arena
+ *        can land there too, so only a negative answer is conclusive.
+ */
+static int stored_inline(const struct wjson* node, const wjson_char* string)
+{
+    const char* start = (const char*)(node + 1);
+
+    return (const char*)string >= start && (const char*)string < start + 32;
+}
+
+/**
+ * @brief Checks which keys and strings are stored inline, by the parser and by the append functions, and that
+ *        replacing inline strings with longer, shorter and non-string values keeps every value intact. The first
+ *        member is the container's own node and never inline.
+ */
+static void test_inline_strings(void)
+{
+    const char* text = "{\"h\":\"0\",\"k\":\"v\",\"a key far too long to be stored inline\":\"x\",\"id\":"
+                       "\"a string value far too long to be stored inline\"}";
+    const wchar_t* long_key = L"a key far too long to be stored inline";
+    const wchar_t* long_value = L"a replacement value much longer than the original";
+    static const unsigned short expected[] = {0, WJSON_FLAG_INLINE_KEY | WJSON_FLAG_INLINE_STRING,
+                                              WJSON_FLAG_INLINE_STRING, WJSON_FLAG_INLINE_KEY};
+    struct wjson* reference = wjson_parse_buffer_arena(text, strlen(text), scratch);
+    struct wjson* documents[3];
+    struct wjson* member;
+    int which;
+    int i;
+
+    documents[0] = wjson_parse_buffer(text, strlen(text));
+    documents[1] = wjson_parse_buffer_arena(text, strlen(text), scratch);
+    documents[2] = wjson_initialize();
+    wjson_append_string(documents[2], L"h", L"0");
+    wjson_append_string(documents[2], L"k", L"v");
+    wjson_append_string(documents[2], (wchar_t*)long_key, L"x");
+    wjson_append_string(documents[2], L"id", L"a string value far too long to be stored inline");
+    for (which = 0; which < 3; which++)
+    {
+        for (i = 0, member = documents[which]; i < 4 && member != NULL; i++, member = member->next)
+        {
+            unsigned short flags = member->flags & (WJSON_FLAG_INLINE_KEY | WJSON_FLAG_INLINE_STRING);
+
+            if (flags != expected[i] || ((flags & WJSON_FLAG_INLINE_KEY) && !stored_inline(member, member->key))
+                || ((flags & WJSON_FLAG_INLINE_STRING) && !stored_inline(member, member->data_string)))
+                fail(__LINE__, "member %d of document %d is stored wrongly", i, which);
+        }
+        if (!same_tree(documents[which], reference)) fail(__LINE__, "document %d differs", which);
+
+        /* Replacements never write into the inline space beyond the old string */
+        wjson_set_string(documents[which], L"k", (wchar_t*)long_value);
+        member = wjson_get(documents[which], L"k");
+        if (!has_string(member, long_value) || (member->flags & WJSON_FLAG_INLINE_STRING))
+            fail(__LINE__, "longer replacement in document %d is wrong", which);
+        wjson_set_string(documents[which], L"k", L"w");
+        wjson_set_string(documents[which], L"id", L"y");
+        wjson_set_numerical(documents[which], (wchar_t*)long_key, 7);
+        if (!has_string(member, L"w") || !has_string(wjson_get(documents[which], L"id"), L"y")
+            || wjson_get(documents[which], long_key)->data_numerical != 7 || !stored_inline(member, member->key))
+            fail(__LINE__, "replacements in document %d are wrong", which);
+    }
+    wjson_free(documents[0]);
+    wjson_free(documents[2]);
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief Event parser client that logs integers and raw numbers as text.
+ */
+static int log_integer(void* context, int64_t value)
+{
+    char* log = (char*)context;
+
+    sprintf(log + strlen(log), "i%lld ", (long long)value);
+    return 1;
+}
+
+static int log_unsigned(void* context, uint64_t value)
+{
+    char* log = (char*)context;
+
+    sprintf(log + strlen(log), "u%llu ", (unsigned long long)value);
+    return 1;
+}
+
+static int log_double(void* context, double value)
+{
+    char* log = (char*)context;
+
+    sprintf(log + strlen(log), "d%g ", value);
+    return 1;
+}
+
+static int log_raw_number(void* context, const char* text, size_t length)
+{
+    char* log = (char*)context;
+
+    sprintf(log + strlen(log), "r%.*s ", (int)length, text);
+    return 1;
+}
+
+/**
+ * @brief Checks that integers at the edges of the 64-bit ranges and past 2^53 stay exact, that raw numbers are
+ *        serialized verbatim and converted on request, and the integer setters and event callbacks.
+ */
+static void test_integers(void)
+{
+    const char* text = "[9223372036854775807,-9223372036854775808,18446744073709551615,9007199254740993,1.5,"
+                       "18446744073709551616,-0]";
+    const char* raw = "[1.000e+01,-0.0,123456789012345678901234567890,42]";
+    struct wjson_events events = {NULL, NULL, NULL, NULL, NULL, NULL, log_double, NULL, NULL,
+                                  log_integer, log_unsigned, NULL};
+    struct wjson* document = wjson_parse_buffer_flags(text, strlen(text), scratch, WJSON_NUMBER_INTEGERS);
+    struct wjson* object = wjson_initialize();
+    char log[256];
+    char* written;
+    int64_t integer = 0;
+    uint64_t unsigned_integer = 0;
+    double number = 0;
+
+    written = serialize(document);
+    if (!same_text(written, "[9223372036854775807,-9223372036854775808,18446744073709551615,9007199254740993,1.5,"
+                            "1.8446744073709552e19,-0]"))
+        fail(__LINE__, "integers serialized as %s", written ? written : "NULL");
+    free(written);
+    if (wjson_list_get(document, 0)->type != WJSON_TYPE_INTEGER
+        || !wjson_get_int64(wjson_list_get(document, 1), &integer) || integer != INT64_MIN
+        || !(wjson_list_get(document, 2)->flags & WJSON_FLAG_UNSIGNED)
+        || !wjson_get_uint64(wjson_list_get(document, 2), &unsigned_integer) || unsigned_integer != UINT64_MAX
+        || wjson_get_int64(wjson_list_get(document, 2), &integer)
+        || wjson_get_uint64(wjson_list_get(document, 1), &unsigned_integer)
+        || wjson_get_int64(wjson_list_get(document, 4), &integer)
+        || wjson_list_get(document, 5)->type != WJSON_TYPE_NUMERICAL)
+        fail(__LINE__, "integer accessors are wrong");
+
+    document = wjson_parse_buffer_flags(raw, strlen(raw), scratch, WJSON_NUMBER_RAW);
+    written = serialize(document);
+    if (!same_text(written, raw) || wjson_list_get(document, 2)->type != WJSON_TYPE_RAW_NUMBER
+        || !wjson_get_double(wjson_list_get(document, 0), &number) || number != 10
+        || !wjson_get_int64(wjson_list_get(document, 3), &integer) || integer != 42
+        || wjson_get_int64(wjson_list_get(document, 2), &integer))
+        fail(__LINE__, "raw numbers serialized as %s", written ? written : "NULL");
+    free(written);
+
+    log[0] = '\0';
+    wjson_parse_events("[-3,18446744073709551615,2.5,1e400]", 36, &events, log);
+    if (strcmp(log, "i-3 u18446744073709551615 d2.5 dinf ") != 0) fail(__LINE__, "integer events were %s", log);
+    events.on_raw_number = log_raw_number;
+    log[0] = '\0';
+    wjson_parse_events("[-3,2.50]", 9, &events, log);
+    if (strcmp(log, "r-3 r2.50 ") != 0) fail(__LINE__, "raw number events were %s", log);
+
+    wjson_append_integer(object, L"a", INT64_MAX);
+    wjson_append_numerical(object, L"b", 0.5);
+    wjson_set_integer(object, L"b", -9007199254740993);
+    wjson_set_integer(object, L"c", 1);
+    written = serialize(object);
+    if (!same_text(written, "{\"a\":9223372036854775807,\"b\":-9007199254740993,\"c\":1}"))
+        fail(__LINE__, "built integers serialized as %s", written ? written : "NULL");
+    free(written);
+    wjson_free(object);
+    wjson_arena_reset(scratch);
+}
+
+/**
+ * @brief Checks wjson_free on deep and replaced trees, and which trees a destroyed push parser frees. Nothing is
+ *        checked directly: a leak or a double free shows up under a leak checker or AddressSanitizer.
+ */
+static void test_free(void)
+{
+    size_t depth = 200000;
+    struct wjson_push_parser* parser;
+    struct wjson* document;
+    struct wjson* object;
+    const char* text;
+    char* deep;
+    int round;
+
+    /* A tree handed out by wjson_push_parser_root outlives its parser, even one that later failed */
+    parser = wjson_push_parser_create_tree(NULL);
+    if (wjson_push_parser_feed(parser, "{\"a\":1}", 7) != WJSON_PARSE_COMPLETE) fail(__LINE__, "push parse failed");
+    document = wjson_push_parser_root(parser);
+    if (document == NULL || wjson_push_parser_root(parser) != NULL) fail(__LINE__, "root was not handed out once");
+    if (wjson_push_parser_feed(parser, " x", 2) != WJSON_PARSE_ERROR) fail(__LINE__, "trailing garbage accepted");
+    wjson_push_parser_destroy(parser);
+    if (document == NULL || wjson_get(document, L"a") == NULL || wjson_get(document, L"a")->data_numerical != 1)
+        fail(__LINE__, "handed out root was freed with its parser");
+    wjson_free(document);
+
+    /* Trees that were never handed out, complete or not, are freed with the parser */
+    parser = wjson_push_parser_create_tree(NULL);
+    if (wjson_push_parser_feed(parser, "{\"a\":1} x", 9) != WJSON_PARSE_ERROR)
+        fail(__LINE__, "trailing garbage accepted");
+    wjson_push_parser_destroy(parser);
+    parser = wjson_push_parser_create_tree(NULL);
+    text = "{\"a\":[1,{\"b\":\"a string too long to be stored inline";
+    wjson_push_parser_feed(parser, text, strlen(text));
+    wjson_push_parser_destroy(parser);
+
+    /* Nesting far deeper than the C stack could recurse */
+    deep = (char*)malloc(2 * depth + 1);
+    memset(deep, '[', depth);
+    memset(deep + depth, ']', depth);
+    document = wjson_parse_buffer(deep, 2 * depth);
+    if (document == NULL) fail(__LINE__, "deep document failed to parse");
+    wjson_free(document);
+    free(deep);
+
+    /* Replaced containers are freed, and freed nodes are reused */
+    for (round = 0; round < 4; round++)
+    {
+        object = wjson_initialize();
+        wjson_append_object(object, L"o", wjson_parse_buffer(file_document, strlen(file_document)));
+        wjson_set_list(object, L"o", wjson_initialize_list());
+        wjson_set_string(object, L"o", L"no longer a container");
+        wjson_free(object);
+    }
+    wjson_free(NULL);
+    wjson_free(wjson_parse_buffer_arena(file_document, strlen(file_document), scratch));
+    wjson_arena_reset(scratch);
+    wjson_pool_trim();
+}
+
+/**
+ * @brief Checks that a reusable parser gives the same trees and events as the one-shot parsers document after
+ *        document, and that it and the push parser enforce depth and length limits, including on strings whose
+ *        escapes decode to fewer bytes and on a string that arrives one byte at a time.
+ */
+static void test_limits(void)
+{
+    static const char* const accepted[] = {"[[[1]]]", "{\"abcd\":\"wxyz\"}", "[\"\\u00e9\\u00e9\"]",
+                                           "[\"\\\"\\\\ab\"]"};
+    static const char* const rejected[] = {"[[[[1]]]]", "{\"abcde\":1}", "[\"\\u00e9\\u00e9x\"]", "[{\"a\":[{}]}]"};
+    struct wjson_parser* parser = wjson_parser_create();
+    struct wjson_push_parser* push;
+    struct event_log log;
+    struct wjson* document;
+    size_t which;
+    size_t fed;
+    int status;
+
+    for (which = 0; which < 4; which++)
+    {
+        document = wjson_parser_parse(parser, file_document, strlen(file_document), scratch, 0);
+        if (!same_tree(document, wjson_parse_buffer_arena(file_document, strlen(file_document), scratch)))
+            fail(__LINE__, "reused parser differs on document %u", (unsigned)which);
+        log.count = 0;
+        log.limit = 1000;
+        if (wjson_parser_parse_events(parser, event_document, strlen(event_document), &log_events, &log)
+            != WJSON_PARSE_COMPLETE || strcmp(log.events, event_sequence) != 0)
+            fail(__LINE__, "reused parser reported %s", log.events);
+        wjson_arena_reset(scratch);
+    }
+    document = wjson_parser_parse(parser, "[9007199254740993]", 18, scratch, WJSON_NUMBER_INTEGERS);
+    if (document == NULL || document->type != WJSON_TYPE_INTEGER || document->data_integer != 9007199254740993)
+        fail(__LINE__, "reused parser ignored its flags");
+
+    wjson_parser_set_limits(parser, 3, 4);
+    for (which = 0; which < 4; which++)
+    {
+        if (wjson_parser_parse(parser, accepted[which], strlen(accepted[which]), scratch, 0) == NULL)
+            fail(__LINE__, "%s exceeded the limits", accepted[which]);
+        if (wjson_parser_parse(parser, rejected[which], strlen(rejected[which]), scratch, 0) != NULL
+            || wjson_parser_parse_events(parser, rejected[which], strlen(rejected[which]), &log_events, &log)
+               != WJSON_PARSE_ERROR)
+            fail(__LINE__, "%s was within the limits", rejected[which]);
+    }
+    wjson_parser_set_limits(parser, 0, 0);
+    if (wjson_parser_parse(parser, rejected[0], strlen(rejected[0]), scratch, 0) == NULL)
+        fail(__LINE__, "limits were not lifted");
+    wjson_parser_destroy(parser);
+
+    push = wjson_push_parser_create_tree(scratch);
+    wjson_push_parser_set_limits(push, 3, 16);
+    status = wjson_push_parser_feed(push, "[\"", 2);
+    for (fed = 0; fed < 1000 && status == WJSON_PARSE_INCOMPLETE; fed++)
+        status = wjson_push_parser_feed(push, "a", 1);
+    if (status != WJSON_PARSE_ERROR || fed > 6 * 16 + 2)
+        fail(__LINE__, "long string rejected after %u bytes", (unsigned)fed);
+    wjson_push_parser_destroy(push);
+    push = wjson_push_parser_create_tree(scratch);
+    wjson_push_parser_set_limits(push, 3, 16);
+    if (wjson_push_parser_feed(push, "[[[", 3) != WJSON_PARSE_INCOMPLETE
+        || wjson_push_parser_feed(push, "[", 1) != WJSON_PARSE_ERROR)
+        fail(__LINE__, "push parser exceeded its depth limit");
+    wjson_push_parser_destroy(push);
+    wjson_arena_reset(scratch);
+}
+
+int main(void)
+{
+    scratch = wjson_arena_create(0);
+
+    test_parse_file();
+    test_arena();
+    test_list_index();
+    test_keys();
+    test_storage();
+    test_strings();
+    test_parse_numbers();
+    test_format_numbers();
+    test_serialize();
+    test_events();
+    test_push();
+    test_ndjson();
+    test_indexed();
+    test_lazy();
+    test_paths();
+    test_tapes();
+    test_interning();
+    test_node_layout();
+    test_inline_strings();
+    test_integers();
+    test_free();
+    test_limits();
+    wjson_arena_destroy(scratch);
+    wjson_pool_trim();
+
+    if (failures != 0)
+    {
+        fprintf(stderr, "%d check(s) failed\n", failures);
+        return EXIT_FAILURE;
+    }
+    printf("All wjson tests passed\n");
+    return EXIT_SUCCESS;
+}
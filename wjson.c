@@ -5,522 +5,6930 @@
  */
 
 #include "wjson.h"
+#include "wjson_pow5.h"
+
+#include <locale.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef WJSON_UTF8_STORAGE
+#define WJSON_STRCMP strcmp
+#define WJSON_PRI_STRING L"%s"
+#else
+#define WJSON_STRCMP wcscmp
+#define WJSON_PRI_STRING L"%ls"
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define WJSON_HAVE_SSE2 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define WJSON_HAVE_MMAP 1
+#define WJSON_HAVE_UNISTD 1
+#define WJSON_HAVE_PTHREAD 1
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 /**
- * @brief Matches a sequence of wide characters in the input JSON file stream.
+ * @brief Head node of a wjson object or list.
  *
- * This function attempts to match the given sequence of wide characters in the input file stream.
- * If the sequence is found, the file stream position is unchanged, and the function returns 1.
- * If the sequence is not found, the file stream is rewound to its initial position, and the function returns 0.
+ * The head is the node returned by wjson_initialize and friends, and the node data_object and data_list point
+ * to. It doubles as the container's first member, and additionally tracks the container's last member and
+ * member count so appending takes constant time, and the arena (if any) members are allocated from. Heads are
+ * marked with WJSON_FLAG_HEAD; node must stay the first member so a head can be used wherever a struct wjson
+ * is expected.
  *
- * @param file FILE pointer to the input JSON file.
- * @param sequence Wide character sequence to match in the input file stream.
- * @return 1 if the sequence is successfully matched, 0 otherwise.
+ * List heads (WJSON_FLAG_LIST) also keep a growable vector of pointers to their elements, in order, so elements
+ * can be fetched by index in constant time. The first entry is the head node itself. Object heads instead keep
+ * a hash index over their members' keys, built once the object grows past WJSON_INDEX_THRESHOLD members.
  */
-int wjson_match_sequence(FILE* file, const wchar_t* sequence)
+struct wjson_head
 {
-    int index = 0;
-    wint_t wchar;
-    wint_t buffer[1024];
-    int bufferIndex = 0;
-
-    /* Save the current file position to startPos */
-    long startPos = ftell(file);
-
-    while ((wchar = fgetwc(file)) != WEOF && sequence[index] != L'\0')
-    {
-        if (wchar != sequence[index])
-        {
-
-            /* Characters do not match, put them back into the stream */
-            while (bufferIndex > 0)
-            {
-                ungetwc(buffer[--bufferIndex], file);
-            }
-
-            /* Restore the file position to the initial position */
-            fseek(file, startPos, SEEK_SET);
-            return 0;
-        }
-        buffer[bufferIndex++] = wchar;
-        index++;
-    }
-
-    if (sequence[index] == L'\0')
-    {
-        /* Return success if end of sequence is reached */
-        return 1;
-    }
-    else
-    {
-        /* Restore the file position to the initial position & return failure. */
-        fseek(file, startPos, SEEK_SET);
-        return 0;
-    }
-}
-
+    struct wjson node;
+    struct wjson_arena* arena;
+    struct wjson* tail;
+    size_t count;
+    union {
+        struct wjson** elements;
+        struct wjson_index_slot* index;
+    };
+    size_t capacity;
+};
 
+/**
+ * @brief Slot of an object's hash index. Empty slots have a NULL member.
+ */
+struct wjson_index_slot
+{
+    size_t hash;
+    struct wjson* member;
+};
 
+#define WJSON_INDEX_THRESHOLD 8
 
+/*
+ * Keys and strings that fit, together, in this many bytes are stored straight after their node, in the same
+ * allocation (see wjson_append_node_inline), so a 32-byte node and its short strings share a 64-byte line.
+ */
+#define WJSON_INLINE_CAPACITY 32
+#define WJSON_NOT_INLINE ((size_t)-1)
 
 /**
- * @brief Parses a JSON string value from the file stream and returns a wchar_t pointer.
+ * @brief Cursor over an in-memory JSON document, or over one chunk of a document that arrives in pieces.
  *
- * This function reads characters from the file stream until a closing double quote is encountered,
- * storing them in a buffer and null-terminating the string. The buffer is then returned as a wchar_t pointer.
+ * The parse routines walk a UTF-8 byte buffer with a plain pointer rather than pulling wide characters through
+ * stdio, so there is no stream locking, no locale decoding and no seeking back on a failed match. The buffer
+ * does not need to be null terminated; end marks one past its last byte, and base is the offset of start within
+ * the whole document, for error messages. When partial is set more input may follow end, so running out of
+ * bytes part way through a token is not an error; the token routines return WJSON_TOKEN_PARTIAL instead.
  *
- * @param file FILE pointer to the input JSON file.
- * @param wchar Initial wide character, expected to be the opening double quote of the string.
- * @return wchar_t pointer to the parsed string.
- * @note Memory for the string is allocated on the stack and must be used with caution.
- * @author Toby Benjamin Clark
+ * Strings containing escape sequences are unescaped into scratch, a heap buffer that grows as needed and is
+ * reused for every such string in the document; it is released when the parse finishes.
  */
-wchar_t* wjson_parse_value_string(FILE* file, wint_t wchar)
+struct wjson_scanner
 {
-    wint_t buffer[1024];
-    int bufferIndex = 0;
+    const char* start;
+    const char* cursor;
+    const char* end;
+    size_t base;
+    int partial;
+    char* scratch;
+    size_t scratch_capacity;
+};
+
+#define WJSON_TOKEN_PARTIAL (-1)
 
-    while ((wchar = fgetwc(file)) != WEOF && wchar != L'"') buffer[bufferIndex++] = wchar;
+/**
+ * @brief Reports a parse error along with the byte offset at which it occurred.
+ *
+ * @param scanner Scanner positioned at the offending input.
+ * @param message Description of the error.
+ */
+void wjson_parse_error(struct wjson_scanner* scanner, const char* message)
+{
+    fprintf(stderr, "wJson: %s at offset %lu.", message,
+            (unsigned long)(scanner->base + (size_t)(scanner->cursor - scanner->start)));
+}
 
-    /* Null Terminate String */
-    buffer[bufferIndex] = L'\0';
-    wprintf(L"v\"%ls\"\n", buffer);
-    return buffer;
+/**
+ * @brief Advances the scanner past any JSON whitespace (space, tab, line feed & carriage return).
+ *
+ * @param scanner Scanner to advance.
+ */
+void wjson_skip_whitespace(struct wjson_scanner* scanner)
+{
+    while (scanner->cursor < scanner->end)
+    {
+        char c = *scanner->cursor;
+        if (c != ' ' && c != '\t' && c != '\n' && c != '\r') return;
+        scanner->cursor++;
+    }
 }
 
 /**
- * @brief Parses a JSON numeric value from the file stream and returns a double.
+ * @brief Matches a sequence of characters at the current scanner position.
  *
- * This function reads characters from the file stream until a non-numeric character is encountered,
- * storing them in a buffer. The buffer is then null-terminated and parsed as a double value.
+ * This function compares the given sequence against the bytes at the scanner position. If the sequence is
+ * found the scanner is advanced past it and the function returns 1. If it is not found the scanner is left
+ * untouched; as the input is already in memory nothing needs to be pushed back or rewound. If the input ends
+ * part way through the sequence and more may follow, the match is reported as partial.
  *
- * @param file FILE pointer to the input JSON file.
- * @param firstChar Initial wide character, expected to be the first character of the numeric value.
- * @return Parsed double value.
- * @note The buffer is null-terminated to form a string before parsing.
- * @author Toby Benjamin Clark
+ * @param scanner Scanner over the input JSON document.
+ * @param sequence Null terminated sequence to match.
+ * @return 1 if the sequence is successfully matched, WJSON_TOKEN_PARTIAL if the input so far is a proper prefix
+ *         of it, 0 otherwise.
  */
-double wjson_parse_double(FILE* file, wint_t firstChar)
+int wjson_match_sequence(struct wjson_scanner* scanner, const char* sequence)
 {
-    wchar_t buffer[1024];
-    int bufferIndex = 0;
-
-    buffer[bufferIndex++] = firstChar;
+    size_t length = strlen(sequence);
+    size_t available = (size_t)(scanner->end - scanner->cursor);
 
-    /* Append characters while they are numerical */
-    wint_t wchar;
-    while ((wchar = fgetwc(file)) != WEOF && (iswdigit(wchar) || wchar == L'.' || wchar == L'-'))
+    if (available < length)
     {
-        buffer[bufferIndex++] = wchar;
+        if (scanner->partial && memcmp(scanner->cursor, sequence, available) == 0) return WJSON_TOKEN_PARTIAL;
+        return 0;
     }
+    if (memcmp(scanner->cursor, sequence, length) != 0) return 0;
 
-    /* Null Terminate the Buffer */
-    buffer[bufferIndex] = L'\0';
-
-    /* Calculate & return result */
-    double result;
-    swscanf(buffer, L"%lf", &result);
-    return result;
+    scanner->cursor += length;
+    return 1;
 }
 
 /**
- * @brief Parses a JSON array from the file stream and returns a wjson pointer.
+ * @brief Decodes a run of UTF-8 bytes into a null terminated wide character string.
  *
- * This function reads characters from the file stream, parsing values until the end of the array is reached.
- * Parsed values are appended to a wjson list. The resulting wjson list is then returned.
+ * At most capacity - 1 wide characters are written, followed by a null terminator, and the return value is the
+ * length the whole decoded string would have, in the manner of swprintf. UTF-8 never yields more code points
+ * than it has bytes, so a capacity of length + 1 always suffices. Malformed or truncated sequences are decoded
+ * as U+FFFD rather than rejected.
  *
- * @param file FILE pointer to the input JSON file.
- * @return wjson pointer to the parsed JSON array.
- * @note The caller is responsible for freeing the allocated memory.
- * @author Toby Benjamin Clark
+ * @param source UTF-8 bytes to decode.
+ * @param length Number of bytes in source.
+ * @param destination Buffer receiving the decoded wide characters; may be NULL if capacity is 0.
+ * @param capacity Number of wide characters destination has room for, including the null terminator.
+ * @return Number of wide characters in the decoded string, excluding the null terminator.
  */
-struct wjson* wjson_parse_list(FILE* file)
+size_t wjson_decode_utf8(const char* source, size_t length, wchar_t* destination, size_t capacity)
 {
-    wint_t wchar;
-    /* If the first character is not an opening square bracket, return NULL */
-    if ((wchar = fgetwc(file)) != L'[') return NULL;
-
-    /* Initialize a wjson list to store parsed values */
-    struct wjson* list_node = wjson_initialize_list();
+    const unsigned char* byte = (const unsigned char*)source;
+    const unsigned char* end = byte + length;
+    size_t written = 0;
 
-    /* Loop through characters until the end of the array or end of file is reached */
-    while ((wchar = fgetwc(file)) != L']' && wchar != WEOF)
+    while (byte < end)
     {
-        /* If the character is a double quote, parse a string value and append it to the list */
-        if (wchar == L'"')
-        {
-            wchar_t* parsed_string = wjson_parse_value_string(file, wchar);
-            wjson_list_append_string(list_node, parsed_string);
-        }
-            /* If the character is an opening curly brace, parse an object value and append it to the list */
-        else if (wchar == L'{')
-        {
-            ungetwc(wchar, file);
-            wjson_list_append_object(list_node, wjson_parse_subobj(file));
-        }
-            /* If the character is an opening square bracket, parse a nested array value and append it to the list */
-        else if (wchar == L'[')
+        unsigned long code_point;
+        int continuation;
+
+        /* ASCII needs no decoding */
+        if (*byte < 0x80)
         {
-            ungetwc(wchar, file);
-            wjson_list_append_object(list_node, wjson_parse_list(file));
+            if (written + 1 < capacity) destination[written] = (wchar_t)*byte;
+            written++;
+            byte++;
+            continue;
         }
-            /* If the character sequence matches "true", parse a boolean true value and append it to the list */
-        else if (wjson_match_sequence(file, L"true"))
+
+        /* Work out the sequence length from the lead byte */
+        if ((*byte & 0xE0) == 0xC0)
         {
-            wjson_list_append_boolean(list_node, true);
+            code_point = *byte & 0x1F;
+            continuation = 1;
         }
-            /* If the character sequence matches "false", parse a boolean false value and append it to the list */
-        else if (wjson_match_sequence(file, L"false"))
+        else if ((*byte & 0xF0) == 0xE0)
         {
-            wjson_list_append_boolean(list_node, false);
+            code_point = *byte & 0x0F;
+            continuation = 2;
         }
-            /* If the character sequence matches "null", parse a null value and append it to the list */
-        else if (wjson_match_sequence(file, L"null"))
+        else if ((*byte & 0xF8) == 0xF0)
         {
-            wjson_list_append_string(list_node, L"null");
+            code_point = *byte & 0x07;
+            continuation = 3;
         }
-            /* If the character is a digit, dot, or minus sign, parse a numerical value and append it to the list */
-        else if (iswdigit(wchar) || wchar == L'.' || wchar == L'-')
+        else
         {
-            double parsedValue = wjson_parse_double(file, wchar);
-            wjson_list_append_numerical(list_node, parsedValue);
+            code_point = 0xFFFD;
+            continuation = 0;
         }
-            /* Continue to the next character if none of the conditions are met */
-        else
+        byte++;
+
+        /* Fold in the continuation bytes */
+        while (continuation > 0 && byte < end && (*byte & 0xC0) == 0x80)
         {
-            continue;
+            code_point = (code_point << 6) | (*byte++ & 0x3F);
+            continuation--;
         }
+        if (continuation != 0) code_point = 0xFFFD;
+
+        if (written + 1 < capacity) destination[written] = (wchar_t)code_point;
+        written++;
     }
-    return list_node;
+
+    if (capacity > 0) destination[(written < capacity) ? written : capacity - 1] = L'\0';
+    return written;
 }
 
 /**
- * @brief Parses a JSON value from the file stream and appends it to a wjson node.
- *
- * This function reads characters from the file stream, determining the type of JSON value,
- * and appends it to the provided wjson node using the specified key.
+ * @brief Encodes a null terminated wide character string as UTF-8.
  *
- * @param file FILE pointer to the input JSON file.
- * @param key Array of wide characters representing the key associated with the JSON value.
- * @param wjson_node Pointer to the wjson node to which the parsed value will be appended.
- * @note The key is used for identifying the field within the wjson node.
- * @note The caller is responsible for freeing the allocated memory for the key.
- * @note If a string value is parsed, its memory is allocated on the stack and must be used with caution.
- * @author Toby Benjamin Clark
+ * @param source Wide string to encode.
+ * @param destination Buffer receiving the UTF-8 bytes and a null terminator, or NULL to only measure.
+ * @return Number of bytes in the encoding, excluding the null terminator.
  */
-void wjson_parse_value(FILE* file, wint_t key[1024], struct wjson* wjson_node)
+size_t wjson_encode_utf8(const wchar_t* source, char* destination)
 {
-    wint_t wchar;
-    while ((wchar = fgetwc(file)) != WEOF)
+    size_t written = 0;
+
+    for (; *source != L'\0'; source++)
     {
-        /* If the character is a double quote, parse a string value */
-        if (wchar == L'"')
-        {
-            wchar_t* parsed_string = wjson_parse_value_string(file, wchar);
-            wjson_append_string(wjson_node, key, parsed_string);
-            return;
-        }
-            /* If the character is an opening curly brace, parse an object value */
-        else if (wchar == L'{')
-        {
-            ungetwc(wchar, file);
-            wjson_append_object(wjson_node, key, wjson_parse_subobj(file));
-            return;
-        }
-            /* If the character is an opening square bracket, parse an array value */
-        else if (wchar == L'[')
+        unsigned long code_point = (unsigned long)*source;
+        char bytes[4];
+        int count, i;
+
+        if (code_point < 0x80)
         {
-            ungetwc(wchar, file);
-            wjson_append_list(wjson_node, key, wjson_parse_list(file));
-            return;
+            bytes[0] = (char)code_point;
+            count = 1;
         }
-            /* If the character sequence matches "true", parse a boolean true value */
-        else if (wjson_match_sequence(file, L"true"))
+        else if (code_point < 0x800)
         {
-            wjson_append_boolean(wjson_node, key, true);
-            return;
+            bytes[0] = (char)(0xC0 | (code_point >> 6));
+            bytes[1] = (char)(0x80 | (code_point & 0x3F));
+            count = 2;
         }
-            /* If the character sequence matches "false", parse a boolean false value */
-        else if (wjson_match_sequence(file, L"false"))
+        else if (code_point < 0x10000)
         {
-            wjson_append_boolean(wjson_node, key, false);
-            return;
+            bytes[0] = (char)(0xE0 | (code_point >> 12));
+            bytes[1] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            bytes[2] = (char)(0x80 | (code_point & 0x3F));
+            count = 3;
         }
-            /* If the character sequence matches "null", parse a null value */
-        else if (wjson_match_sequence(file, L"null"))
+        else
         {
-            wjson_append_string(wjson_node, key, L"null");
-            return;
+            if (code_point > 0x10FFFF) code_point = 0xFFFD;
+            bytes[0] = (char)(0xF0 | (code_point >> 18));
+            bytes[1] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+            bytes[2] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+            bytes[3] = (char)(0x80 | (code_point & 0x3F));
+            count = 4;
         }
-            /* If the character is a digit, dot, or minus sign, parse a numerical value */
-        else if (iswdigit(wchar) || wchar == L'.' || wchar == L'-')
+
+        if (destination != NULL)
         {
-            double parsedValue = wjson_parse_double(file, wchar);
-            wjson_append_numerical(wjson_node, key, parsedValue);
-            return;
+            for (i = 0; i < count; i++) destination[written + i] = bytes[i];
         }
-        continue;
+        written += count;
     }
+
+    if (destination != NULL) destination[written] = '\0';
+    return written;
 }
 
 /**
- * @brief Parses a JSON key and its associated value from the file stream.
+ * @brief Returns the index of the lowest set bit of a non-zero mask.
  *
- * This function reads characters from the file stream, parsing a key and its associated value.
- * The parsed key and value are then appended to the given wjson node.
+ * @param mask Mask with at least one bit set.
+ * @return Index of the lowest set bit.
+ */
+int wjson_lowest_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int index = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * @brief Finds the first byte in a run that ends or interrupts a JSON string.
  *
- * @param file FILE pointer to the input JSON file.
- * @param wchar Initial wide character, expected to be the opening double quote of the key.
- * @param wjson_node Pointer to the wjson node to which the parsed key and value will be appended.
- * @note The parsed key is expected to be a string, and its memory is allocated on the stack.
- * @author Toby Benjamin Clark
+ * Returns the first double quote, backslash or control character (below 0x20) in the run, or end if there is
+ * none. The run is examined 32 bytes at a time with AVX2 when the compiler targets it, 16 bytes at a time with
+ * SSE2 otherwise, and a byte at a time on other targets and for the final partial block.
+ *
+ * @param cursor First byte to examine.
+ * @param end One past the last byte to examine.
+ * @return Pointer to the first special byte, or end.
  */
-void wjson_parse_key(FILE* file, wint_t wchar, struct wjson* wjson_node)
+const char* wjson_scan_string(const char* cursor, const char* end)
 {
-    if (wchar != L'"') return;
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i backslash = _mm256_set1_epi8('\\');
+    const __m256i control = _mm256_set1_epi8(0x1F);
+
+    while (end - cursor >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)cursor);
 
-    /* Accumulate characters into a buffer until closing double quote is encountered */
-    wint_t buffer[1024];
-    int bufferIndex = 0;
+        /* Bytes equal to their unsigned minimum with 0x1F are control characters */
+        __m256i special = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, quote), _mm256_cmpeq_epi8(block, backslash)),
+            _mm256_cmpeq_epi8(_mm256_min_epu8(block, control), block));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
 
-    while ((wchar = fgetwc(file)) != WEOF && wchar != L'"') buffer[bufferIndex++] = wchar;
+        if (mask != 0) return cursor + wjson_lowest_bit(mask);
+        cursor += 32;
+    }
+#elif defined(WJSON_HAVE_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+
+    while (end - cursor >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)cursor);
 
-    /* Null Terminate String */
-    buffer[bufferIndex] = L'\0';
-    wprintf(L"k\"%ls\"   ", buffer);
+        /* Bytes equal to their unsigned minimum with 0x1F are control characters */
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(block, control), block));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(special);
 
-    /* Parse : */
-    while ((wchar = fgetwc(file)) != WEOF && wchar != L':') continue;
+        if (mask != 0) return cursor + wjson_lowest_bit(mask);
+        cursor += 16;
+    }
+#endif
 
-    /* Parse Value */
-    wjson_parse_value(file, buffer, wjson_node);
+    while (cursor < end)
+    {
+        unsigned char c = (unsigned char)*cursor;
+        if (c == '"' || c == '\\' || c < 0x20) return cursor;
+        cursor++;
+    }
+    return end;
 }
 
 /**
- * @brief Parses a JSON object from the file stream and returns a wjson pointer.
- *
- * This function reads characters from the file stream, parsing key-value pairs until the end of the object is reached.
- * Parsed key-value pairs are appended to a wjson object. The resulting wjson object is then returned.
+ * @brief Finds the closing double quote of a string whose contents may be split across chunks.
  *
- * @param file FILE pointer to the input JSON file.
- * @return wjson pointer to the parsed JSON object.
- * @note The caller is responsible for freeing the allocated memory.
- * @author Toby Benjamin Clark
+ * @param cursor First byte of string contents to examine.
+ * @param end One past the last byte to examine.
+ * @param escaped Whether the byte at cursor is escaped; updated to describe the byte at end.
+ * @return Pointer to the closing double quote, or end if the string continues past end.
  */
-struct wjson* wjson_parse_subobj(FILE* file)
+const char* wjson_find_string_end(const char* cursor, const char* end, int* escaped)
 {
-    struct wjson* wjson_node = wjson_initialize();
-
-    printf("\nSUBOBJ\n");
-    wint_t wchar;
-    while ((wchar = fgetwc(file)) != WEOF && wchar != L'{') continue;
-    while ((wchar = fgetwc(file)) != WEOF && wchar != L'}')
+    while (cursor < end)
     {
-        wjson_parse_key(file, wchar, wjson_node);
+        if (*escaped)
+        {
+            *escaped = 0;
+            cursor++;
+            continue;
+        }
+
+        cursor = wjson_scan_string(cursor, end);
+        if (cursor == end) break;
+        if (*cursor == '"') return cursor;
+        if (*cursor == '\\') *escaped = 1;
+        cursor++;
     }
-    printf("END SUBOBJ\n");
-    return wjson_node;
+    return end;
 }
 
 /**
- * @brief Parses a JSON file and returns a wjson pointer representing the entire JSON structure.
+ * @brief Ensures the scanner's scratch buffer can hold at least the given number of bytes.
  *
- * This function opens the specified JSON file, parses its contents, and returns a wjson pointer
- * representing the entire JSON structure. The caller is responsible for freeing the allocated memory.
+ * The buffer grows geometrically so unescaping a string costs amortised constant time per byte.
  *
- * @param filename Name of the JSON file to parse.
- * @return wjson pointer to the parsed JSON structure.
- * @note Memory allocation failure results in an error message and program exit.
- * @author Toby Benjamin Clark
+ * @param scanner Scanner owning the scratch buffer.
+ * @param required Number of bytes needed.
+ * @return 1 on success, 0 on memory allocation failure.
  */
-struct wjson* wjson_parse(const char* filename)
+int wjson_reserve_scratch(struct wjson_scanner* scanner, size_t required)
 {
-    FILE* file = fopen(filename, "r");
+    size_t capacity = (scanner->scratch_capacity == 0) ? 256 : scanner->scratch_capacity;
+    char* scratch;
 
-    if (file == NULL)
+    if (required <= scanner->scratch_capacity) return 1;
+    while (capacity < required) capacity *= 2;
+
+    scratch = (char*)realloc(scanner->scratch, capacity);
+    if (scratch == NULL)
     {
-        wprintf(L"Error opening file: %s\n", filename);
-        return NULL;
+        fprintf(stderr, "wJson: Failed to allocate memory for string scratch buffer.");
+        return 0;
     }
-    struct wjson* wjson_node = wjson_parse_subobj(file);
-
 
-    fclose(file);
-    return wjson_node;
+    scanner->scratch = scratch;
+    scanner->scratch_capacity = capacity;
+    return 1;
 }
 
-
-
-
-
 /**
- * @brief Prints indentation spaces based on the specified indentation level.
- *
- * This function prints indentation spaces to the standard output based on the specified indentation level.
+ * @brief Reads the four hexadecimal digits of a \\u escape.
  *
- * @param indentation Number of indentation levels to be printed.
+ * @param digits First of the four digits; the caller has checked that four bytes are available.
+ * @param value Receives the decoded code unit.
+ * @return 1 on success, 0 if any digit is not hexadecimal.
  */
-void wjson_print_indentation(int indentation)
+int wjson_parse_hex4(const char* digits, unsigned long* value)
 {
-    int indentation_counter = 0;
-    for (indentation_counter = 0; indentation_counter < indentation; indentation_counter++)
-        wprintf(L"\t");
-    return;
+    int i;
+
+    *value = 0;
+    for (i = 0; i < 4; i++)
+    {
+        char c = digits[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') *value |= (unsigned long)(c - '0');
+        else if (c >= 'a' && c <= 'f') *value |= (unsigned long)(c - 'a' + 10);
+        else if (c >= 'A' && c <= 'F') *value |= (unsigned long)(c - 'A' + 10);
+        else return 0;
+    }
+    return 1;
 }
 
 /**
- * @brief Prints a JSON list to the standard output with specified indentation.
+ * @brief Scans a JSON string, returning its unescaped contents as a span of UTF-8 bytes.
  *
- * This function recursively prints the elements of a JSON list to the standard output with proper indentation.
+ * The scanner must be positioned just past the opening double quote. Runs of ordinary bytes are skipped with
+ * wjson_scan_string. A string without escape sequences is returned in place, as a span of the source buffer;
+ * otherwise it is unescaped into the scanner's scratch buffer and the span points there, valid until the next
+ * string is scanned. Either way it is converted to storage with wjson_store_utf8. Unescaped control characters
+ * and malformed escapes are parse errors; \\u escapes, including surrogate pairs, are encoded as UTF-8.
  *
- * @param head Pointer to the head of the wjson list.
- * @param indentation Number of indentation levels for proper formatting.
+ * A string whose contents run past limit is a parse error, detected before more than a few bytes past the limit
+ * have been copied to scratch, so a limit also bounds the memory an oversized string can take.
+ *
+ * @param scanner Scanner over the input JSON document.
+ * @param start Receives the first byte of the string's contents.
+ * @param length Receives the number of bytes in the string's contents.
+ * @param limit Maximum number of bytes in the contents, or 0 for no limit.
+ * @return 1 on success, 0 on a parse error, or WJSON_TOKEN_PARTIAL if a partial scanner ends inside the string.
  */
-void wjson_print_list(struct wjson* head, int indentation)
+int wjson_parse_value_string(struct wjson_scanner* scanner, const char** start, size_t* length, size_t limit)
 {
-    struct wjson* current = head;
-    wprintf(L"[\n");
+    const char* run = scanner->cursor;
+    size_t written = 0;
 
-    while (current != NULL)
+    scanner->cursor = wjson_scan_string(scanner->cursor, scanner->end);
+
+    /* Fast path: no escapes, so the contents can be taken straight from the source */
+    if (scanner->cursor < scanner->end && *scanner->cursor == '"')
     {
-        /* Print indentation for each element in the list */
-        wjson_print_indentation(indentation + 1);
+        *start = run;
+        *length = (size_t)(scanner->cursor - run);
+        if (limit != 0 && *length > limit)
+        {
+            wjson_parse_error(scanner, "String exceeds length limit");
+            return 0;
+        }
+        scanner->cursor++;
+        return 1;
+    }
 
-        switch (current->type)
+    for (;;)
+    {
+        size_t run_length = (size_t)(scanner->cursor - run);
+        unsigned long code_point;
+        char escape;
+
+        if (scanner->cursor == scanner->end)
         {
-            case WJSON_TYPE_NUMERICAL:
-                wprintf(L"%f", current->data_numerical);
-                break;
-            case WJSON_TYPE_STRING:
-                wprintf(L"\"%ls\"", current->data_string);
-                break;
-            case WJSON_TYPE_BOOLEAN:
-                if (current->data_bool) wprintf(L"true");
-                else wprintf(L"false");
-                break;
-            case WJSON_TYPE_OBJECT:
-                /* Recursively print an object */
-                wjson_print(current->data_object, indentation + 1);
-                break;
-            case WJSON_TYPE_LIST:
-                /* Recursively print a nested list */
-                wjson_print_list(current->data_list, indentation + 1);
-                break;
-            case WJSON_TYPE_NULL:
-                wprintf(L"null");
+            if (scanner->partial) return WJSON_TOKEN_PARTIAL;
+            wjson_parse_error(scanner, "Unterminated string");
+            return 0;
+        }
+        if ((unsigned char)*scanner->cursor < 0x20)
+        {
+            wjson_parse_error(scanner, "Unescaped control character in string");
+            return 0;
+        }
+
+        /* Copy the run of ordinary bytes; an escape adds at most four more */
+        if (limit != 0 && written + run_length > limit)
+        {
+            wjson_parse_error(scanner, "String exceeds length limit");
+            return 0;
+        }
+        if (!wjson_reserve_scratch(scanner, written + run_length + 4)) return 0;
+        memcpy(scanner->scratch + written, run, run_length);
+        written += run_length;
+
+        if (*scanner->cursor == '"')
+        {
+            scanner->cursor++;
+            break;
+        }
+
+        /* Near the end of a partial scanner, an unterminated string may yet complete a cut off escape */
+        if (scanner->partial && scanner->end - scanner->cursor < 12)
+        {
+            int escaped = 0;
+            if (wjson_find_string_end(scanner->cursor, scanner->end, &escaped) == scanner->end)
+                return WJSON_TOKEN_PARTIAL;
+        }
+        if (scanner->end - scanner->cursor < 2)
+        {
+            wjson_parse_error(scanner, "Unterminated string");
+            return 0;
+        }
+        escape = scanner->cursor[1];
+        scanner->cursor += 2;
+
+        switch (escape)
+        {
+            case '"': scanner->scratch[written++] = '"'; break;
+            case '\\': scanner->scratch[written++] = '\\'; break;
+            case '/': scanner->scratch[written++] = '/'; break;
+            case 'b': scanner->scratch[written++] = '\b'; break;
+            case 'f': scanner->scratch[written++] = '\f'; break;
+            case 'n': scanner->scratch[written++] = '\n'; break;
+            case 'r': scanner->scratch[written++] = '\r'; break;
+            case 't': scanner->scratch[written++] = '\t'; break;
+            case 'u':
+                if (scanner->end - scanner->cursor < 4 || !wjson_parse_hex4(scanner->cursor, &code_point))
+                {
+                    wjson_parse_error(scanner, "Invalid \\u escape");
+                    return 0;
+                }
+                scanner->cursor += 4;
+
+                /* A high surrogate must be followed by an escaped low surrogate */
+                if (code_point >= 0xD800 && code_point <= 0xDBFF)
+                {
+                    unsigned long low;
+
+                    if (scanner->end - scanner->cursor < 6 || scanner->cursor[0] != '\\' || scanner->cursor[1] != 'u'
+                        || !wjson_parse_hex4(scanner->cursor + 2, &low) || low < 0xDC00 || low > 0xDFFF)
+                    {
+                        wjson_parse_error(scanner, "Unpaired surrogate in \\u escape");
+                        return 0;
+                    }
+                    scanner->cursor += 6;
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                }
+                else if (code_point >= 0xDC00 && code_point <= 0xDFFF)
+                {
+                    wjson_parse_error(scanner, "Unpaired surrogate in \\u escape");
+                    return 0;
+                }
+
+                /* Encode the code point as UTF-8 */
+                if (code_point < 0x80)
+                {
+                    scanner->scratch[written++] = (char)code_point;
+                }
+                else if (code_point < 0x800)
+                {
+                    scanner->scratch[written++] = (char)(0xC0 | (code_point >> 6));
+                    scanner->scratch[written++] = (char)(0x80 | (code_point & 0x3F));
+                }
+                else if (code_point < 0x10000)
+                {
+                    scanner->scratch[written++] = (char)(0xE0 | (code_point >> 12));
+                    scanner->scratch[written++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+                    scanner->scratch[written++] = (char)(0x80 | (code_point & 0x3F));
+                }
+                else
+                {
+                    scanner->scratch[written++] = (char)(0xF0 | (code_point >> 18));
+                    scanner->scratch[written++] = (char)(0x80 | ((code_point >> 12) & 0x3F));
+                    scanner->scratch[written++] = (char)(0x80 | ((code_point >> 6) & 0x3F));
+                    scanner->scratch[written++] = (char)(0x80 | (code_point & 0x3F));
+                }
                 break;
+            default:
+                scanner->cursor -= 2;
+                wjson_parse_error(scanner, "Invalid escape sequence");
+                return 0;
         }
 
-        /* If not the last entry, print a comma and a new line */
-        if (current->next != NULL) wprintf(L",");
-        wprintf(L"\n");
+        /* Skip to the next special byte */
+        run = scanner->cursor;
+        scanner->cursor = wjson_scan_string(scanner->cursor, scanner->end);
+    }
 
-        current = current->next;
+    if (limit != 0 && written > limit)
+    {
+        wjson_parse_error(scanner, "String exceeds length limit");
+        return 0;
     }
+    *start = scanner->scratch;
+    *length = written;
+    return 1;
+}
+
+/**
+ * @brief Multiplies two 64-bit integers, returning the low half of the product and storing the high half.
+ *
+ * @param a First factor.
+ * @param b Second factor.
+ * @param high Receives the high 64 bits of the product.
+ * @return Low 64 bits of the product.
+ */
+uint64_t wjson_multiply_64(uint64_t a, uint64_t b, uint64_t* high)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 product = (unsigned __int128)a * b;
+    *high = (uint64_t)(product >> 64);
+    return (uint64_t)product;
+#else
+    uint64_t a_low = a & 0xFFFFFFFF, a_high = a >> 32;
+    uint64_t b_low = b & 0xFFFFFFFF, b_high = b >> 32;
+    uint64_t low_low = a_low * b_low;
+    uint64_t high_low = a_high * b_low;
+    uint64_t low_high = a_low * b_high;
+
+    /* Cannot overflow: (2^32 - 1)^2 + 2 * (2^32 - 1) < 2^64 */
+    uint64_t middle = (low_low >> 32) + (high_low & 0xFFFFFFFF) + low_high;
+
+    *high = a_high * b_high + (high_low >> 32) + (middle >> 32);
+    return (middle << 32) | (low_low & 0xFFFFFFFF);
+#endif
+}
 
-    /* Print indentation for the closing square bracket */
-    wjson_print_indentation(indentation);
-    wprintf(L"]");
+/**
+ * @brief Counts the leading zero bits of a non-zero 64-bit integer.
+ *
+ * @param value Integer with at least one bit set.
+ * @return Number of leading zero bits.
+ */
+int wjson_leading_zeros_64(uint64_t value)
+{
+#if defined(__GNUC__)
+    return __builtin_clzll(value);
+#else
+    int count = 0;
+    while ((value & ((uint64_t)1 << 63)) == 0)
+    {
+        value <<= 1;
+        count++;
+    }
+    return count;
+#endif
 }
 
 /**
- * @brief Prints a JSON object to the standard output with specified indentation.
+ * @brief Converts w * 10^q to the nearest double with the Eisel-Lemire algorithm.
  *
- * This function recursively prints the key-value pairs of a JSON object to the standard output with proper indentation.
+ * The significand is multiplied by a 128-bit approximation of 5^q from wjson_pow5_table, which almost always
+ * determines the correctly rounded result outright. In the rare cases where the truncated product cannot decide
+ * between two neighbouring doubles, or the result would overflow, the function gives up and the caller falls
+ * back to strtod.
  *
- * @param head Pointer to the head of the wjson object.
- * @param indentation Number of indentation levels for proper formatting.
+ * @param w Decimal significand; must be non-zero.
+ * @param q Decimal exponent.
+ * @param negative Whether the number is negative.
+ * @param result Receives the correctly rounded double.
+ * @return 1 on success, 0 if the caller must fall back to a slower conversion.
  */
-void wjson_print(struct wjson* head, int indentation)
+int wjson_eisel_lemire(uint64_t w, int q, int negative, double* result)
 {
-    struct wjson* current = head;
-    wprintf(L"{\n");
+    uint64_t low, high, mantissa, bits;
+    int leading_zeros, upper_bit;
+    long exponent;
 
-    while (current != NULL)
+    if (q < WJSON_POW5_SMALLEST)
     {
-        /* Print indentation for each key-value pair in the object */
-        wjson_print_indentation(indentation + 1);
-
-        /* Print the key */
-        wprintf(L"\"%ls\" : ", current->key);
+        bits = (uint64_t)negative << 63;
+        memcpy(result, &bits, sizeof(double));
+        return 1;
+    }
+    if (q > WJSON_POW5_LARGEST) return 0;
 
-        switch (current->type)
-        {
-            case WJSON_TYPE_NUMERICAL:
-                wprintf(L"%f", current->data_numerical);
-                break;
-            case WJSON_TYPE_STRING:
-                wprintf(L"\"%ls\"", current->data_string);
-                break;
-            case WJSON_TYPE_BOOLEAN:
-                if (current->data_bool) wprintf(L"true");
-                else wprintf(L"false");
-                break;
-            case WJSON_TYPE_OBJECT:
-                /* Recursively print a nested object */
-                wjson_print(current->data_object, indentation + 1);
-                break;
-            case WJSON_TYPE_LIST:
-                /* Recursively print a nested list */
-                wjson_print_list(current->data_list, indentation + 1);
-                break;
-            case WJSON_TYPE_NULL:
-                wprintf(L"null");
-                break;
-        }
+    /* Normalise the significand and take the high half of its product with 5^q */
+    leading_zeros = wjson_leading_zeros_64(w);
+    w <<= leading_zeros;
+    low = wjson_multiply_64(w, wjson_pow5_table[2 * (q - WJSON_POW5_SMALLEST)], &high);
 
-        /* If not the last entry, print a comma and a new line */
-        if (current->next != NULL) wprintf(L",");
-        wprintf(L"\n");
+    /* Fold in the low half of 5^q when the truncation could affect rounding */
+    if ((high & 0x1FF) == 0x1FF && low + w < low)
+    {
+        uint64_t second_high;
+        uint64_t second_low = wjson_multiply_64(w, wjson_pow5_table[2 * (q - WJSON_POW5_SMALLEST) + 1], &second_high);
+        uint64_t middle = low + second_high;
 
-        current = current->next;
+        if (middle < low) high++;
+        if (middle + 1 == 0 && (high & 0x1FF) == 0x1FF && second_low + w < second_low) return 0;
+        low = middle;
     }
 
-    /* Print indentation for the closing curly brace */
-    wjson_print_indentation(indentation);
-    wprintf(L"}");
-}
+    /* Keep 54 bits (the 53 bit significand plus a rounding bit) and work out the binary exponent, which is
+     * floor(q * log2(10)) plus the bias and the normalisation shifts */
+    upper_bit = (int)(high >> 63);
+    mantissa = high >> (upper_bit + 9);
+    leading_zeros += 1 ^ upper_bit;
+    exponent = ((217706L * q) >> 16) + 1024 + 63 - leading_zeros;
 
+    /* Subnormal results */
+    if (exponent <= 0)
+    {
+        if (-exponent + 1 >= 64)
+        {
+            bits = (uint64_t)negative << 63;
+            memcpy(result, &bits, sizeof(double));
+            return 1;
+        }
+        mantissa >>= -exponent + 1;
+        mantissa += mantissa & 1;
+        mantissa >>= 1;
+        exponent = (mantissa < ((uint64_t)1 << 52)) ? 0 : 1;
+        bits = (mantissa & (((uint64_t)1 << 52) - 1)) | ((uint64_t)exponent << 52) | ((uint64_t)negative << 63);
+        memcpy(result, &bits, sizeof(double));
+        return 1;
+    }
 
+    /* An exact product halfway between two doubles rounds to even */
+    if (low == 0 && (high & 0x1FF) == 0 && (mantissa & 3) == 1)
+    {
+        if ((mantissa << (upper_bit + 64 - 53 - 2)) == high) mantissa &= ~(uint64_t)1;
+    }
 
+    mantissa += mantissa & 1;
+    mantissa >>= 1;
+    if (mantissa >= ((uint64_t)2 << 52))
+    {
+        mantissa = (uint64_t)1 << 52;
+        exponent++;
+    }
+    if (exponent > 2046) return 0;
 
+    bits = (mantissa & (((uint64_t)1 << 52) - 1)) | ((uint64_t)exponent << 52) | ((uint64_t)negative << 63);
+    memcpy(result, &bits, sizeof(double));
+    return 1;
+}
 
-/*
- * @brief Initializes a new wjson instance and allocates memory for it.
+/**
+ * @brief Converts a validated JSON number with strtod, independently of the current locale.
  *
- * This function allocates memory for a new wjson instance, initializes its
- * members to default values (NULL, 0, false), and returns a pointer to the
- * newly created instance.
+ * strtod expects the locale's decimal point, so the copy handed to it has '.' replaced accordingly.
  *
- * @return Pointer to the newly initialized wjson instance.
- * @note Memory allocation failure results in an error message and program exit.
- * @author Toby Benjamin Clark
+ * @param start First character of the number.
+ * @param length Number of characters in the number.
+ * @param result Receives the converted value.
+ * @return 1 on success, 0 on memory allocation failure.
  */
-struct wjson* wjson_initialize()
+int wjson_strtod(const char* start, size_t length, double* result)
 {
-    /* Allocating Memory for new struct wjson pointer */
-    struct wjson* new_node = (struct wjson*)malloc(sizeof(struct wjson));
-    if (new_node == NULL)
+    char buffer[128];
+    char* copy = (length < sizeof(buffer)) ? buffer : (char*)malloc(length + 1);
+    char decimal_point = localeconv()->decimal_point[0];
+    size_t i;
+
+    if (copy == NULL)
     {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
-        exit(EXIT_FAILURE);
+        fprintf(stderr, "wJson: Failed to allocate memory for number conversion.");
+        return 0;
     }
 
-    /* Initialize Members to NULL */
-    new_node->type = 0;
-    new_node->prev = NULL;
-    new_node->next = NULL;
-    new_node->key = NULL;
+    for (i = 0; i < length; i++) copy[i] = (start[i] == '.') ? decimal_point : start[i];
+    copy[length] = '\0';
+    *result = strtod(copy, NULL);
+
+    if (copy != buffer) free(copy);
+    return 1;
+}
+
+/**
+ * @brief A JSON number as scanned, before any conversion.
+ *
+ * start and end delimit the source text. Up to 19 significant digits are held in significand, scaled by ten to
+ * the power of exponent; truncated records that non-zero digits past the 19th were dropped. integral is set if
+ * the number has neither a fraction nor an exponent.
+ */
+struct wjson_number
+{
+    const char* start;
+    const char* end;
+    uint64_t significand;
+    long exponent;
+    int truncated;
+    int negative;
+    int integral;
+};
+
+#define WJSON_INTEGER_SIGNED 1
+#define WJSON_INTEGER_UNSIGNED 2
+
+/**
+ * @brief Scans and validates a JSON numeric value, without converting it.
+ *
+ * The number must follow the JSON grammar exactly: an optional minus sign, an integer part without leading
+ * zeros, an optional fraction and an optional exponent. Up to 19 significant digits are accumulated into a
+ * 64-bit significand as they are validated.
+ *
+ * @param scanner Scanner positioned at the first character of the number.
+ * @param number Receives the scanned number.
+ * @return 1 on success, 0 if the number is malformed, or WJSON_TOKEN_PARTIAL if a partial scanner ends at or
+ *         inside the number, which may therefore continue.
+ */
+int wjson_scan_number(struct wjson_scanner* scanner, struct wjson_number* number)
+{
+    const char* start = scanner->cursor;
+    const char* end = scanner->end;
+    const char* cursor = start;
+    uint64_t significand = 0;
+    int digits = 0;
+    int truncated = 0;
+    int negative = 0;
+    long exponent = 0;
+    int integral = 1;
+
+    if (cursor < end && *cursor == '-')
+    {
+        negative = 1;
+        cursor++;
+    }
+
+    /* Integer part: a single zero, or a non-zero digit followed by any digits */
+    if (cursor == end && scanner->partial) return WJSON_TOKEN_PARTIAL;
+    if (cursor == end || *cursor < '0' || *cursor > '9')
+    {
+        scanner->cursor = cursor;
+        wjson_parse_error(scanner, "Malformed number");
+        return 0;
+    }
+    if (*cursor == '0')
+    {
+        cursor++;
+        if (cursor < end && *cursor >= '0' && *cursor <= '9')
+        {
+            scanner->cursor = cursor;
+            wjson_parse_error(scanner, "Leading zero in number");
+            return 0;
+        }
+    }
+    else
+    {
+        while (cursor < end && *cursor >= '0' && *cursor <= '9')
+        {
+            if (digits < 19)
+            {
+                significand = significand * 10 + (uint64_t)(*cursor - '0');
+                digits++;
+            }
+            else
+            {
+                if (*cursor != '0') truncated = 1;
+                exponent++;
+            }
+            cursor++;
+        }
+    }
+
+    /* Fraction: a dot followed by at least one digit */
+    if (cursor < end && *cursor == '.')
+    {
+        integral = 0;
+        cursor++;
+        if (cursor == end && scanner->partial) return WJSON_TOKEN_PARTIAL;
+        if (cursor == end || *cursor < '0' || *cursor > '9')
+        {
+            scanner->cursor = cursor;
+            wjson_parse_error(scanner, "Expected digit after decimal point");
+            return 0;
+        }
+        while (cursor < end && *cursor >= '0' && *cursor <= '9')
+        {
+            if (digits < 19)
+            {
+                significand = significand * 10 + (uint64_t)(*cursor - '0');
+                if (significand != 0) digits++;
+                exponent--;
+            }
+            else if (*cursor != '0')
+            {
+                truncated = 1;
+            }
+            cursor++;
+        }
+    }
+
+    /* Exponent: e or E, an optional sign and at least one digit */
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+    {
+        int exponent_negative = 0;
+        long explicit_exponent = 0;
+
+        integral = 0;
+        cursor++;
+        if (cursor < end && (*cursor == '+' || *cursor == '-'))
+        {
+            exponent_negative = (*cursor == '-');
+            cursor++;
+        }
+        if (cursor == end && scanner->partial) return WJSON_TOKEN_PARTIAL;
+        if (cursor == end || *cursor < '0' || *cursor > '9')
+        {
+            scanner->cursor = cursor;
+            wjson_parse_error(scanner, "Expected digit in exponent");
+            return 0;
+        }
+        while (cursor < end && *cursor >= '0' && *cursor <= '9')
+        {
+            /* Anything this large is already zero or infinity */
+            if (explicit_exponent < 100000) explicit_exponent = explicit_exponent * 10 + (*cursor - '0');
+            cursor++;
+        }
+        exponent += exponent_negative ? -explicit_exponent : explicit_exponent;
+    }
+
+    if (cursor == end && scanner->partial) return WJSON_TOKEN_PARTIAL;
+    scanner->cursor = cursor;
+
+    number->start = start;
+    number->end = cursor;
+    number->significand = significand;
+    number->exponent = exponent;
+    number->truncated = truncated;
+    number->negative = negative;
+    number->integral = integral;
+    return 1;
+}
+
+/**
+ * @brief Converts a scanned number to the nearest double.
+ *
+ * Integers and short decimals that are exactly representable are converted directly; everything else goes
+ * through the Eisel-Lemire algorithm, with strtod as a fallback for the rare inputs it cannot decide. The result
+ * is always correctly rounded.
+ *
+ * @param number Number from wjson_scan_number.
+ * @param result Receives the converted value.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_number_double(const struct wjson_number* number, double* result)
+{
+    static const double powers_of_ten[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    uint64_t significand = number->significand;
+    long exponent = number->exponent;
+    int negative = number->negative;
+
+    if (significand == 0)
+    {
+        *result = negative ? -0.0 : 0.0;
+        return 1;
+    }
+
+    if (!number->truncated)
+    {
+        /* Exactly representable significand and power of ten: one correctly rounded operation */
+        if (significand <= ((uint64_t)1 << 53) && exponent >= -22 && exponent <= 22)
+        {
+            double value = (double)significand;
+
+            if (exponent < 0)
+                value /= powers_of_ten[-exponent];
+            else
+                value *= powers_of_ten[exponent];
+
+            *result = negative ? -value : value;
+            return 1;
+        }
+
+        if (exponent >= -400 && exponent <= 400 && wjson_eisel_lemire(significand, (int)exponent, negative, result))
+            return 1;
+    }
+    else if (exponent >= -400 && exponent <= 400)
+    {
+        /* The digits beyond the 19th lie between significand and significand + 1; agreement decides */
+        double upper;
+
+        if (wjson_eisel_lemire(significand, (int)exponent, negative, result)
+            && wjson_eisel_lemire(significand + 1, (int)exponent, negative, &upper) && upper == *result)
+            return 1;
+    }
+
+    return wjson_strtod(number->start, (size_t)(number->end - number->start), result);
+}
+
+/**
+ * @brief Works out whether a scanned number is an integer that fits in 64 bits.
+ *
+ * Negative zero is left to the double representation, which can hold its sign.
+ *
+ * @param number Number from wjson_scan_number.
+ * @param result Receives the value, as the bits of an int64_t for WJSON_INTEGER_SIGNED.
+ * @return WJSON_INTEGER_SIGNED if the number fits in an int64_t, WJSON_INTEGER_UNSIGNED if it only fits in a
+ *         uint64_t, or 0 if it is not an integer or is out of range.
+ */
+int wjson_number_integer(const struct wjson_number* number, uint64_t* result)
+{
+    uint64_t magnitude = number->significand;
+
+    if (!number->integral) return 0;
+
+    /* Integers past 19 digits are re-read with an overflow check */
+    if (number->truncated || number->exponent != 0)
+    {
+        const char* cursor = number->start + number->negative;
+
+        for (magnitude = 0; cursor < number->end; cursor++)
+        {
+            uint64_t digit = (uint64_t)(*cursor - '0');
+
+            if (magnitude > (UINT64_MAX - digit) / 10) return 0;
+            magnitude = magnitude * 10 + digit;
+        }
+    }
+
+    if (number->negative)
+    {
+        if (magnitude == 0 || magnitude > (uint64_t)INT64_MAX + 1) return 0;
+        *result = (uint64_t)0 - magnitude;
+        return WJSON_INTEGER_SIGNED;
+    }
+
+    *result = magnitude;
+    return (magnitude <= (uint64_t)INT64_MAX) ? WJSON_INTEGER_SIGNED : WJSON_INTEGER_UNSIGNED;
+}
+
+/**
+ * @brief Parses a JSON numeric value from the scanner and converts it to the nearest double.
+ *
+ * @param scanner Scanner positioned at the first character of the number.
+ * @param result Receives the parsed value.
+ * @return 1 on success, 0 if the number is malformed, or WJSON_TOKEN_PARTIAL if a partial scanner ends at or
+ *         inside the number, which may therefore continue.
+ */
+int wjson_parse_double(struct wjson_scanner* scanner, double* result)
+{
+    struct wjson_number number;
+    int status = wjson_scan_number(scanner, &number);
+
+    return (status == 1) ? wjson_number_double(&number, result) : status;
+}
+
+struct wjson* wjson_append_node(struct wjson* wjson_node);
+struct wjson* wjson_append_node_inline(struct wjson* wjson_node, size_t key_length, size_t value_length,
+                                       wjson_char** key, wjson_char** value);
+wjson_char* wjson_place_utf8(wjson_char* copy, const char* source, size_t length);
+void wjson_index_member(struct wjson* wjson_node, struct wjson* member);
+wjson_char* wjson_store_utf8(struct wjson* wjson_node, const char* source, size_t length);
+struct wjson_intern* wjson_intern_of(const struct wjson* wjson_node);
+wjson_char* wjson_intern_utf8(struct wjson_intern* pool, const char* source, size_t length);
+
+/**
+ * @brief State of the tree builder, the event client behind wjson_parse_buffer.
+ *
+ * The heads of the containers being built are kept on a stack, innermost last, along with the key of the next
+ * member when the innermost container is an object. A pooled key is stored in key as soon as it is parsed;
+ * otherwise its bytes are held in text (pending is set) until the member is allocated, so that a short key can
+ * be stored inline with it.
+ */
+struct wjson_builder
+{
+    struct wjson_arena* arena;
+    struct wjson** open;
+    size_t depth;
+    size_t capacity;
+    wjson_char* key;
+    char* text;
+    size_t text_length;
+    size_t text_capacity;
+    int pending;
+    struct wjson* root;
+};
+
+/**
+ * @brief Appends a member of the given type to the innermost open container, under the pending key if any.
+ *
+ * @param builder Builder state.
+ * @param type Type of the new member.
+ * @param value UTF-8 bytes of the member's string value, or NULL if it is not a string.
+ * @param length Number of bytes in value.
+ * @return Pointer to the new member, or NULL on memory allocation failure.
+ */
+struct wjson* wjson_builder_member(struct wjson_builder* builder, unsigned short type, const char* value,
+                                   size_t length)
+{
+    struct wjson* head = builder->open[builder->depth - 1];
+    wjson_char* key_storage;
+    wjson_char* value_storage;
+    struct wjson* member = wjson_append_node_inline(head, builder->pending ? builder->text_length : WJSON_NOT_INLINE,
+                                                    (value != NULL) ? length : WJSON_NOT_INLINE, &key_storage,
+                                                    &value_storage);
+
+    if (builder->key != NULL)
+    {
+        member->key = builder->key;
+        member->flags |= WJSON_FLAG_INTERNED;
+    }
+    else if (builder->pending)
+    {
+        member->key = (key_storage != NULL) ? wjson_place_utf8(key_storage, builder->text, builder->text_length)
+                                            : wjson_store_utf8(head, builder->text, builder->text_length);
+        if (member->key == NULL) return NULL;
+    }
+
+    if (value != NULL)
+    {
+        member->data_string = (value_storage != NULL) ? wjson_place_utf8(value_storage, value, length)
+                                                      : wjson_store_utf8(head, value, length);
+        if (member->data_string == NULL) return NULL;
+    }
+    member->type = type;
+
+    /* Make object members visible to wjson_get */
+    if (member->key != NULL) wjson_index_member(head, member);
+    builder->key = NULL;
+    builder->pending = 0;
+    return member;
+}
+
+/**
+ * @brief Opens a new container, attaching it to its parent or making it the root.
+ *
+ * @param builder Builder state.
+ * @param list Whether the container is a list.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_builder_open(struct wjson_builder* builder, int list)
+{
+    struct wjson* member = NULL;
+    struct wjson* head;
+
+    if (builder->depth == builder->capacity)
+    {
+        size_t capacity = (builder->capacity == 0) ? 16 : builder->capacity * 2;
+        struct wjson** open = (struct wjson**)realloc(builder->open, capacity * sizeof(struct wjson*));
+
+        if (open == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for nesting stack.");
+            return 0;
+        }
+        builder->open = open;
+        builder->capacity = capacity;
+    }
+
+    /* The member is added before the container it will hold, so a member that cannot be added leaves nothing behind */
+    if (builder->depth != 0)
+    {
+        member = wjson_builder_member(builder, list ? WJSON_TYPE_LIST : WJSON_TYPE_OBJECT, NULL, 0);
+        if (member == NULL) return 0;
+    }
+
+    if (builder->arena == NULL)
+        head = list ? wjson_initialize_list() : wjson_initialize();
+    else
+        head = list ? wjson_arena_initialize_list(builder->arena) : wjson_arena_initialize(builder->arena);
+
+    if (member == NULL)
+        builder->root = head;
+    else
+        member->data_object = head;
+
+    builder->open[builder->depth++] = head;
+    return 1;
+}
+
+int wjson_builder_object_start(void* context)
+{
+    return wjson_builder_open((struct wjson_builder*)context, 0);
+}
+
+int wjson_builder_array_start(void* context)
+{
+    return wjson_builder_open((struct wjson_builder*)context, 1);
+}
+
+int wjson_builder_close(void* context)
+{
+    ((struct wjson_builder*)context)->depth--;
+    return 1;
+}
+
+int wjson_builder_key(void* context, const char* key, size_t length)
+{
+    struct wjson_builder* builder = (struct wjson_builder*)context;
+    struct wjson_intern* pool = wjson_intern_of(builder->open[builder->depth - 1]);
+
+    /* Repeated keys share one pooled copy when the container has an intern pool */
+    if (pool != NULL)
+    {
+        builder->key = wjson_intern_utf8(pool, key, length);
+        return builder->key != NULL;
+    }
+
+    /* Otherwise hold on to the bytes until the member is allocated */
+    if (length >= builder->text_capacity)
+    {
+        size_t capacity = (length < 32) ? 64 : length * 2;
+        char* text = (char*)realloc(builder->text, capacity);
+
+        if (text == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
+            return 0;
+        }
+        builder->text = text;
+        builder->text_capacity = capacity;
+    }
+    memcpy(builder->text, key, length);
+    builder->text_length = length;
+    builder->pending = 1;
+    return 1;
+}
+
+int wjson_builder_string(void* context, const char* value, size_t length)
+{
+    return wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_STRING, value, length) != NULL;
+}
+
+int wjson_builder_number(void* context, double value)
+{
+    struct wjson* member = wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_NUMERICAL, NULL, 0);
+
+    if (member != NULL) member->data_numerical = value;
+    return member != NULL;
+}
+
+int wjson_builder_bool(void* context, bool value)
+{
+    struct wjson* member = wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_BOOLEAN, NULL, 0);
+
+    if (member != NULL) member->data_bool = value;
+    return member != NULL;
+}
+
+int wjson_builder_null(void* context)
+{
+    return wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_NULL, NULL, 0) != NULL;
+}
+
+int wjson_builder_integer(void* context, int64_t value)
+{
+    struct wjson* member = wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_INTEGER, NULL, 0);
+
+    if (member != NULL) member->data_integer = value;
+    return member != NULL;
+}
+
+int wjson_builder_unsigned(void* context, uint64_t value)
+{
+    struct wjson* member = wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_INTEGER, NULL, 0);
+
+    if (member == NULL) return 0;
+    member->flags |= WJSON_FLAG_UNSIGNED;
+    member->data_unsigned = value;
+    return 1;
+}
+
+int wjson_builder_raw_number(void* context, const char* text, size_t length)
+{
+    return wjson_builder_member((struct wjson_builder*)context, WJSON_TYPE_RAW_NUMBER, text, length) != NULL;
+}
+
+/**
+ * @brief Callbacks that build a wjson tree from the event parser.
+ */
+const struct wjson_events wjson_builder_events = {
+    wjson_builder_object_start,
+    wjson_builder_close,
+    wjson_builder_array_start,
+    wjson_builder_close,
+    wjson_builder_key,
+    wjson_builder_string,
+    wjson_builder_number,
+    wjson_builder_bool,
+    wjson_builder_null,
+    NULL,
+    NULL,
+    NULL
+};
+
+/**
+ * @brief Builder callbacks that keep integers that fit in 64 bits as WJSON_TYPE_INTEGER.
+ */
+const struct wjson_events wjson_builder_integer_events = {
+    wjson_builder_object_start,
+    wjson_builder_close,
+    wjson_builder_array_start,
+    wjson_builder_close,
+    wjson_builder_key,
+    wjson_builder_string,
+    wjson_builder_number,
+    wjson_builder_bool,
+    wjson_builder_null,
+    wjson_builder_integer,
+    wjson_builder_unsigned,
+    NULL
+};
+
+/**
+ * @brief Builder callbacks that keep every number as WJSON_TYPE_RAW_NUMBER, converting none of them.
+ */
+const struct wjson_events wjson_builder_raw_events = {
+    wjson_builder_object_start,
+    wjson_builder_close,
+    wjson_builder_array_start,
+    wjson_builder_close,
+    wjson_builder_key,
+    wjson_builder_string,
+    wjson_builder_number,
+    wjson_builder_bool,
+    wjson_builder_null,
+    NULL,
+    NULL,
+    wjson_builder_raw_number
+};
+
+#define WJSON_STATE_START 0
+#define WJSON_STATE_VALUE 1
+#define WJSON_STATE_FIRST_VALUE 2
+#define WJSON_STATE_KEY 3
+#define WJSON_STATE_FIRST_KEY 4
+#define WJSON_STATE_COLON 5
+#define WJSON_STATE_AFTER_VALUE 6
+#define WJSON_STATE_DONE 7
+
+/**
+ * @brief State of a resumable parse, shared by wjson_parse_events and the push parser.
+ *
+ * The grammar is driven by the state - expecting the document, a value, a key, a colon or the separator after a
+ * value - with the open containers kept on an explicit stack rather than the C call stack, so nesting depth is
+ * bounded only by memory and the parse can stop at any token boundary and pick up again later.
+ *
+ * A token cut off by the end of a chunk is copied into pending, starting at its first byte, and completed from
+ * the next chunk before it is parsed; escaped records whether the last pending byte of a string escapes the
+ * byte after it. offset counts the bytes fed before the current chunk and token_offset is the offset of the
+ * pending token, both for error messages. status is sticky once the parse fails or is stopped. max_depth and
+ * max_length, when not 0, bound the nesting depth and the unescaped length in bytes of keys and strings, and
+ * through it the size of pending and scratch.
+ *
+ * Every buffer grows as needed and is kept when the state is reset, so a state reused across documents settles
+ * into parsing without allocating.
+ */
+struct wjson_push_parser
+{
+    const struct wjson_events* events;
+    void* context;
+    int state;
+    int status;
+    char initial[64];
+    char* nesting;
+    size_t depth;
+    size_t capacity;
+    char* pending;
+    size_t pending_length;
+    size_t pending_capacity;
+    int escaped;
+    size_t offset;
+    size_t token_offset;
+    char* scratch;
+    size_t scratch_capacity;
+    size_t max_depth;
+    size_t max_length;
+    struct wjson_builder builder;
+};
+
+/**
+ * @brief Resets the state of a resumable parse to the start of a new document, keeping its buffers and limits.
+ *
+ * @param parser Parser state, initialized with wjson_push_parser_init.
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ */
+void wjson_push_parser_reset(struct wjson_push_parser* parser, const struct wjson_events* events, void* context)
+{
+    parser->events = events;
+    parser->context = context;
+    parser->state = WJSON_STATE_START;
+    parser->status = WJSON_PARSE_INCOMPLETE;
+    parser->depth = 0;
+    parser->pending_length = 0;
+    parser->escaped = 0;
+    parser->offset = 0;
+    parser->token_offset = 0;
+    parser->builder.arena = NULL;
+    parser->builder.depth = 0;
+    parser->builder.key = NULL;
+    parser->builder.pending = 0;
+    parser->builder.root = NULL;
+}
+
+/**
+ * @brief Initializes the state of a resumable parse.
+ *
+ * @param parser Parser state to initialize.
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ */
+void wjson_push_parser_init(struct wjson_push_parser* parser, const struct wjson_events* events, void* context)
+{
+    parser->nesting = parser->initial;
+    parser->capacity = sizeof(parser->initial);
+    parser->pending = NULL;
+    parser->pending_capacity = 0;
+    parser->scratch = NULL;
+    parser->scratch_capacity = 0;
+    parser->max_depth = 0;
+    parser->max_length = 0;
+    parser->builder.open = NULL;
+    parser->builder.capacity = 0;
+    parser->builder.text = NULL;
+    parser->builder.text_capacity = 0;
+    wjson_push_parser_reset(parser, events, context);
+}
+
+/**
+ * @brief Releases the buffers owned by a parser state, but not the state itself or any tree it built.
+ *
+ * @param parser Parser state to release.
+ */
+void wjson_push_parser_release(struct wjson_push_parser* parser)
+{
+    if (parser->nesting != parser->initial) free(parser->nesting);
+    free(parser->pending);
+    free(parser->scratch);
+    free(parser->builder.open);
+    free(parser->builder.text);
+}
+
+/**
+ * @brief Closes the innermost container and reports its end.
+ *
+ * @param parser Parser state.
+ * @param scanner Scanner positioned at the closing brace or bracket.
+ * @return WJSON_PARSE_COMPLETE, or WJSON_PARSE_ABORTED if the callback stopped the parse.
+ */
+int wjson_push_close(struct wjson_push_parser* parser, struct wjson_scanner* scanner)
+{
+    char open = parser->nesting[--parser->depth];
+    int proceed = 1;
+
+    scanner->cursor++;
+    parser->state = (parser->depth == 0) ? WJSON_STATE_DONE : WJSON_STATE_AFTER_VALUE;
+
+    if (open == '{' && parser->events->on_object_end != NULL) proceed = parser->events->on_object_end(parser->context);
+    if (open == '[' && parser->events->on_array_end != NULL) proceed = parser->events->on_array_end(parser->context);
+    return proceed ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+}
+
+/**
+ * @brief Parses the token at the scanner position and reports it to its callback.
+ *
+ * The scanner must be positioned at a non-whitespace byte and the document must not be complete. If the token
+ * runs past the end of a partial scanner nothing is reported, the state is left unchanged and the token can be
+ * parsed again from its first byte once more input has arrived.
+ *
+ * @param parser Parser state.
+ * @param scanner Scanner positioned at the first byte of the token.
+ * @return WJSON_PARSE_COMPLETE if the token was parsed, WJSON_PARSE_ERROR, WJSON_PARSE_ABORTED if a callback
+ *         stopped the parse, or WJSON_TOKEN_PARTIAL.
+ */
+int wjson_push_token(struct wjson_push_parser* parser, struct wjson_scanner* scanner)
+{
+    const struct wjson_events* events = parser->events;
+    void* context = parser->context;
+    char c = *scanner->cursor;
+    int proceed = 1;
+    int result;
+
+    switch (parser->state)
+    {
+        case WJSON_STATE_START:
+            /* The document must be an object or an array */
+            if (c != '{' && c != '[')
+            {
+                wjson_parse_error(scanner, "Expected '{' or '['");
+                return WJSON_PARSE_ERROR;
+            }
+            break;
+
+        case WJSON_STATE_FIRST_VALUE:
+            /* Empty containers close straight away */
+            if (c == ']') return wjson_push_close(parser, scanner);
+            break;
+
+        case WJSON_STATE_FIRST_KEY:
+            if (c == '}') return wjson_push_close(parser, scanner);
+            /* Fall through */
+        case WJSON_STATE_KEY:
+        {
+            const char* start;
+            size_t length;
+
+            if (c != '"')
+            {
+                wjson_parse_error(scanner, "Expected key");
+                return WJSON_PARSE_ERROR;
+            }
+            scanner->cursor++;
+            result = wjson_parse_value_string(scanner, &start, &length, parser->max_length);
+            if (result != 1) return result;
+
+            parser->state = WJSON_STATE_COLON;
+            if (events->on_key != NULL) proceed = events->on_key(context, start, length);
+            return proceed ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+        }
+
+        case WJSON_STATE_COLON:
+            if (c != ':')
+            {
+                wjson_parse_error(scanner, "Expected ':'");
+                return WJSON_PARSE_ERROR;
+            }
+            scanner->cursor++;
+            parser->state = WJSON_STATE_VALUE;
+            return WJSON_PARSE_COMPLETE;
+
+        case WJSON_STATE_AFTER_VALUE:
+        {
+            char open = parser->nesting[parser->depth - 1];
+
+            /* Parse , or the closing brace or bracket */
+            if (c == ',')
+            {
+                scanner->cursor++;
+                parser->state = (open == '{') ? WJSON_STATE_KEY : WJSON_STATE_VALUE;
+                return WJSON_PARSE_COMPLETE;
+            }
+            if (c == (open == '{' ? '}' : ']')) return wjson_push_close(parser, scanner);
+
+            wjson_parse_error(scanner, (open == '{') ? "Expected ',' or '}'" : "Expected ',' or ']'");
+            return WJSON_PARSE_ERROR;
+        }
+
+        default:
+            break;
+    }
+
+    /* If the character is an opening brace or bracket, open a container */
+    if (c == '{' || c == '[')
+    {
+        if (parser->max_depth != 0 && parser->depth == parser->max_depth)
+        {
+            wjson_parse_error(scanner, "Nesting exceeds depth limit");
+            return WJSON_PARSE_ERROR;
+        }
+        if (parser->depth == parser->capacity)
+        {
+            char* grown = (char*)malloc(parser->capacity * 2);
+            if (grown == NULL)
+            {
+                fprintf(stderr, "wJson: Failed to allocate memory for nesting stack.");
+                return WJSON_PARSE_ERROR;
+            }
+            memcpy(grown, parser->nesting, parser->depth);
+            if (parser->nesting != parser->initial) free(parser->nesting);
+            parser->nesting = grown;
+            parser->capacity *= 2;
+        }
+        parser->nesting[parser->depth++] = c;
+        scanner->cursor++;
+        parser->state = (c == '{') ? WJSON_STATE_FIRST_KEY : WJSON_STATE_FIRST_VALUE;
+
+        if (c == '{' && events->on_object_start != NULL) proceed = events->on_object_start(context);
+        if (c == '[' && events->on_array_start != NULL) proceed = events->on_array_start(context);
+        return proceed ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+    }
+
+    /* If the character is a double quote, parse a string value */
+    if (c == '"')
+    {
+        const char* start;
+        size_t length;
+
+        scanner->cursor++;
+        result = wjson_parse_value_string(scanner, &start, &length, parser->max_length);
+        if (result != 1) return result;
+        if (events->on_string != NULL) proceed = events->on_string(context, start, length);
+    }
+    /* If the character is a digit or minus sign, parse a numerical value */
+    else if ((c >= '0' && c <= '9') || c == '-')
+    {
+        struct wjson_number number;
+        uint64_t integer;
+        double value;
+        int kind;
+
+        result = wjson_scan_number(scanner, &number);
+        if (result != 1) return result;
+
+        /* Hand over the text or an exact integer to clients that ask for them, converting only what is needed */
+        if (events->on_raw_number != NULL)
+        {
+            proceed = events->on_raw_number(context, number.start, (size_t)(number.end - number.start));
+        }
+        else if (events->on_integer != NULL && (kind = wjson_number_integer(&number, &integer)) != 0
+                 && (kind == WJSON_INTEGER_SIGNED || events->on_unsigned != NULL))
+        {
+            if (kind == WJSON_INTEGER_SIGNED)
+                proceed = events->on_integer(context, (int64_t)integer);
+            else
+                proceed = events->on_unsigned(context, integer);
+        }
+        else if (events->on_number != NULL)
+        {
+            if (!wjson_number_double(&number, &value)) return WJSON_PARSE_ERROR;
+            proceed = events->on_number(context, value);
+        }
+    }
+    /* Otherwise the value must be one of the literals true, false and null */
+    else
+    {
+        const char* literal = (c == 't') ? "true" : (c == 'f') ? "false" : "null";
+
+        result = wjson_match_sequence(scanner, literal);
+        if (result == WJSON_TOKEN_PARTIAL) return result;
+        if (result == 0)
+        {
+            wjson_parse_error(scanner, "Unexpected character");
+            return WJSON_PARSE_ERROR;
+        }
+
+        if (c == 'n')
+        {
+            if (events->on_null != NULL) proceed = events->on_null(context);
+        }
+        else if (events->on_bool != NULL)
+        {
+            proceed = events->on_bool(context, c == 't');
+        }
+    }
+
+    parser->state = WJSON_STATE_AFTER_VALUE;
+    return proceed ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+}
+
+/**
+ * @brief Appends bytes of a cut off token to the parser's pending buffer.
+ *
+ * With a length limit set, a pending token may take at most six times the limit plus two bytes: enough for a
+ * string at the limit written entirely in \\u escapes, with its quotes. Longer tokens are rejected as they
+ * arrive rather than buffered whole.
+ *
+ * @param parser Parser state, with token_offset set to the offset of the token.
+ * @param data Bytes to append.
+ * @param length Number of bytes to append.
+ * @return 1 on success, 0 if the token exceeds the length limit or on memory allocation failure.
+ */
+int wjson_push_stash(struct wjson_push_parser* parser, const char* data, size_t length)
+{
+    if (parser->max_length != 0 && parser->max_length <= ((size_t)-1 - 2) / 6
+        && parser->pending_length + length > parser->max_length * 6 + 2)
+    {
+        fprintf(stderr, "wJson: Token exceeds length limit at offset %lu.", (unsigned long)parser->token_offset);
+        return 0;
+    }
+
+    if (parser->pending_length + length > parser->pending_capacity)
+    {
+        size_t capacity = (parser->pending_capacity == 0) ? 64 : parser->pending_capacity;
+        char* pending;
+
+        while (capacity < parser->pending_length + length) capacity *= 2;
+        pending = (char*)realloc(parser->pending, capacity);
+        if (pending == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for pending token.");
+            return 0;
+        }
+        parser->pending = pending;
+        parser->pending_capacity = capacity;
+    }
+
+    if (length > 0) memcpy(parser->pending + parser->pending_length, data, length);
+    parser->pending_length += length;
+    return 1;
+}
+
+/**
+ * @brief Runs the parser over a scanner until the input runs out, the parse fails or a callback stops it.
+ *
+ * A token cut off by the end of a partial scanner is moved to the pending buffer to be completed by the next
+ * chunk.
+ *
+ * @param parser Parser state.
+ * @param scanner Scanner over the input.
+ * @return WJSON_PARSE_COMPLETE if the document is complete and only whitespace follows it,
+ *         WJSON_PARSE_INCOMPLETE if more input is needed, WJSON_PARSE_ERROR or WJSON_PARSE_ABORTED.
+ */
+int wjson_push_run(struct wjson_push_parser* parser, struct wjson_scanner* scanner)
+{
+    for (;;)
+    {
+        const char* token;
+        int result;
+
+        wjson_skip_whitespace(scanner);
+        if (scanner->cursor == scanner->end)
+            return (parser->state == WJSON_STATE_DONE) ? WJSON_PARSE_COMPLETE : WJSON_PARSE_INCOMPLETE;
+
+        /* Only whitespace may follow the document */
+        if (parser->state == WJSON_STATE_DONE)
+        {
+            wjson_parse_error(scanner, "Unexpected trailing characters");
+            return WJSON_PARSE_ERROR;
+        }
+
+        token = scanner->cursor;
+        result = wjson_push_token(parser, scanner);
+        if (result == WJSON_TOKEN_PARTIAL)
+        {
+            parser->token_offset = scanner->base + (size_t)(token - scanner->start);
+            if (!wjson_push_stash(parser, token, (size_t)(scanner->end - token))) return WJSON_PARSE_ERROR;
+
+            /* Note whether the string so far ends inside an escape sequence */
+            parser->escaped = 0;
+            if (*token == '"')
+                wjson_find_string_end(parser->pending + 1, parser->pending + parser->pending_length, &parser->escaped);
+
+            scanner->cursor = scanner->end;
+            return WJSON_PARSE_INCOMPLETE;
+        }
+        if (result != WJSON_PARSE_COMPLETE) return result;
+    }
+}
+
+/**
+ * @brief Parses the pending token, which is complete or can no longer be continued.
+ *
+ * @param parser Parser state.
+ * @param scanner Scanner over the current input, whose scratch buffer is shared.
+ * @return WJSON_PARSE_COMPLETE on success, WJSON_PARSE_ERROR or WJSON_PARSE_ABORTED.
+ */
+int wjson_push_flush(struct wjson_push_parser* parser, struct wjson_scanner* scanner)
+{
+    struct wjson_scanner token;
+    int result;
+
+    token.start = parser->pending;
+    token.cursor = parser->pending;
+    token.end = parser->pending + parser->pending_length;
+    token.base = parser->token_offset;
+    token.partial = 0;
+    token.scratch = scanner->scratch;
+    token.scratch_capacity = scanner->scratch_capacity;
+
+    result = wjson_push_token(parser, &token);
+
+    /* The bytes gathered for the token must all belong to it */
+    if (result == WJSON_PARSE_COMPLETE && token.cursor != token.end)
+    {
+        wjson_parse_error(&token, "Unexpected character");
+        result = WJSON_PARSE_ERROR;
+    }
+
+    scanner->scratch = token.scratch;
+    scanner->scratch_capacity = token.scratch_capacity;
+    parser->pending_length = 0;
+    return result;
+}
+
+/**
+ * @brief Continues the pending token with the bytes at the start of a new chunk, parsing it once it ends.
+ *
+ * Strings continue up to their closing double quote, numbers over the characters a number may contain and
+ * literals over lowercase letters; the bytes are appended once, so a long token split across many chunks is
+ * still copied and parsed in linear time.
+ *
+ * @param parser Parser state with a pending token.
+ * @param scanner Scanner over the new chunk.
+ * @return WJSON_PARSE_COMPLETE if the token was parsed, WJSON_PARSE_INCOMPLETE if it continues past the chunk,
+ *         WJSON_PARSE_ERROR or WJSON_PARSE_ABORTED.
+ */
+int wjson_push_resume(struct wjson_push_parser* parser, struct wjson_scanner* scanner)
+{
+    const char* cursor = scanner->cursor;
+    char first = parser->pending[0];
+    int ended;
+
+    if (first == '"')
+    {
+        cursor = wjson_find_string_end(cursor, scanner->end, &parser->escaped);
+        ended = (cursor < scanner->end);
+        if (ended) cursor++;
+    }
+    else if ((first >= '0' && first <= '9') || first == '-')
+    {
+        while (cursor < scanner->end && ((*cursor >= '0' && *cursor <= '9') || *cursor == '.' || *cursor == 'e'
+                                         || *cursor == 'E' || *cursor == '+' || *cursor == '-'))
+            cursor++;
+        ended = (cursor < scanner->end);
+    }
+    else
+    {
+        while (cursor < scanner->end && *cursor >= 'a' && *cursor <= 'z') cursor++;
+        ended = (cursor < scanner->end);
+    }
+
+    if (!wjson_push_stash(parser, scanner->cursor, (size_t)(cursor - scanner->cursor))) return WJSON_PARSE_ERROR;
+    scanner->cursor = cursor;
+
+    if (!ended) return WJSON_PARSE_INCOMPLETE;
+    return wjson_push_flush(parser, scanner);
+}
+
+/**
+ * @brief Creates a push parser that reports each token of a document fed to it in chunks to a set of callbacks.
+ *
+ * The push parser suits input that arrives in pieces, such as a network stream: each chunk is parsed as soon as
+ * it is fed, and a token cut off by the end of a chunk - part way through a string, an escape sequence, a number
+ * or a literal - is carried over and completed by the next one. Callbacks behave as for wjson_parse_events.
+ *
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ * @return Pointer to the new parser.
+ * @note The caller is responsible for releasing the parser with wjson_push_parser_destroy.
+ */
+struct wjson_push_parser* wjson_push_parser_create(const struct wjson_events* events, void* context)
+{
+    struct wjson_push_parser* parser = (struct wjson_push_parser*)malloc(sizeof(struct wjson_push_parser));
+
+    if (parser == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for push parser.");
+        exit(EXIT_FAILURE);
+    }
+
+    wjson_push_parser_init(parser, events, context);
+    return parser;
+}
+
+/**
+ * @brief Creates a push parser that builds a wjson tree from a document fed to it in chunks.
+ *
+ * The tree is built exactly as wjson_parse_buffer_arena builds it, and is returned by wjson_push_parser_root
+ * once the document is complete.
+ *
+ * @param arena Arena to allocate the document from, or NULL to allocate from the heap.
+ * @return Pointer to the new parser.
+ * @note The caller is responsible for releasing the parser with wjson_push_parser_destroy.
+ */
+struct wjson_push_parser* wjson_push_parser_create_tree(struct wjson_arena* arena)
+{
+    struct wjson_push_parser* parser = wjson_push_parser_create(&wjson_builder_events, NULL);
+
+    parser->context = &parser->builder;
+    parser->builder.arena = arena;
+    return parser;
+}
+
+/**
+ * @brief Sets the limits a push parser enforces on the document fed to it.
+ *
+ * The limits are those of wjson_parser_set_limits. A string is rejected as soon as it runs past the length
+ * limit, so the parser never buffers much more than the limit, even for a string spread over many chunks.
+ *
+ * @param parser Push parser to configure, before its first chunk is fed.
+ * @param max_depth Maximum number of nested objects and arrays, or 0 for no limit.
+ * @param max_length Maximum length in bytes of a key or string once unescaped, or 0 for no limit.
+ */
+void wjson_push_parser_set_limits(struct wjson_push_parser* parser, size_t max_depth, size_t max_length)
+{
+    parser->max_depth = max_depth;
+    parser->max_length = max_length;
+}
+
+/**
+ * @brief Feeds the next chunk of a document to a push parser.
+ *
+ * Every complete token in the chunk is parsed and reported before the function returns; the chunk itself is not
+ * retained and may be reused by the caller. Whitespace may follow the document, but nothing else.
+ *
+ * @param parser Push parser.
+ * @param chunk Pointer to the first byte of the chunk.
+ * @param length Number of bytes in the chunk.
+ * @return WJSON_PARSE_INCOMPLETE if the document needs more input, WJSON_PARSE_COMPLETE once it is complete,
+ *         WJSON_PARSE_ERROR on a parse error or WJSON_PARSE_ABORTED if a callback stopped the parse. The last
+ *         two are sticky: feeding more input returns them again.
+ */
+int wjson_push_parser_feed(struct wjson_push_parser* parser, const char* chunk, size_t length)
+{
+    struct wjson_scanner scanner;
+    int status = WJSON_PARSE_COMPLETE;
+
+    if (parser->status == WJSON_PARSE_ERROR || parser->status == WJSON_PARSE_ABORTED) return parser->status;
+
+    scanner.start = chunk;
+    scanner.cursor = chunk;
+    scanner.end = chunk + length;
+    scanner.base = parser->offset;
+    scanner.partial = 1;
+    scanner.scratch = parser->scratch;
+    scanner.scratch_capacity = parser->scratch_capacity;
+
+    if (parser->pending_length > 0) status = wjson_push_resume(parser, &scanner);
+    if (status == WJSON_PARSE_COMPLETE) status = wjson_push_run(parser, &scanner);
+
+    parser->scratch = scanner.scratch;
+    parser->scratch_capacity = scanner.scratch_capacity;
+    parser->offset += length;
+    parser->status = status;
+    return status;
+}
+
+/**
+ * @brief Tells a push parser that the document has ended.
+ *
+ * A token still pending, such as a number at the very end of the input, is parsed, and the document is then
+ * checked to be complete.
+ *
+ * @param parser Push parser.
+ * @return WJSON_PARSE_COMPLETE if the document is complete, WJSON_PARSE_ERROR if it is malformed or truncated,
+ *         or WJSON_PARSE_ABORTED if a callback stopped the parse.
+ */
+int wjson_push_parser_finish(struct wjson_push_parser* parser)
+{
+    struct wjson_scanner scanner;
+    int status = WJSON_PARSE_COMPLETE;
+
+    if (parser->status == WJSON_PARSE_ERROR || parser->status == WJSON_PARSE_ABORTED) return parser->status;
+
+    scanner.start = "";
+    scanner.cursor = scanner.start;
+    scanner.end = scanner.start;
+    scanner.base = parser->offset;
+    scanner.partial = 0;
+    scanner.scratch = parser->scratch;
+    scanner.scratch_capacity = parser->scratch_capacity;
+
+    if (parser->pending_length > 0) status = wjson_push_flush(parser, &scanner);
+    if (status == WJSON_PARSE_COMPLETE && parser->state != WJSON_STATE_DONE)
+    {
+        wjson_parse_error(&scanner, "Unexpected end of input");
+        status = WJSON_PARSE_ERROR;
+    }
+
+    parser->scratch = scanner.scratch;
+    parser->scratch_capacity = scanner.scratch_capacity;
+    parser->status = status;
+    return status;
+}
+
+/**
+ * @brief Returns the tree built by a push parser created with wjson_push_parser_create_tree.
+ *
+ * @param parser Push parser.
+ * @return wjson pointer to the parsed JSON structure once the document is complete, or NULL.
+ * @note The tree is handed out once and outlives the parser; the caller is responsible for freeing it. Later calls
+ *       return NULL.
+ */
+struct wjson* wjson_push_parser_root(struct wjson_push_parser* parser)
+{
+    struct wjson* root = parser->builder.root;
+
+    if (parser->status != WJSON_PARSE_COMPLETE) return NULL;
+    parser->builder.root = NULL;
+    return root;
+}
+
+/**
+ * @brief Destroys a push parser, releasing its buffers.
+ *
+ * A tree push parser also frees any tree it built that wjson_push_parser_root has not handed out, whether the
+ * document completed, failed or was destroyed part way through.
+ *
+ * @param parser Push parser to destroy.
+ */
+void wjson_push_parser_destroy(struct wjson_push_parser* parser)
+{
+    wjson_free(parser->builder.root);
+    wjson_push_parser_release(parser);
+    free(parser);
+}
+
+/**
+ * @brief Parses a whole document held in memory with a parser state, in a single run of its state machine.
+ *
+ * @param parser Parser state, reset to the start of a document.
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @return WJSON_PARSE_COMPLETE, WJSON_PARSE_ABORTED or WJSON_PARSE_ERROR.
+ */
+int wjson_push_parse_whole(struct wjson_push_parser* parser, const char* data, size_t length)
+{
+    struct wjson_scanner scanner;
+    int status;
+
+    scanner.start = data;
+    scanner.cursor = data;
+    scanner.end = data + length;
+    scanner.base = 0;
+    scanner.partial = 0;
+    scanner.scratch = parser->scratch;
+    scanner.scratch_capacity = parser->scratch_capacity;
+
+    status = wjson_push_run(parser, &scanner);
+    if (status == WJSON_PARSE_INCOMPLETE)
+    {
+        wjson_parse_error(&scanner, "Unexpected end of input");
+        status = WJSON_PARSE_ERROR;
+    }
+
+    parser->scratch = scanner.scratch;
+    parser->scratch_capacity = scanner.scratch_capacity;
+    parser->status = status;
+    return status;
+}
+
+/**
+ * @brief Parses a whole document held in memory into a tree, using the builder of a parser state.
+ *
+ * @param parser Parser state, whose buffers and limits are used and which is reset first.
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param arena Arena to allocate the document from, or NULL for the heap.
+ * @param flags WJSON_NUMBER_INTEGERS or WJSON_NUMBER_RAW, or 0.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ */
+struct wjson* wjson_push_parse_tree(struct wjson_push_parser* parser, const char* data, size_t length,
+                                    struct wjson_arena* arena, int flags)
+{
+    const struct wjson_events* events = &wjson_builder_events;
+
+    if (flags & WJSON_NUMBER_RAW)
+        events = &wjson_builder_raw_events;
+    else if (flags & WJSON_NUMBER_INTEGERS)
+        events = &wjson_builder_integer_events;
+
+    wjson_push_parser_reset(parser, events, &parser->builder);
+    parser->builder.arena = arena;
+
+    if (wjson_push_parse_whole(parser, data, length) == WJSON_PARSE_COMPLETE) return parser->builder.root;
+
+    wjson_free(parser->builder.root);
+    return NULL;
+}
+
+/**
+ * @brief Parses a JSON document held in memory, reporting each token to a set of callbacks.
+ *
+ * No tree is built: keys and strings are handed to the callbacks as spans of UTF-8 that are only valid for the
+ * duration of the call, and memory use does not depend on the size of the document. Any callback may return 0
+ * to stop the parse early, for instance once the fields of interest have been seen. Callbacks left NULL are
+ * skipped. The whole document is parsed in a single run of the push parser's state machine.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE once the whole document has been reported, WJSON_PARSE_ABORTED if a callback
+ *         stopped the parse, or WJSON_PARSE_ERROR on a parse error.
+ */
+int wjson_parse_events(const char* data, size_t length, const struct wjson_events* events, void* context)
+{
+    struct wjson_push_parser parser;
+    int status;
+
+    wjson_push_parser_init(&parser, events, context);
+    status = wjson_push_parse_whole(&parser, data, length);
+    wjson_push_parser_release(&parser);
+    return status;
+}
+
+/**
+ * @brief Parses a JSON document held in memory and returns a wjson pointer representing it.
+ *
+ * This is the core parsing entry point; wjson_parse and wjson_parse_subobj read their input into memory and
+ * hand it to this function. The document must be a single JSON object or array encoded as UTF-8, optionally
+ * surrounded by whitespace. The data does not need to be null terminated.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ * @note The caller is responsible for freeing the allocated memory.
+ */
+struct wjson* wjson_parse_buffer(const char* data, size_t length)
+{
+    return wjson_parse_buffer_arena(data, length, NULL);
+}
+
+/**
+ * @brief Parses a JSON document held in memory, allocating the resulting tree from an arena.
+ *
+ * Every node, key and string of the document is allocated from the arena, and the whole document is released
+ * with wjson_arena_reset or wjson_arena_destroy. Passing a NULL arena allocates from the heap, exactly like
+ * wjson_parse_buffer. The tree is built by a client of wjson_parse_events.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param arena Arena to allocate the document from, or NULL.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ * @note On a parse error any partially built document is left in the arena until it is reset.
+ */
+struct wjson* wjson_parse_buffer_arena(const char* data, size_t length, struct wjson_arena* arena)
+{
+    return wjson_parse_buffer_flags(data, length, arena, 0);
+}
+
+/**
+ * @brief Parses a JSON document held in memory, choosing how numbers are stored.
+ *
+ * By default every number is converted to a double. WJSON_NUMBER_INTEGERS keeps integers that fit in 64 bits
+ * exactly, as WJSON_TYPE_INTEGER, so identifiers past 2^53 survive. WJSON_NUMBER_RAW converts nothing: each
+ * number keeps its source text as WJSON_TYPE_RAW_NUMBER, is converted only when read with wjson_get_double,
+ * wjson_get_int64 or wjson_get_uint64, and is serialized back verbatim.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param arena Arena to allocate the document from, or NULL for the heap.
+ * @param flags WJSON_NUMBER_INTEGERS or WJSON_NUMBER_RAW, or 0.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ * @note On a parse error a partially built heap document is freed; one in an arena is left there until it is
+ *       reset.
+ */
+struct wjson* wjson_parse_buffer_flags(const char* data, size_t length, struct wjson_arena* arena, int flags)
+{
+    struct wjson_push_parser parser;
+    struct wjson* wjson_node;
+
+    wjson_push_parser_init(&parser, NULL, NULL);
+    wjson_node = wjson_push_parse_tree(&parser, data, length, arena, flags);
+    wjson_push_parser_release(&parser);
+    return wjson_node;
+}
+
+/**
+ * @brief Reusable parser for in-memory documents.
+ *
+ * Holds the state of a parse - the nesting stack, the scratch buffer strings are unescaped into and the tree
+ * builder's stack and key buffer - across documents. Each buffer grows to fit the largest token or deepest
+ * nesting seen so far and is kept, so once a parser has warmed up, parsing further documents of similar shape
+ * allocates nothing but the documents themselves, however long their tokens are.
+ */
+struct wjson_parser
+{
+    struct wjson_push_parser state;
+};
+
+/**
+ * @brief Creates a reusable parser, without limits on nesting depth or string length.
+ *
+ * @return Pointer to the new parser.
+ * @note The caller is responsible for releasing the parser with wjson_parser_destroy. A parser must not be used
+ *       by two threads at once.
+ */
+struct wjson_parser* wjson_parser_create(void)
+{
+    struct wjson_parser* parser = (struct wjson_parser*)malloc(sizeof(struct wjson_parser));
+
+    if (parser == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for parser.");
+        exit(EXIT_FAILURE);
+    }
+
+    wjson_push_parser_init(&parser->state, NULL, NULL);
+    return parser;
+}
+
+/**
+ * @brief Sets the limits a parser enforces on the documents it parses.
+ *
+ * A document that exceeds a limit fails to parse with an error at the offending token, so untrusted input can
+ * neither nest without bound nor make the parser buffer an arbitrarily long string.
+ *
+ * @param parser Parser to configure.
+ * @param max_depth Maximum number of nested objects and arrays, or 0 for no limit.
+ * @param max_length Maximum length in bytes of a key or string once unescaped, or 0 for no limit.
+ */
+void wjson_parser_set_limits(struct wjson_parser* parser, size_t max_depth, size_t max_length)
+{
+    parser->state.max_depth = max_depth;
+    parser->state.max_length = max_length;
+}
+
+/**
+ * @brief Parses a JSON document held in memory with a reusable parser.
+ *
+ * Behaves like wjson_parse_buffer_flags, but reuses the parser's buffers and enforces its limits.
+ *
+ * @param parser Parser to use.
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param arena Arena to allocate the document from, or NULL for the heap.
+ * @param flags WJSON_NUMBER_INTEGERS or WJSON_NUMBER_RAW, or 0.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ * @note The tree does not depend on the parser and outlives it.
+ */
+struct wjson* wjson_parser_parse(struct wjson_parser* parser, const char* data, size_t length,
+                                 struct wjson_arena* arena, int flags)
+{
+    return wjson_push_parse_tree(&parser->state, data, length, arena, flags);
+}
+
+/**
+ * @brief Parses a JSON document held in memory with a reusable parser, reporting each token to a set of callbacks.
+ *
+ * Behaves like wjson_parse_events, but reuses the parser's buffers and enforces its limits.
+ *
+ * @param parser Parser to use.
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE, WJSON_PARSE_ABORTED or WJSON_PARSE_ERROR, as for wjson_parse_events.
+ */
+int wjson_parser_parse_events(struct wjson_parser* parser, const char* data, size_t length,
+                              const struct wjson_events* events, void* context)
+{
+    wjson_push_parser_reset(&parser->state, events, context);
+    return wjson_push_parse_whole(&parser->state, data, length);
+}
+
+/**
+ * @brief Destroys a reusable parser, releasing its buffers. Trees it built are not affected.
+ *
+ * @param parser Parser to destroy.
+ */
+void wjson_parser_destroy(struct wjson_parser* parser)
+{
+    wjson_push_parser_release(&parser->state);
+    free(parser);
+}
+
+/**
+ * @brief Reads the remainder of a file stream into a heap allocated buffer.
+ *
+ * @param file FILE pointer to read from.
+ * @param length Receives the number of bytes read.
+ * @return Heap allocated buffer holding the data, or NULL on a read or memory allocation failure.
+ * @note The caller is responsible for freeing the returned buffer.
+ */
+char* wjson_read_stream(FILE* file, size_t* length)
+{
+    size_t capacity = 4096;
+    size_t used = 0;
+    char* buffer = (char*)malloc(capacity);
+
+    while (buffer != NULL)
+    {
+        size_t read = fread(buffer + used, 1, capacity - used, file);
+        used += read;
+
+        if (used < capacity)
+        {
+            if (ferror(file)) break;
+            *length = used;
+            return buffer;
+        }
+
+        /* Buffer is full, grow it geometrically */
+        {
+            char* grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL) break;
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+
+    fprintf(stderr, "wJson: Failed to read JSON input.");
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * @brief Parses a JSON object from the file stream and returns a wjson pointer.
+ *
+ * The remainder of the stream is read into memory and handed to wjson_parse_buffer.
+ *
+ * @param file FILE pointer to the input JSON file.
+ * @return wjson pointer to the parsed JSON object, or NULL on failure.
+ * @note The caller is responsible for freeing the allocated memory.
+ * @author Toby Benjamin Clark
+ */
+struct wjson* wjson_parse_subobj(FILE* file)
+{
+    struct wjson* wjson_node;
+    size_t length;
+    char* data = wjson_read_stream(file, &length);
+
+    if (data == NULL) return NULL;
+
+    wjson_node = wjson_parse_buffer(data, length);
+    free(data);
+    return wjson_node;
+}
+
+#ifdef WJSON_HAVE_MMAP
+/**
+ * @brief Reads everything from a file descriptor into a heap allocated buffer.
+ *
+ * This is the fallback for inputs that cannot be memory mapped, such as pipes, sockets and character devices.
+ *
+ * @param descriptor File descriptor to read from.
+ * @param length Receives the number of bytes read.
+ * @return Heap allocated buffer holding the data, or NULL on a read or memory allocation failure.
+ * @note The caller is responsible for freeing the returned buffer.
+ */
+char* wjson_read_descriptor(int descriptor, size_t* length)
+{
+    size_t capacity = 65536;
+    size_t used = 0;
+    char* buffer = (char*)malloc(capacity);
+
+    while (buffer != NULL)
+    {
+        ssize_t count = read(descriptor, buffer + used, capacity - used);
+
+        if (count < 0)
+        {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (count == 0)
+        {
+            *length = used;
+            return buffer;
+        }
+        used += (size_t)count;
+
+        /* Buffer is full, grow it geometrically */
+        if (used == capacity)
+        {
+            char* grown = (char*)realloc(buffer, capacity * 2);
+            if (grown == NULL) break;
+            buffer = grown;
+            capacity *= 2;
+        }
+    }
+
+    fprintf(stderr, "wJson: Failed to read JSON input.");
+    free(buffer);
+    return NULL;
+}
+#endif
+
+/**
+ * @brief The contents of a JSON file, either memory mapped or read into the heap.
+ */
+struct wjson_source
+{
+    const char* data;
+    size_t length;
+    void* mapping;
+    char* buffer;
+};
+
+/**
+ * @brief Makes the contents of a file available in memory.
+ *
+ * Regular files are memory mapped and parsed directly out of the page cache, so no bytes are copied through a
+ * stdio buffer. The mapping is advised as sequential so the kernel reads ahead aggressively. Inputs that cannot
+ * be mapped (pipes, character devices, empty files) are read into memory instead. Platforms without mmap fall
+ * back to reading the file through stdio.
+ *
+ * @param source Receives the contents.
+ * @param filename Name of the file.
+ * @return 1 on success, 0 if the file could not be opened or read.
+ * @note The contents must be released with wjson_close_source.
+ */
+int wjson_open_source(struct wjson_source* source, const char* filename)
+{
+#ifdef WJSON_HAVE_MMAP
+    struct stat status;
+    int descriptor = open(filename, O_RDONLY);
+
+    source->mapping = NULL;
+    source->buffer = NULL;
+
+    if (descriptor < 0)
+    {
+        wprintf(L"Error opening file: %s\n", filename);
+        return 0;
+    }
+
+    /* Map regular files straight into memory */
+    if (fstat(descriptor, &status) == 0 && S_ISREG(status.st_mode) && status.st_size > 0
+        && (unsigned long long)status.st_size <= (unsigned long long)(size_t)-1)
+    {
+        void* mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (mapping != MAP_FAILED)
+        {
+            close(descriptor);
+#ifdef MADV_SEQUENTIAL
+            madvise(mapping, (size_t)status.st_size, MADV_SEQUENTIAL);
+#endif
+            source->mapping = mapping;
+            source->data = (const char*)mapping;
+            source->length = (size_t)status.st_size;
+            return 1;
+        }
+    }
+
+    /* Fall back to reading for anything that cannot be mapped */
+    source->buffer = wjson_read_descriptor(descriptor, &source->length);
+    close(descriptor);
+#else
+    FILE* file = fopen(filename, "rb");
+
+    source->mapping = NULL;
+    source->buffer = NULL;
+
+    if (file == NULL)
+    {
+        wprintf(L"Error opening file: %s\n", filename);
+        return 0;
+    }
+    source->buffer = wjson_read_stream(file, &source->length);
+    fclose(file);
+#endif
+
+    source->data = source->buffer;
+    return source->buffer != NULL;
+}
+
+/**
+ * @brief Releases the contents of a file obtained from wjson_open_source.
+ *
+ * @param source Contents to release.
+ */
+void wjson_close_source(struct wjson_source* source)
+{
+#ifdef WJSON_HAVE_MMAP
+    if (source->mapping != NULL) munmap(source->mapping, source->length);
+#endif
+    free(source->buffer);
+}
+
+/**
+ * @brief Parses a JSON file and returns a wjson pointer representing the entire JSON structure.
+ *
+ * The file is memory mapped where possible and parsed with wjson_parse_buffer.
+ *
+ * @param filename Name of the JSON file to parse.
+ * @return wjson pointer to the parsed JSON structure, or NULL on failure.
+ * @note The caller is responsible for freeing the allocated memory.
+ * @author Toby Benjamin Clark
+ */
+struct wjson* wjson_parse(const char* filename)
+{
+    struct wjson_source source;
+    struct wjson* wjson_node;
+
+    if (!wjson_open_source(&source, filename)) return NULL;
+
+    wjson_node = wjson_parse_buffer(source.data, source.length);
+    wjson_close_source(&source);
+    return wjson_node;
+}
+
+/**
+ * @brief Parses a JSON file, reporting each token to a set of callbacks as wjson_parse_events does.
+ *
+ * The file is memory mapped where possible, so even very large files are scanned straight out of the page
+ * cache without being copied or turned into a tree.
+ *
+ * @param filename Name of the JSON file to parse.
+ * @param events Callbacks to report tokens to.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE, WJSON_PARSE_ABORTED, or WJSON_PARSE_ERROR on a parse or read error.
+ */
+int wjson_parse_file_events(const char* filename, const struct wjson_events* events, void* context)
+{
+    struct wjson_source source;
+    int status;
+
+    if (!wjson_open_source(&source, filename)) return WJSON_PARSE_ERROR;
+
+    status = wjson_parse_events(source.data, source.length, events, context);
+    wjson_close_source(&source);
+    return status;
+}
+
+
+
+
+
+#define WJSON_NDJSON_BLOCK_SIZE 1048576
+
+/**
+ * @brief Work shared by the threads of an NDJSON parse.
+ *
+ * The input is handed out in blocks of about WJSON_NDJSON_BLOCK_SIZE bytes, each extended to the end of its last
+ * record; next is the start of the first block not yet claimed and claimed counts the blocks handed out. In
+ * ordered mode a worker delivers its block's documents only once delivered reaches the block's sequence number,
+ * so the callback sees records in input order. Every field after context is guarded by lock.
+ */
+struct wjson_ndjson_job
+{
+    const char* data;
+    const char* end;
+    int flags;
+    int (*callback)(void* context, size_t offset, struct wjson* document);
+    void* context;
+    const char* next;
+    size_t claimed;
+    size_t delivered;
+    int status;
+#ifdef WJSON_HAVE_PTHREAD
+    pthread_mutex_t lock;
+    pthread_cond_t turn;
+#endif
+};
+
+/**
+ * @brief A parsed record waiting to be delivered in ordered mode.
+ */
+struct wjson_ndjson_record
+{
+    size_t offset;
+    struct wjson* document;
+};
+
+/**
+ * @brief Records the outcome of a record or callback in the job status.
+ *
+ * A stopped parse stays stopped, and an error is only reported if no callback stopped the parse.
+ *
+ * @param job Shared job; the caller holds its lock.
+ * @param status WJSON_PARSE_ERROR or WJSON_PARSE_ABORTED.
+ */
+void wjson_ndjson_fail(struct wjson_ndjson_job* job, int status)
+{
+    if (job->status != WJSON_PARSE_ABORTED) job->status = status;
+}
+
+void wjson_ndjson_lock(struct wjson_ndjson_job* job)
+{
+#ifdef WJSON_HAVE_PTHREAD
+    pthread_mutex_lock(&job->lock);
+#else
+    (void)job;
+#endif
+}
+
+void wjson_ndjson_unlock(struct wjson_ndjson_job* job)
+{
+#ifdef WJSON_HAVE_PTHREAD
+    pthread_mutex_unlock(&job->lock);
+#else
+    (void)job;
+#endif
+}
+
+/**
+ * @brief Claims blocks of an NDJSON job and parses their records until the input runs out.
+ *
+ * Each worker allocates the documents of its current block from its own arena, so workers never contend on the
+ * allocator, and resets the arena once the block has been delivered.
+ *
+ * @param argument The shared struct wjson_ndjson_job.
+ * @return NULL.
+ */
+void* wjson_ndjson_worker(void* argument)
+{
+    struct wjson_ndjson_job* job = (struct wjson_ndjson_job*)argument;
+    struct wjson_arena* arena = wjson_arena_create(0);
+    struct wjson_parser* parser = wjson_parser_create();
+    struct wjson_ndjson_record* records = NULL;
+    size_t capacity = 0;
+
+    for (;;)
+    {
+        const char* cursor;
+        const char* block_end;
+        size_t sequence;
+        size_t count = 0;
+        size_t i;
+        int status = WJSON_PARSE_COMPLETE;
+
+        /* Claim the next block, extended to the end of its last record */
+        wjson_ndjson_lock(job);
+        if (job->next == job->end || job->status == WJSON_PARSE_ABORTED)
+        {
+            wjson_ndjson_unlock(job);
+            break;
+        }
+        cursor = job->next;
+        if ((size_t)(job->end - cursor) <= WJSON_NDJSON_BLOCK_SIZE)
+        {
+            block_end = job->end;
+        }
+        else
+        {
+            block_end = (const char*)memchr(cursor + WJSON_NDJSON_BLOCK_SIZE, '\n',
+                                            (size_t)(job->end - cursor) - WJSON_NDJSON_BLOCK_SIZE);
+            block_end = (block_end == NULL) ? job->end : block_end + 1;
+        }
+        job->next = block_end;
+        sequence = job->claimed++;
+        wjson_ndjson_unlock(job);
+
+        /* Parse each non-blank line of the block as a document */
+        while (cursor < block_end && status != WJSON_PARSE_ABORTED)
+        {
+            const char* line_end = (const char*)memchr(cursor, '\n', (size_t)(block_end - cursor));
+            const char* start = cursor;
+            struct wjson* document;
+
+            if (line_end == NULL) line_end = block_end;
+            cursor = line_end + 1;
+
+            while (start < line_end && (*start == ' ' || *start == '\t' || *start == '\r')) start++;
+            if (start == line_end) continue;
+
+            document = wjson_parser_parse(parser, start, (size_t)(line_end - start), arena, 0);
+            if (document == NULL) status = WJSON_PARSE_ERROR;
+
+            if (job->flags & WJSON_NDJSON_ORDERED)
+            {
+                if (count == capacity)
+                {
+                    size_t grown_capacity = (capacity == 0) ? 256 : capacity * 2;
+                    struct wjson_ndjson_record* grown = (struct wjson_ndjson_record*)realloc(
+                        records, grown_capacity * sizeof(struct wjson_ndjson_record));
+
+                    if (grown == NULL)
+                    {
+                        fprintf(stderr, "wJson: Failed to allocate memory for NDJSON records.");
+                        exit(EXIT_FAILURE);
+                    }
+                    records = grown;
+                    capacity = grown_capacity;
+                }
+                records[count].offset = (size_t)(start - job->data);
+                records[count].document = document;
+                count++;
+            }
+            else if (!job->callback(job->context, (size_t)(start - job->data), document))
+            {
+                status = WJSON_PARSE_ABORTED;
+            }
+        }
+
+        /* In ordered mode, wait for the previous block to be delivered, then deliver this one */
+        if (job->flags & WJSON_NDJSON_ORDERED)
+        {
+            wjson_ndjson_lock(job);
+#ifdef WJSON_HAVE_PTHREAD
+            while (job->delivered != sequence) pthread_cond_wait(&job->turn, &job->lock);
+#endif
+            if (job->status == WJSON_PARSE_ABORTED) count = 0;
+            wjson_ndjson_unlock(job);
+
+            for (i = 0; i < count; i++)
+            {
+                if (!job->callback(job->context, records[i].offset, records[i].document))
+                {
+                    status = WJSON_PARSE_ABORTED;
+                    break;
+                }
+            }
+        }
+
+        wjson_ndjson_lock(job);
+        if (status != WJSON_PARSE_COMPLETE) wjson_ndjson_fail(job, status);
+        if (job->flags & WJSON_NDJSON_ORDERED)
+        {
+            job->delivered++;
+#ifdef WJSON_HAVE_PTHREAD
+            pthread_cond_broadcast(&job->turn);
+#endif
+        }
+        wjson_ndjson_unlock(job);
+
+        wjson_arena_reset(arena);
+    }
+
+    free(records);
+    wjson_parser_destroy(parser);
+    wjson_arena_destroy(arena);
+    return NULL;
+}
+
+/**
+ * @brief Parses newline delimited JSON (NDJSON, or JSON Lines) on a pool of worker threads.
+ *
+ * Each non-blank line of the input is parsed as a separate document and passed to the callback along with the
+ * offset of its first byte; a record that fails to parse is passed as NULL. The input is split into blocks of
+ * about a megabyte at record boundaries, which the calling thread and threads - 1 worker threads claim in turn,
+ * each parsing into its own arena, so throughput scales with the number of cores.
+ *
+ * By default the callback is invoked on the worker threads as soon as each record is parsed, concurrently and
+ * in no particular order. With WJSON_NDJSON_ORDERED it is invoked for one record at a time, in input order;
+ * blocks are still parsed in parallel. Either way a document is only valid until the callback returns, and a
+ * callback returning 0 stops the parse.
+ *
+ * @param data Pointer to the first byte of the input.
+ * @param length Number of bytes in the input.
+ * @param threads Number of threads to parse with, or 0 for one per online processor.
+ * @param flags 0 or WJSON_NDJSON_ORDERED.
+ * @param callback Function receiving each record.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE once every record has been delivered, WJSON_PARSE_ABORTED if a callback stopped
+ *         the parse, or WJSON_PARSE_ERROR if any record failed to parse.
+ */
+int wjson_parse_ndjson(const char* data, size_t length, unsigned int threads, int flags,
+                       int (*callback)(void* context, size_t offset, struct wjson* document), void* context)
+{
+    struct wjson_ndjson_job job;
+    size_t blocks = length / WJSON_NDJSON_BLOCK_SIZE + 1;
+
+    job.data = data;
+    job.end = data + length;
+    job.flags = flags;
+    job.callback = callback;
+    job.context = context;
+    job.next = data;
+    job.claimed = 0;
+    job.delivered = 0;
+    job.status = WJSON_PARSE_COMPLETE;
+
+#ifdef WJSON_HAVE_PTHREAD
+    {
+        pthread_t* workers;
+        unsigned int started = 0;
+        unsigned int i;
+
+        if (threads == 0)
+        {
+            long online = sysconf(_SC_NPROCESSORS_ONLN);
+            threads = (online > 0) ? (unsigned int)online : 1;
+        }
+        if (threads > blocks) threads = (unsigned int)blocks;
+
+        pthread_mutex_init(&job.lock, NULL);
+        pthread_cond_init(&job.turn, NULL);
+
+        /* The calling thread is a worker too; if threads cannot be started, the others pick up the slack */
+        workers = (pthread_t*)malloc(threads * sizeof(pthread_t));
+        if (workers != NULL)
+        {
+            for (i = 0; i + 1 < threads; i++)
+            {
+                if (pthread_create(&workers[started], NULL, wjson_ndjson_worker, &job) == 0) started++;
+            }
+        }
+        wjson_ndjson_worker(&job);
+
+        for (i = 0; i < started; i++) pthread_join(workers[i], NULL);
+        free(workers);
+
+        pthread_cond_destroy(&job.turn);
+        pthread_mutex_destroy(&job.lock);
+    }
+#else
+    (void)threads;
+    (void)blocks;
+    wjson_ndjson_worker(&job);
+#endif
+
+    return job.status;
+}
+
+/**
+ * @brief Parses a newline delimited JSON file on a pool of worker threads, as wjson_parse_ndjson does.
+ *
+ * The file is memory mapped where the platform supports it, so the workers parse straight out of the page cache.
+ *
+ * @param filename Path to the NDJSON file.
+ * @param threads Number of threads to parse with, or 0 for one per online processor.
+ * @param flags 0 or WJSON_NDJSON_ORDERED.
+ * @param callback Function receiving each record.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE, WJSON_PARSE_ABORTED or WJSON_PARSE_ERROR, as for wjson_parse_ndjson. The file
+ *         failing to open or read is a WJSON_PARSE_ERROR.
+ */
+int wjson_parse_ndjson_file(const char* filename, unsigned int threads, int flags,
+                            int (*callback)(void* context, size_t offset, struct wjson* document), void* context)
+{
+    struct wjson_source source;
+    int status;
+
+    if (!wjson_open_source(&source, filename)) return WJSON_PARSE_ERROR;
+
+    status = wjson_parse_ndjson(source.data, source.length, threads, flags, callback, context);
+    wjson_close_source(&source);
+    return status;
+}
+
+
+
+
+
+#define WJSON_INDEX_BLOCK 64
+#define WJSON_INDEX_MIN_CHUNK 1048576
+
+/**
+ * @brief Stage one state for one chunk of a document being structurally indexed.
+ *
+ * A chunk covers bytes begin to end of the document, begin being a multiple of WJSON_INDEX_BLOCK. escaped,
+ * in_string and scalar carry the lexical state at begin: whether the first byte is escaped by a backslash, lies
+ * inside a string, or continues a run of scalar bytes (a number or literal). quotes receives the parity of the
+ * unescaped double quotes in the chunk when counting. The offsets of the chunk's structural bytes are collected
+ * in indices.
+ */
+struct wjson_index_chunk
+{
+    const char* data;
+    size_t begin;
+    size_t end;
+    int escaped;
+    int in_string;
+    int scalar;
+    int counting;
+    int quotes;
+    uint32_t* indices;
+    size_t count;
+    size_t capacity;
+    int failed;
+};
+
+/**
+ * @brief Returns the index of the lowest set bit of a non-zero 64-bit mask.
+ *
+ * @param mask Mask with at least one bit set.
+ * @return Index of the lowest set bit.
+ */
+int wjson_trailing_zeros_64(uint64_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(mask);
+#else
+    int index = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        index++;
+    }
+    return index;
+#endif
+}
+
+/**
+ * @brief Classifies the 64 bytes of a block into bitmasks, one bit per byte.
+ *
+ * The block is compared 32 bytes at a time with AVX2 when the compiler targets it, 16 bytes at a time with SSE2
+ * otherwise, and a byte at a time on other targets.
+ *
+ * @param block The 64 bytes to classify.
+ * @param quote Receives the double quotes.
+ * @param backslash Receives the backslashes.
+ * @param whitespace Receives the spaces, tabs, carriage returns and line feeds.
+ * @param operators Receives the braces, brackets, colons and commas.
+ */
+void wjson_classify_block(const char* block, uint64_t* quote, uint64_t* backslash, uint64_t* whitespace,
+                          uint64_t* operators)
+{
+#if defined(__AVX2__)
+    int i;
+
+    *quote = *backslash = *whitespace = *operators = 0;
+    for (i = 0; i < 64; i += 32)
+    {
+        __m256i bytes = _mm256_loadu_si256((const __m256i*)(block + i));
+        /* Setting bit 5 folds [ onto { and ] onto } */
+        __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')));
+        __m256i line = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n')),
+                                       _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r')));
+        __m256i brace = _mm256_or_si256(_mm256_cmpeq_epi8(folded, _mm256_set1_epi8('{')),
+                                        _mm256_cmpeq_epi8(folded, _mm256_set1_epi8('}')));
+        __m256i separator = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(':')),
+                                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(',')));
+
+        *quote |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'))) << i;
+        *backslash |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\\')))
+                      << i;
+        *whitespace |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(space, line)) << i;
+        *operators |= (uint64_t)(unsigned int)_mm256_movemask_epi8(_mm256_or_si256(brace, separator)) << i;
+    }
+#elif defined(WJSON_HAVE_SSE2)
+    int i;
+
+    *quote = *backslash = *whitespace = *operators = 0;
+    for (i = 0; i < 64; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(block + i));
+        /* Setting bit 5 folds [ onto { and ] onto } */
+        __m128i folded = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+        __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                                     _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')));
+        __m128i line = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n')),
+                                    _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r')));
+        __m128i brace = _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                                     _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+        __m128i separator = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(':')),
+                                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8(',')));
+
+        *quote |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'))) << i;
+        *backslash |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\\'))) << i;
+        *whitespace |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_or_si128(space, line)) << i;
+        *operators |= (uint64_t)(unsigned int)_mm_movemask_epi8(_mm_or_si128(brace, separator)) << i;
+    }
+#else
+    int i;
+
+    *quote = *backslash = *whitespace = *operators = 0;
+    for (i = 0; i < 64; i++)
+    {
+        uint64_t bit = (uint64_t)1 << i;
+        switch (block[i])
+        {
+            case '"': *quote |= bit; break;
+            case '\\': *backslash |= bit; break;
+            case ' ': case '\t': case '\n': case '\r': *whitespace |= bit; break;
+            case '{': case '}': case '[': case ']': case ':': case ',': *operators |= bit; break;
+            default: break;
+        }
+    }
+#endif
+}
+
+/**
+ * @brief Runs stage one over a chunk: finds its structural bytes, or counts its quotes.
+ *
+ * The structural bytes are the braces, brackets, colons and commas outside strings, the opening quote of each
+ * string, and the first byte of each number or literal; together they mark the start of every token. Each block
+ * of 64 bytes is classified into bitmasks, the escaped bytes are found from the backslashes, and a prefix XOR of
+ * the unescaped quotes gives the bytes inside strings. The set bits of the result are then written out as
+ * offsets. As JSON only allows backslashes inside strings, every backslash is treated as an escape.
+ *
+ * @param argument The struct wjson_index_chunk to process.
+ * @return NULL.
+ */
+void* wjson_index_worker(void* argument)
+{
+    struct wjson_index_chunk* chunk = (struct wjson_index_chunk*)argument;
+    uint64_t escaped_carry = (uint64_t)chunk->escaped;
+    uint64_t string_carry = chunk->in_string ? ~(uint64_t)0 : 0;
+    uint64_t scalar_carry = (uint64_t)chunk->scalar;
+    int parity = 0;
+    size_t offset;
+
+    for (offset = chunk->begin; offset < chunk->end; offset += WJSON_INDEX_BLOCK)
+    {
+        const char* block = chunk->data + offset;
+        char padded[WJSON_INDEX_BLOCK];
+        uint64_t quote, backslash, whitespace, operators;
+        uint64_t escaped = escaped_carry;
+        uint64_t in_string, scalar, structural;
+
+        /* Pad the final partial block with spaces */
+        if (chunk->end - offset < WJSON_INDEX_BLOCK)
+        {
+            memset(padded, ' ', sizeof(padded));
+            memcpy(padded, block, chunk->end - offset);
+            block = padded;
+        }
+        wjson_classify_block(block, &quote, &backslash, &whitespace, &operators);
+
+        /* Mark the byte after each unescaped backslash as escaped; backslashes are rare, so walk them */
+        escaped_carry = 0;
+        while (backslash != 0)
+        {
+            uint64_t bit = backslash & (~backslash + 1);
+            if ((escaped & bit) == 0)
+            {
+                if (bit == (uint64_t)1 << 63) escaped_carry = 1;
+                else escaped |= bit << 1;
+            }
+            backslash &= backslash - 1;
+        }
+        quote &= ~escaped;
+
+        /* A prefix XOR of the quotes sets every byte from an opening quote up to its closing quote */
+        in_string = quote;
+        in_string ^= in_string << 1;
+        in_string ^= in_string << 2;
+        in_string ^= in_string << 4;
+        in_string ^= in_string << 8;
+        in_string ^= in_string << 16;
+        in_string ^= in_string << 32;
+
+        /* Its top bit is the parity of the block's quotes */
+        if (chunk->counting)
+        {
+            parity ^= (int)(in_string >> 63);
+            continue;
+        }
+        in_string ^= string_carry;
+        string_carry = (in_string >> 63) ? ~(uint64_t)0 : 0;
+
+        /* Numbers and literals start where a run of other bytes outside strings starts */
+        scalar = ~(whitespace | operators | quote | in_string);
+        structural = (operators & ~in_string) | (quote & in_string) | (scalar & ~((scalar << 1) | scalar_carry));
+        scalar_carry = scalar >> 63;
+
+        if (chunk->end - offset < WJSON_INDEX_BLOCK) structural &= ((uint64_t)1 << (chunk->end - offset)) - 1;
+
+        /* Write out the offsets of the structural bytes */
+        if (chunk->count + 64 > chunk->capacity)
+        {
+            size_t capacity = (chunk->capacity == 0) ? 4096 : chunk->capacity * 2;
+            uint32_t* indices = (uint32_t*)realloc(chunk->indices, capacity * sizeof(uint32_t));
+
+            if (indices == NULL)
+            {
+                chunk->failed = 1;
+                return NULL;
+            }
+            chunk->indices = indices;
+            chunk->capacity = capacity;
+        }
+        while (structural != 0)
+        {
+            chunk->indices[chunk->count++] = (uint32_t)(offset + (size_t)wjson_trailing_zeros_64(structural));
+            structural &= structural - 1;
+        }
+    }
+
+    chunk->quotes = parity;
+    return NULL;
+}
+
+/**
+ * @brief Runs stage one of a parse over chunks of a document, on threads - 1 worker threads and the caller.
+ *
+ * @param chunks Chunks to process.
+ * @param count Number of chunks.
+ */
+void wjson_index_chunks(struct wjson_index_chunk* chunks, size_t count)
+{
+#ifdef WJSON_HAVE_PTHREAD
+    pthread_t* workers = (pthread_t*)malloc(count * sizeof(pthread_t));
+    int* started = (int*)calloc(count, sizeof(int));
+    size_t i;
+
+    /* Chunks whose thread cannot be started are processed by the caller */
+    for (i = 1; i < count; i++)
+    {
+        if (workers != NULL && started != NULL)
+            started[i] = (pthread_create(&workers[i], NULL, wjson_index_worker, &chunks[i]) == 0);
+    }
+    wjson_index_worker(&chunks[0]);
+
+    for (i = 1; i < count; i++)
+    {
+        if (started != NULL && started[i]) pthread_join(workers[i], NULL);
+        else wjson_index_worker(&chunks[i]);
+    }
+    free(started);
+    free(workers);
+#else
+    size_t i;
+
+    for (i = 0; i < count; i++) wjson_index_worker(&chunks[i]);
+#endif
+}
+
+/**
+ * @brief Parses a large JSON document in two stages: a structural index, then the tree.
+ *
+ * Stage one finds the start of every token - each brace, bracket, colon, comma, string and scalar - with SIMD
+ * bitmasks, producing an array of offsets; it never branches on individual bytes outside the rare escapes.
+ * With more than one thread, the document is split into chunks that are indexed in parallel: a first parallel
+ * pass counts each chunk's quotes so every chunk knows whether it starts inside a string, and a second one
+ * collects the offsets. Stage two walks the offsets, parsing each token in place with the same state machine
+ * as wjson_parse_events and building the tree, without scanning whitespace. Stage one is the part that scales;
+ * for small documents wjson_parse_buffer_arena is just as fast.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param threads Number of threads for stage one, or 0 for one per online processor.
+ * @param arena Arena to allocate the document from, or NULL to allocate from the heap.
+ * @return wjson pointer to the parsed JSON structure, or NULL on a parse error.
+ * @note Documents of 4 GiB or more, whose offsets would not fit the index, are parsed by
+ *       wjson_parse_buffer_arena instead.
+ */
+struct wjson* wjson_parse_indexed(const char* data, size_t length, unsigned int threads, struct wjson_arena* arena)
+{
+    struct wjson_index_chunk* chunks;
+    struct wjson_push_parser parser;
+    struct wjson_scanner scanner;
+    size_t count;
+    size_t chunk_size;
+    size_t i;
+    int status = WJSON_PARSE_INCOMPLETE;
+
+    if (length >= (size_t)0xFFFFFFFF) return wjson_parse_buffer_arena(data, length, arena);
+
+#ifdef WJSON_HAVE_UNISTD
+    if (threads == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (unsigned int)online : 1;
+    }
+#endif
+    if (threads == 0) threads = 1;
+
+    /* Split the document into equal chunks of whole blocks, none smaller than WJSON_INDEX_MIN_CHUNK */
+    count = length / WJSON_INDEX_MIN_CHUNK + 1;
+    if (count > threads) count = threads;
+    chunk_size = (length / count + WJSON_INDEX_BLOCK - 1) / WJSON_INDEX_BLOCK * WJSON_INDEX_BLOCK;
+
+    chunks = (struct wjson_index_chunk*)calloc(count, sizeof(struct wjson_index_chunk));
+    if (chunks == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for structural index.");
+        return NULL;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        size_t before = i * chunk_size;
+
+        chunks[i].data = data;
+        chunks[i].begin = (before < length) ? before : length;
+        chunks[i].end = (i + 1 == count || before + chunk_size > length) ? length : before + chunk_size;
+        chunks[i].counting = 1;
+
+        /* A chunk starts escaped if an odd run of backslashes precedes it */
+        while (before > 0 && data[before - 1] == '\\')
+        {
+            chunks[i].escaped = !chunks[i].escaped;
+            before--;
+        }
+    }
+
+    /* With several chunks, count quotes first so each chunk knows whether it starts inside a string */
+    if (count > 1)
+    {
+        wjson_index_chunks(chunks, count);
+        for (i = 1; i < count; i++)
+        {
+            char previous = data[chunks[i].begin - 1];
+
+            chunks[i].in_string = chunks[i - 1].in_string ^ chunks[i - 1].quotes;
+            chunks[i].scalar = !chunks[i].in_string && previous != '"' && previous != ' ' && previous != '\t'
+                               && previous != '\n' && previous != '\r' && previous != '{' && previous != '}'
+                               && previous != '[' && previous != ']' && previous != ':' && previous != ',';
+        }
+    }
+    for (i = 0; i < count; i++) chunks[i].counting = 0;
+    wjson_index_chunks(chunks, count);
+
+    /* Stage two: parse the token at each structural offset */
+    wjson_push_parser_init(&parser, &wjson_builder_events, NULL);
+    parser.context = &parser.builder;
+    parser.builder.arena = arena;
+
+    scanner.start = data;
+    scanner.cursor = data;
+    scanner.end = data + length;
+    scanner.base = 0;
+    scanner.partial = 0;
+    scanner.scratch = NULL;
+    scanner.scratch_capacity = 0;
+
+    for (i = 0; i < count && status == WJSON_PARSE_INCOMPLETE; i++)
+    {
+        size_t j;
+
+        if (chunks[i].failed)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for structural index.");
+            status = WJSON_PARSE_ERROR;
+            break;
+        }
+
+        for (j = 0; j < chunks[i].count; j++)
+        {
+            int result;
+            char first;
+            char c;
+
+            scanner.cursor = data + chunks[i].indices[j];
+            first = *scanner.cursor;
+            if (parser.state == WJSON_STATE_DONE)
+            {
+                wjson_parse_error(&scanner, "Unexpected trailing characters");
+                status = WJSON_PARSE_ERROR;
+                break;
+            }
+
+            result = wjson_push_token(&parser, &scanner);
+            if (result != WJSON_PARSE_COMPLETE)
+            {
+                status = WJSON_PARSE_ERROR;
+                break;
+            }
+
+            /* A number or literal must end at whitespace or a structural byte */
+            if (first == '"' || first == '{' || first == '}' || first == '[' || first == ']' || first == ':'
+                || first == ',')
+                continue;
+            c = (scanner.cursor < scanner.end) ? *scanner.cursor : ' ';
+            if (c != ' ' && c != '\t' && c != '\n' && c != '\r' && c != '{' && c != '}' && c != '[' && c != ']'
+                && c != ':' && c != ',' && c != '"')
+            {
+                wjson_parse_error(&scanner, "Unexpected character");
+                status = WJSON_PARSE_ERROR;
+                break;
+            }
+        }
+    }
+
+    if (status == WJSON_PARSE_INCOMPLETE)
+    {
+        scanner.cursor = scanner.end;
+        if (parser.state == WJSON_STATE_DONE)
+        {
+            status = WJSON_PARSE_COMPLETE;
+        }
+        else
+        {
+            wjson_parse_error(&scanner, "Unexpected end of input");
+            status = WJSON_PARSE_ERROR;
+        }
+    }
+
+    for (i = 0; i < count; i++) free(chunks[i].indices);
+    free(chunks);
+    parser.scratch = scanner.scratch;
+    wjson_push_parser_release(&parser);
+    if (status == WJSON_PARSE_COMPLETE) return parser.builder.root;
+
+    wjson_free(parser.builder.root);
+    return NULL;
+}
+
+
+
+
+
+/**
+ * @brief Finds the first double quote, brace or bracket in a run of bytes.
+ *
+ * The run is examined 32 bytes at a time with AVX2 when the compiler targets it, 16 bytes at a time with SSE2
+ * otherwise, and a byte at a time on other targets and for the final partial block.
+ *
+ * @param cursor First byte to examine.
+ * @param end One past the last byte to examine.
+ * @return Pointer to the first such byte, or end.
+ */
+const char* wjson_scan_nesting(const char* cursor, const char* end)
+{
+#if defined(__AVX2__)
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i open = _mm256_set1_epi8('{');
+    const __m256i close = _mm256_set1_epi8('}');
+    const __m256i fold = _mm256_set1_epi8(0x20);
+
+    while (end - cursor >= 32)
+    {
+        __m256i block = _mm256_loadu_si256((const __m256i*)cursor);
+        /* Setting bit 5 folds [ onto { and ] onto } */
+        __m256i folded = _mm256_or_si256(block, fold);
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(block, quote),
+                                          _mm256_or_si256(_mm256_cmpeq_epi8(folded, open),
+                                                          _mm256_cmpeq_epi8(folded, close)));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(special);
+
+        if (mask != 0) return cursor + wjson_lowest_bit(mask);
+        cursor += 32;
+    }
+#elif defined(WJSON_HAVE_SSE2)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i open = _mm_set1_epi8('{');
+    const __m128i close = _mm_set1_epi8('}');
+    const __m128i fold = _mm_set1_epi8(0x20);
+
+    while (end - cursor >= 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i*)cursor);
+        /* Setting bit 5 folds [ onto { and ] onto } */
+        __m128i folded = _mm_or_si128(block, fold);
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(block, quote),
+                                       _mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)));
+        unsigned int mask = (unsigned int)_mm_movemask_epi8(special);
+
+        if (mask != 0) return cursor + wjson_lowest_bit(mask);
+        cursor += 16;
+    }
+#endif
+
+    while (cursor < end)
+    {
+        char c = *cursor;
+        if (c == '"' || c == '{' || c == '}' || c == '[' || c == ']') return cursor;
+        cursor++;
+    }
+    return end;
+}
+
+/**
+ * @brief Skips over a JSON value without parsing it.
+ *
+ * Containers are passed over by matching braces and brackets, jumping from one double quote, brace or bracket to
+ * the next and over whole strings, so no nodes are created and nothing inside is decoded or validated. Scalars
+ * are skipped up to the following whitespace, comma or closing brace or bracket.
+ *
+ * @param scanner Scanner positioned at the first byte of the value; left just past it.
+ * @return 1 on success, 0 if the value is cut off by the end of the input.
+ */
+int wjson_skip_value(struct wjson_scanner* scanner)
+{
+    const char* cursor = scanner->cursor;
+    const char* end = scanner->end;
+    size_t depth = 0;
+
+    if (cursor == end) return 0;
+
+    /* Scalars run up to the next delimiter */
+    if (*cursor != '{' && *cursor != '[' && *cursor != '"')
+    {
+        while (cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']' && *cursor != ' ' && *cursor != '\t'
+               && *cursor != '\n' && *cursor != '\r')
+            cursor++;
+        scanner->cursor = cursor;
+        return 1;
+    }
+
+    for (;;)
+    {
+        if (*cursor == '"')
+        {
+            int escaped = 0;
+
+            cursor = wjson_find_string_end(cursor + 1, end, &escaped);
+            if (cursor == end) break;
+        }
+        else if (*cursor == '{' || *cursor == '[')
+        {
+            depth++;
+        }
+        else
+        {
+            depth--;
+        }
+
+        cursor++;
+        if (depth == 0)
+        {
+            scanner->cursor = cursor;
+            return 1;
+        }
+
+        cursor = wjson_scan_nesting(cursor, end);
+        if (cursor == end) break;
+    }
+
+    scanner->cursor = end;
+    wjson_parse_error(scanner, "Unexpected end of input");
+    return 0;
+}
+
+/**
+ * @brief Reads the key of an object member, if any, and positions the scanner at the member's value.
+ *
+ * @param scanner Scanner positioned at the member, after any whitespace.
+ * @param object Whether the member belongs to an object.
+ * @param member Receives the member.
+ * @return 1 on success, 0 on a parse error.
+ */
+int wjson_lazy_member(struct wjson_scanner* scanner, int object, struct wjson_lazy* member)
+{
+    member->data = scanner->start;
+    member->end = scanner->end;
+    member->key = NULL;
+
+    if (object)
+    {
+        int escaped = 0;
+
+        if (scanner->cursor == scanner->end || *scanner->cursor != '"')
+        {
+            wjson_parse_error(scanner, "Expected key");
+            return 0;
+        }
+        member->key = scanner->cursor;
+        scanner->cursor = wjson_find_string_end(scanner->cursor + 1, scanner->end, &escaped);
+        if (scanner->cursor == scanner->end)
+        {
+            wjson_parse_error(scanner, "Unterminated string");
+            return 0;
+        }
+        scanner->cursor++;
+
+        wjson_skip_whitespace(scanner);
+        if (scanner->cursor == scanner->end || *scanner->cursor != ':')
+        {
+            wjson_parse_error(scanner, "Expected ':'");
+            return 0;
+        }
+        scanner->cursor++;
+        wjson_skip_whitespace(scanner);
+    }
+
+    if (scanner->cursor == scanner->end)
+    {
+        wjson_parse_error(scanner, "Unexpected end of input");
+        return 0;
+    }
+    member->start = scanner->cursor;
+    return 1;
+}
+
+/**
+ * @brief Skips the value at the scanner position and the comma after it.
+ *
+ * @param scanner Scanner positioned at a member's value.
+ * @param close Closing brace or bracket of the container.
+ * @return 1 if another member follows, 0 at the end of the container, or -1 on a parse error.
+ */
+int wjson_lazy_advance(struct wjson_scanner* scanner, char close)
+{
+    if (!wjson_skip_value(scanner)) return -1;
+
+    wjson_skip_whitespace(scanner);
+    if (scanner->cursor < scanner->end && *scanner->cursor == ',')
+    {
+        scanner->cursor++;
+        wjson_skip_whitespace(scanner);
+        return 1;
+    }
+    if (scanner->cursor < scanner->end && *scanner->cursor == close) return 0;
+
+    wjson_parse_error(scanner, (close == '}') ? "Expected ',' or '}'" : "Expected ',' or ']'");
+    return -1;
+}
+
+/**
+ * @brief Prepares a scanner over the document a lazy value belongs to, positioned at the value.
+ *
+ * @param value Lazy value.
+ * @param scanner Scanner to prepare.
+ */
+void wjson_lazy_scanner(const struct wjson_lazy* value, struct wjson_scanner* scanner)
+{
+    scanner->start = value->data;
+    scanner->cursor = value->start;
+    scanner->end = value->end;
+    scanner->base = 0;
+    scanner->partial = 0;
+    scanner->scratch = NULL;
+    scanner->scratch_capacity = 0;
+}
+
+/**
+ * @brief Opens a lazy handle on a JSON document held in memory, without parsing it.
+ *
+ * A lazy handle is a position in the source buffer. Navigating with wjson_lazy_get, wjson_lazy_at and
+ * wjson_lazy_next decodes only the keys along the way; the values of members that are passed over are skipped by
+ * bracket matching, so no nodes are created and nothing is copied. Reading a few fields out of a large document
+ * therefore costs a fraction of a full parse. Skipped values are not validated; wjson_lazy_materialize parses a
+ * value in full when needed.
+ *
+ * @param value Receives the handle on the document's root value.
+ * @param data Pointer to the first byte of the document, which must outlive every handle into it.
+ * @param length Number of bytes in the document.
+ * @return 1 if the document starts with an object or array, 0 otherwise.
+ */
+int wjson_lazy_open(struct wjson_lazy* value, const char* data, size_t length)
+{
+    struct wjson_scanner scanner;
+
+    scanner.start = data;
+    scanner.cursor = data;
+    scanner.end = data + length;
+    wjson_skip_whitespace(&scanner);
+
+    value->data = data;
+    value->start = scanner.cursor;
+    value->end = scanner.end;
+    value->key = NULL;
+
+    if (scanner.cursor == scanner.end || (*scanner.cursor != '{' && *scanner.cursor != '['))
+    {
+        scanner.base = 0;
+        wjson_parse_error(&scanner, "Expected '{' or '['");
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * @brief Returns the type of a lazy value from its first byte.
+ *
+ * @param value Lazy value.
+ * @return One of the WJSON_TYPE_* constants, or WJSON_TYPE_EMPTY if the value is malformed.
+ */
+int wjson_lazy_type(const struct wjson_lazy* value)
+{
+    char c = (value->start < value->end) ? *value->start : '\0';
+
+    if (c == '{') return WJSON_TYPE_OBJECT;
+    if (c == '[') return WJSON_TYPE_LIST;
+    if (c == '"') return WJSON_TYPE_STRING;
+    if (c == 't' || c == 'f') return WJSON_TYPE_BOOLEAN;
+    if (c == 'n') return WJSON_TYPE_NULL;
+    if ((c >= '0' && c <= '9') || c == '-') return WJSON_TYPE_NUMERICAL;
+    return WJSON_TYPE_EMPTY;
+}
+
+/**
+ * @brief Finds a member of a lazy object by key.
+ *
+ * The members before the match are passed over without decoding their values. Keys without escape sequences are
+ * compared in place.
+ *
+ * @param object Lazy object.
+ * @param key Null terminated UTF-8 key to find.
+ * @param member Receives the member's value.
+ * @return 1 if the member was found, 0 if it was not or the object is malformed.
+ */
+int wjson_lazy_get(const struct wjson_lazy* object, const char* key, struct wjson_lazy* member)
+{
+    struct wjson_scanner scanner;
+    size_t key_length = strlen(key);
+    int found = 0;
+    int more;
+
+    if (wjson_lazy_type(object) != WJSON_TYPE_OBJECT) return 0;
+    wjson_lazy_scanner(object, &scanner);
+
+    scanner.cursor++;
+    wjson_skip_whitespace(&scanner);
+    more = (scanner.cursor == scanner.end || *scanner.cursor != '}');
+
+    while (more == 1 && wjson_lazy_member(&scanner, 1, member))
+    {
+        const char* name = member->key + 1;
+        int escaped = 0;
+        size_t length = (size_t)(wjson_find_string_end(name, scanner.end, &escaped) - name);
+
+        /* Only keys with escape sequences need decoding */
+        if (memchr(name, '\\', length) == NULL)
+        {
+            found = (length == key_length && memcmp(name, key, length) == 0);
+        }
+        else
+        {
+            struct wjson_scanner decoder = scanner;
+            const char* decoded;
+
+            decoder.cursor = name;
+            if (wjson_parse_value_string(&decoder, &decoded, &length, 0) != 1) break;
+            scanner.scratch = decoder.scratch;
+            scanner.scratch_capacity = decoder.scratch_capacity;
+            found = (length == key_length && memcmp(decoded, key, length) == 0);
+        }
+        if (found) break;
+
+        more = wjson_lazy_advance(&scanner, '}');
+    }
+
+    free(scanner.scratch);
+    return found;
+}
+
+/**
+ * @brief Finds a member of a lazy object or an element of a lazy array by position.
+ *
+ * @param container Lazy object or array.
+ * @param index Zero based position of the member.
+ * @param member Receives the member's value; for objects, its key is available through wjson_lazy_key.
+ * @return 1 if the member exists, 0 if the index is out of range or the container is malformed.
+ */
+int wjson_lazy_at(const struct wjson_lazy* container, size_t index, struct wjson_lazy* member)
+{
+    struct wjson_scanner scanner;
+    int type = wjson_lazy_type(container);
+    char close = (type == WJSON_TYPE_OBJECT) ? '}' : ']';
+
+    if (type != WJSON_TYPE_OBJECT && type != WJSON_TYPE_LIST) return 0;
+    wjson_lazy_scanner(container, &scanner);
+
+    scanner.cursor++;
+    wjson_skip_whitespace(&scanner);
+    if (scanner.cursor < scanner.end && *scanner.cursor == close) return 0;
+
+    for (;;)
+    {
+        if (!wjson_lazy_member(&scanner, type == WJSON_TYPE_OBJECT, member)) return 0;
+        if (index-- == 0) return 1;
+        if (wjson_lazy_advance(&scanner, close) != 1) return 0;
+    }
+}
+
+/**
+ * @brief Moves from a member of a lazy object or array to the one after it.
+ *
+ * Iterating with wjson_lazy_at(container, 0, ...) and then wjson_lazy_next visits every member in a single pass.
+ *
+ * @param member Lazy member, as returned by wjson_lazy_at, wjson_lazy_get or wjson_lazy_next.
+ * @param next Receives the following member; may be the same handle as member.
+ * @return 1 if another member follows, 0 at the end of the container or if it is malformed.
+ */
+int wjson_lazy_next(const struct wjson_lazy* member, struct wjson_lazy* next)
+{
+    struct wjson_scanner scanner;
+    int object = (member->key != NULL);
+
+    wjson_lazy_scanner(member, &scanner);
+    if (wjson_lazy_advance(&scanner, object ? '}' : ']') != 1) return 0;
+    return wjson_lazy_member(&scanner, object, next);
+}
+
+/**
+ * @brief Decodes the key of a lazy object member into a buffer as UTF-8.
+ *
+ * @param member Lazy object member.
+ * @param buffer Buffer to receive the null terminated key, or NULL to measure it.
+ * @param capacity Size of the buffer in bytes.
+ * @return Length of the full key in bytes, like snprintf, or 0 if the member has no key.
+ */
+size_t wjson_lazy_key(const struct wjson_lazy* member, char* buffer, size_t capacity)
+{
+    struct wjson_lazy key;
+
+    if (member->key == NULL)
+    {
+        if (buffer != NULL && capacity > 0) buffer[0] = '\0';
+        return 0;
+    }
+
+    key = *member;
+    key.start = member->key;
+    return wjson_lazy_string(&key, buffer, capacity);
+}
+
+/**
+ * @brief Decodes a lazy string value into a buffer as UTF-8.
+ *
+ * @param value Lazy string value.
+ * @param buffer Buffer to receive the null terminated string, or NULL to measure it.
+ * @param capacity Size of the buffer in bytes.
+ * @return Length of the full string in bytes, like snprintf, or 0 if the value is not a valid string.
+ */
+size_t wjson_lazy_string(const struct wjson_lazy* value, char* buffer, size_t capacity)
+{
+    struct wjson_scanner scanner;
+    const char* decoded = "";
+    size_t length = 0;
+
+    wjson_lazy_scanner(value, &scanner);
+    if (wjson_lazy_type(value) == WJSON_TYPE_STRING)
+    {
+        scanner.cursor++;
+        if (wjson_parse_value_string(&scanner, &decoded, &length, 0) != 1)
+        {
+            decoded = "";
+            length = 0;
+        }
+    }
+
+    if (buffer != NULL && capacity > 0)
+    {
+        size_t copied = (length < capacity) ? length : capacity - 1;
+        memcpy(buffer, decoded, copied);
+        buffer[copied] = '\0';
+    }
+
+    free(scanner.scratch);
+    return length;
+}
+
+/**
+ * @brief Parses a lazy numerical value.
+ *
+ * @param value Lazy numerical value.
+ * @param result Receives the number.
+ * @return 1 on success, 0 if the value is not a valid number.
+ */
+int wjson_lazy_number(const struct wjson_lazy* value, double* result)
+{
+    struct wjson_scanner scanner;
+
+    if (wjson_lazy_type(value) != WJSON_TYPE_NUMERICAL) return 0;
+    wjson_lazy_scanner(value, &scanner);
+    return wjson_parse_double(&scanner, result) == 1;
+}
+
+/**
+ * @brief Parses a lazy boolean value.
+ *
+ * @param value Lazy boolean value.
+ * @param result Receives the boolean.
+ * @return 1 on success, 0 if the value is not true or false.
+ */
+int wjson_lazy_bool(const struct wjson_lazy* value, bool* result)
+{
+    struct wjson_scanner scanner;
+
+    wjson_lazy_scanner(value, &scanner);
+    if (wjson_match_sequence(&scanner, "true") == 1)
+    {
+        *result = true;
+        return 1;
+    }
+    if (wjson_match_sequence(&scanner, "false") == 1)
+    {
+        *result = false;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Parses a lazy object or array in full, returning it as a wjson tree.
+ *
+ * Only the bytes of the value itself are parsed, and they are validated as they would be by wjson_parse_buffer.
+ *
+ * @param value Lazy object or array.
+ * @param arena Arena to allocate the tree from, or NULL to allocate from the heap.
+ * @return wjson pointer to the parsed structure, or NULL if the value is not a container or is malformed.
+ */
+struct wjson* wjson_lazy_materialize(const struct wjson_lazy* value, struct wjson_arena* arena)
+{
+    struct wjson_scanner scanner;
+    int type = wjson_lazy_type(value);
+
+    if (type != WJSON_TYPE_OBJECT && type != WJSON_TYPE_LIST) return NULL;
+    wjson_lazy_scanner(value, &scanner);
+    if (!wjson_skip_value(&scanner)) return NULL;
+
+    return wjson_parse_buffer_arena(value->start, (size_t)(scanner.cursor - value->start), arena);
+}
+
+
+
+
+
+/**
+ * @brief One reference token of a compiled JSON Pointer.
+ *
+ * key is the unescaped token as null terminated UTF-8, for lazy documents, and match the same key in storage
+ * form, for wjson trees. Tokens that are array indices also have numeric set and their value in index. A token of
+ * exactly "*" is a wildcard matching every member or element.
+ */
+struct wjson_path_step
+{
+    char* key;
+    wjson_char* match;
+    size_t index;
+    int numeric;
+    int wildcard;
+};
+
+/**
+ * @brief A JSON Pointer compiled by wjson_path_compile.
+ */
+struct wjson_path
+{
+    struct wjson_path_step* steps;
+    size_t count;
+};
+
+/**
+ * @brief Compiles a JSON Pointer (RFC 6901) into a reusable path.
+ *
+ * The pointer is split into reference tokens, ~1 and ~0 are unescaped to / and ~, array indices are converted
+ * to integers and keys are converted to storage form, all once, so evaluating the path against many documents
+ * only costs the lookups themselves. As an extension, a token of exactly "*" matches every member of an object
+ * or element of an array. The empty pointer refers to the whole document.
+ *
+ * @param pointer Null terminated UTF-8 JSON Pointer, such as "/users/3/name".
+ * @return Pointer to the compiled path, or NULL if the pointer is malformed.
+ * @note The caller is responsible for releasing the path with wjson_path_free.
+ */
+struct wjson_path* wjson_path_compile(const char* pointer)
+{
+    struct wjson_path* path;
+    const char* cursor;
+    size_t count = 0;
+
+    if (*pointer != '\0' && *pointer != '/')
+    {
+        fprintf(stderr, "wJson: JSON Pointer must start with '/'.");
+        return NULL;
+    }
+    for (cursor = pointer; *cursor != '\0'; cursor++)
+    {
+        if (*cursor == '/') count++;
+    }
+
+    path = (struct wjson_path*)malloc(sizeof(struct wjson_path));
+    if (path == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for JSON Pointer.");
+        exit(EXIT_FAILURE);
+    }
+    path->count = 0;
+    path->steps = (struct wjson_path_step*)calloc(count + 1, sizeof(struct wjson_path_step));
+    if (path->steps == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for JSON Pointer.");
+        exit(EXIT_FAILURE);
+    }
+
+    cursor = pointer;
+    while (*cursor == '/')
+    {
+        struct wjson_path_step* step = &path->steps[path->count++];
+        const char* token = ++cursor;
+        size_t length;
+        size_t i;
+
+        while (*cursor != '\0' && *cursor != '/') cursor++;
+
+        step->key = (char*)malloc((size_t)(cursor - token) + 1);
+        if (step->key == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for JSON Pointer.");
+            exit(EXIT_FAILURE);
+        }
+
+        /* Unescape ~1 and ~0, in that order of precedence */
+        for (length = 0; token < cursor; token++)
+        {
+            if (*token != '~')
+            {
+                step->key[length++] = *token;
+            }
+            else if (token + 1 < cursor && (token[1] == '0' || token[1] == '1'))
+            {
+                step->key[length++] = (token[1] == '0') ? '~' : '/';
+                token++;
+            }
+            else
+            {
+                fprintf(stderr, "wJson: Invalid escape sequence in JSON Pointer.");
+                step->key[length] = '\0';
+                wjson_path_free(path);
+                return NULL;
+            }
+        }
+        step->key[length] = '\0';
+        step->wildcard = (length == 1 && step->key[0] == '*');
+
+        /* Array indices are 0 or a digit string without a leading zero */
+        step->numeric = (length > 0 && (step->key[0] != '0' || length == 1));
+        step->index = 0;
+        for (i = 0; i < length && step->numeric; i++)
+        {
+            if (step->key[i] < '0' || step->key[i] > '9' || step->index > ((size_t)-1 - 9) / 10) step->numeric = 0;
+            else step->index = step->index * 10 + (size_t)(step->key[i] - '0');
+        }
+
+        step->match = (wjson_char*)malloc((length + 1) * sizeof(wjson_char));
+        if (step->match == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for JSON Pointer.");
+            exit(EXIT_FAILURE);
+        }
+#ifdef WJSON_UTF8_STORAGE
+        memcpy(step->match, step->key, length + 1);
+#else
+        wjson_decode_utf8(step->key, length, step->match, length + 1);
+#endif
+    }
+
+    return path;
+}
+
+/**
+ * @brief Releases a compiled path.
+ *
+ * @param path Path to release, or NULL.
+ */
+void wjson_path_free(struct wjson_path* path)
+{
+    size_t i;
+
+    if (path == NULL) return;
+    for (i = 0; i < path->count; i++)
+    {
+        free(path->steps[i].key);
+        free(path->steps[i].match);
+    }
+    free(path->steps);
+    free(path);
+}
+
+/**
+ * @brief Returns the head of the container a member holds, or NULL if its value is not a container.
+ *
+ * @param member Member node.
+ * @return Head of the object or list, or NULL.
+ */
+struct wjson* wjson_path_container(struct wjson* member)
+{
+    if (member->type == WJSON_TYPE_OBJECT) return member->data_object;
+    if (member->type == WJSON_TYPE_LIST) return member->data_list;
+    return NULL;
+}
+
+struct wjson* wjson_find_member(struct wjson* wjson_node, const wjson_char* key);
+
+/**
+ * @brief Matches the remaining steps of a path against a value of a wjson tree.
+ *
+ * @param value Node matched by the steps so far.
+ * @param head Head of the container value holds, or NULL if it holds a scalar.
+ * @param path Compiled path.
+ * @param step Index of the next step to match.
+ * @param matches Array receiving matching nodes.
+ * @param capacity Number of entries in matches.
+ * @param found Number of matches found so far.
+ * @param exhaustive Whether to keep counting matches once matches is full.
+ * @return Number of matches found so far, including those from this value.
+ */
+size_t wjson_path_match(struct wjson* value, struct wjson* head, const struct wjson_path* path, size_t step,
+                        struct wjson** matches, size_t capacity, size_t found, int exhaustive)
+{
+    const struct wjson_path_step* current = &path->steps[step];
+    struct wjson* member;
+
+    if (step == path->count)
+    {
+        if (found < capacity) matches[found] = value;
+        return found + 1;
+    }
+    if (head == NULL) return found;
+
+    /* Wildcards branch into every member or element */
+    if (current->wildcard)
+    {
+        for (member = head; member != NULL && member->type != WJSON_TYPE_EMPTY; member = member->next)
+        {
+            found = wjson_path_match(member, wjson_path_container(member), path, step + 1, matches, capacity, found,
+                                     exhaustive);
+            if (!exhaustive && found >= capacity) break;
+        }
+        return found;
+    }
+
+    /* Lists are indexed in constant time; objects use their hash index */
+    if (head->flags & WJSON_FLAG_LIST)
+    {
+        if (!current->numeric) return found;
+        member = wjson_list_get(head, current->index);
+    }
+    else
+    {
+        member = wjson_find_member(head, current->match);
+    }
+
+    if (member == NULL) return found;
+    return wjson_path_match(member, wjson_path_container(member), path, step + 1, matches, capacity, found,
+                            exhaustive);
+}
+
+/**
+ * @brief Evaluates a compiled path against a wjson tree, returning the first match.
+ *
+ * Object members are found through wjson_get's hash index and list elements by index in constant time, so the
+ * cost depends on the length of the path rather than the size of the document.
+ *
+ * @param document Head of the wjson object or list to evaluate against.
+ * @param path Compiled path.
+ * @return The first matching node - the document itself for the empty pointer, a member or element otherwise -
+ *         or NULL if nothing matches.
+ */
+struct wjson* wjson_path_eval(struct wjson* document, const struct wjson_path* path)
+{
+    struct wjson* match = NULL;
+
+    wjson_path_match(document, document, path, 0, &match, 1, 0, 0);
+    return match;
+}
+
+/**
+ * @brief Evaluates a compiled path against a wjson tree, returning every match.
+ *
+ * Without wildcards there is at most one match. Matches are stored in document order.
+ *
+ * @param document Head of the wjson object or list to evaluate against.
+ * @param path Compiled path.
+ * @param matches Array receiving the matching nodes, or NULL to count them.
+ * @param capacity Number of entries in matches.
+ * @return Total number of matches, which may exceed capacity, like snprintf.
+ */
+size_t wjson_path_eval_all(struct wjson* document, const struct wjson_path* path, struct wjson** matches,
+                           size_t capacity)
+{
+    return wjson_path_match(document, document, path, 0, matches, (matches == NULL) ? 0 : capacity, 0, 1);
+}
+
+/**
+ * @brief Matches the remaining steps of a path against a lazy value, reporting each match.
+ *
+ * @param value Lazy value matched by the steps so far.
+ * @param path Compiled path.
+ * @param step Index of the next step to match.
+ * @param callback Function receiving each match.
+ * @param context Pointer passed through to the callback.
+ * @return 1 to continue, or 0 if the callback stopped the search.
+ */
+int wjson_path_visit(const struct wjson_lazy* value, const struct wjson_path* path, size_t step,
+                     int (*callback)(void* context, const struct wjson_lazy* match), void* context)
+{
+    const struct wjson_path_step* current = &path->steps[step];
+    struct wjson_lazy member;
+    int type;
+
+    if (step == path->count) return callback(context, value) != 0;
+
+    type = wjson_lazy_type(value);
+    if (type != WJSON_TYPE_OBJECT && type != WJSON_TYPE_LIST) return 1;
+
+    if (current->wildcard)
+    {
+        if (!wjson_lazy_at(value, 0, &member)) return 1;
+        do
+        {
+            if (!wjson_path_visit(&member, path, step + 1, callback, context)) return 0;
+        } while (wjson_lazy_next(&member, &member));
+        return 1;
+    }
+
+    if (type == WJSON_TYPE_LIST)
+    {
+        if (!current->numeric || !wjson_lazy_at(value, current->index, &member)) return 1;
+    }
+    else if (!wjson_lazy_get(value, current->key, &member))
+    {
+        return 1;
+    }
+    return wjson_path_visit(&member, path, step + 1, callback, context);
+}
+
+/**
+ * @brief Evaluates a compiled path directly against a JSON document in memory, without building a tree.
+ *
+ * The document is navigated lazily, as with wjson_lazy_get: only the keys along the path are decoded, and
+ * members off the path are skipped by bracket matching. Each match is passed to the callback as a lazy handle,
+ * from which its value can be read or materialized.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @param path Compiled path.
+ * @param callback Function receiving each match; returning 0 stops the search.
+ * @param context Pointer passed through to the callback.
+ * @return WJSON_PARSE_COMPLETE once every match has been reported, WJSON_PARSE_ABORTED if the callback stopped
+ *         the search, or WJSON_PARSE_ERROR if the document is not an object or array.
+ */
+int wjson_path_stream(const char* data, size_t length, const struct wjson_path* path,
+                      int (*callback)(void* context, const struct wjson_lazy* match), void* context)
+{
+    struct wjson_lazy root;
+
+    if (!wjson_lazy_open(&root, data, length)) return WJSON_PARSE_ERROR;
+    return wjson_path_visit(&root, path, 0, callback, context) ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+}
+
+
+
+
+
+#define WJSON_TAPE_ENTRY(tag, payload) (((uint64_t)(unsigned char)(tag) << 56) | (uint64_t)(payload))
+#define WJSON_TAPE_TAG(entry) ((char)((entry) >> 56))
+#define WJSON_TAPE_PAYLOAD(entry) ((entry) & (((uint64_t)1 << 56) - 1))
+
+/**
+ * @brief Read-only document stored as a flat tape, an alternative to a tree of struct wjson nodes.
+ *
+ * Each value is one 64-bit entry in entries, in document order, tagged in its top byte with the character that
+ * starts it: '{' and '[' open containers and '}' and ']' close them, each storing the index of its partner;
+ * '"' is a string or key, storing the offset of its text in strings; 't', 'f' and 'n' are the literals; and 'd'
+ * is a number, whose double occupies the following entry. Object members are a key entry followed by the value.
+ * Text in strings is a 32-bit length, the UTF-8 bytes and a null terminator.
+ *
+ * A value costs 8 bytes, or 16 for numbers, plus its text; iterating is a forward scan and skipping a subtree
+ * is a single jump to its closing entry.
+ */
+struct wjson_tape
+{
+    uint64_t* entries;
+    size_t count;
+    size_t capacity;
+    char* strings;
+    size_t string_length;
+    size_t string_capacity;
+    size_t* open;
+    size_t depth;
+    size_t open_capacity;
+};
+
+/**
+ * @brief Appends an entry to a tape.
+ *
+ * @param tape Tape being built.
+ * @param entry Entry to append.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_tape_push(struct wjson_tape* tape, uint64_t entry)
+{
+    if (tape->count == tape->capacity)
+    {
+        size_t capacity = (tape->capacity == 0) ? 256 : tape->capacity * 2;
+        uint64_t* entries = (uint64_t*)realloc(tape->entries, capacity * sizeof(uint64_t));
+
+        if (entries == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for tape.");
+            return 0;
+        }
+        tape->entries = entries;
+        tape->capacity = capacity;
+    }
+
+    tape->entries[tape->count++] = entry;
+    return 1;
+}
+
+int wjson_tape_open(void* context, char tag)
+{
+    struct wjson_tape* tape = (struct wjson_tape*)context;
+
+    if (tape->depth == tape->open_capacity)
+    {
+        size_t capacity = (tape->open_capacity == 0) ? 16 : tape->open_capacity * 2;
+        size_t* open = (size_t*)realloc(tape->open, capacity * sizeof(size_t));
+
+        if (open == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for nesting stack.");
+            return 0;
+        }
+        tape->open = open;
+        tape->open_capacity = capacity;
+    }
+
+    /* The payload is filled in with the index of the closing entry once it is known */
+    tape->open[tape->depth++] = tape->count;
+    return wjson_tape_push(tape, WJSON_TAPE_ENTRY(tag, 0));
+}
+
+int wjson_tape_close(void* context, char tag)
+{
+    struct wjson_tape* tape = (struct wjson_tape*)context;
+    size_t start = tape->open[--tape->depth];
+
+    tape->entries[start] |= (uint64_t)tape->count;
+    return wjson_tape_push(tape, WJSON_TAPE_ENTRY(tag, start));
+}
+
+int wjson_tape_object_start(void* context)
+{
+    return wjson_tape_open(context, '{');
+}
+
+int wjson_tape_object_end(void* context)
+{
+    return wjson_tape_close(context, '}');
+}
+
+int wjson_tape_array_start(void* context)
+{
+    return wjson_tape_open(context, '[');
+}
+
+int wjson_tape_array_end(void* context)
+{
+    return wjson_tape_close(context, ']');
+}
+
+int wjson_tape_string(void* context, const char* value, size_t length)
+{
+    struct wjson_tape* tape = (struct wjson_tape*)context;
+    size_t required = tape->string_length + sizeof(uint32_t) + length + 1;
+    uint32_t prefix = (uint32_t)length;
+
+    if (required > tape->string_capacity)
+    {
+        size_t capacity = (tape->string_capacity == 0) ? 4096 : tape->string_capacity;
+        char* strings;
+
+        while (capacity < required) capacity *= 2;
+        strings = (char*)realloc(tape->strings, capacity);
+        if (strings == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for tape strings.");
+            return 0;
+        }
+        tape->strings = strings;
+        tape->string_capacity = capacity;
+    }
+
+    if (!wjson_tape_push(tape, WJSON_TAPE_ENTRY('"', tape->string_length))) return 0;
+    memcpy(tape->strings + tape->string_length, &prefix, sizeof(uint32_t));
+    if (length > 0) memcpy(tape->strings + tape->string_length + sizeof(uint32_t), value, length);
+    tape->strings[required - 1] = '\0';
+    tape->string_length = required;
+    return 1;
+}
+
+int wjson_tape_number(void* context, double value)
+{
+    struct wjson_tape* tape = (struct wjson_tape*)context;
+    uint64_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return wjson_tape_push(tape, WJSON_TAPE_ENTRY('d', 0)) && wjson_tape_push(tape, bits);
+}
+
+int wjson_tape_bool(void* context, bool value)
+{
+    return wjson_tape_push((struct wjson_tape*)context, WJSON_TAPE_ENTRY(value ? 't' : 'f', 0));
+}
+
+int wjson_tape_null(void* context)
+{
+    return wjson_tape_push((struct wjson_tape*)context, WJSON_TAPE_ENTRY('n', 0));
+}
+
+/**
+ * @brief Callbacks that write a tape from the event parser.
+ */
+const struct wjson_events wjson_tape_events = {
+    wjson_tape_object_start,
+    wjson_tape_object_end,
+    wjson_tape_array_start,
+    wjson_tape_array_end,
+    wjson_tape_string,
+    wjson_tape_string,
+    wjson_tape_number,
+    wjson_tape_bool,
+    wjson_tape_null,
+    NULL,
+    NULL,
+    NULL
+};
+
+/**
+ * @brief Allocates an empty tape.
+ *
+ * @return Pointer to the new tape.
+ */
+struct wjson_tape* wjson_tape_create()
+{
+    struct wjson_tape* tape = (struct wjson_tape*)calloc(1, sizeof(struct wjson_tape));
+
+    if (tape == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for tape.");
+        exit(EXIT_FAILURE);
+    }
+    return tape;
+}
+
+/**
+ * @brief Parses a JSON document held in memory into a tape.
+ *
+ * The tape is written by a client of wjson_parse_events, so the document is validated exactly as
+ * wjson_parse_buffer validates it; the only allocations are the geometric growth of the entry and string
+ * buffers.
+ *
+ * @param data Pointer to the first byte of the document.
+ * @param length Number of bytes in the document.
+ * @return Pointer to the tape, or NULL on a parse error.
+ * @note The caller is responsible for releasing the tape with wjson_tape_free.
+ */
+struct wjson_tape* wjson_tape_parse(const char* data, size_t length)
+{
+    struct wjson_tape* tape = wjson_tape_create();
+
+    if (wjson_parse_events(data, length, &wjson_tape_events, tape) != WJSON_PARSE_COMPLETE)
+    {
+        wjson_tape_free(tape);
+        return NULL;
+    }
+    return tape;
+}
+
+/**
+ * @brief Releases a tape.
+ *
+ * @param tape Tape to release, or NULL.
+ */
+void wjson_tape_free(struct wjson_tape* tape)
+{
+    if (tape == NULL) return;
+    free(tape->entries);
+    free(tape->strings);
+    free(tape->open);
+    free(tape);
+}
+
+/**
+ * @brief Returns the type of the value at an index of a tape.
+ *
+ * The document's root container is at index 0.
+ *
+ * @param tape Tape.
+ * @param index Index of a value.
+ * @return One of the WJSON_TYPE_* constants, or WJSON_TYPE_EMPTY for a closing entry or an index past the end.
+ */
+int wjson_tape_type(const struct wjson_tape* tape, size_t index)
+{
+    if (index >= tape->count) return WJSON_TYPE_EMPTY;
+
+    switch (WJSON_TAPE_TAG(tape->entries[index]))
+    {
+        case '{': return WJSON_TYPE_OBJECT;
+        case '[': return WJSON_TYPE_LIST;
+        case '"': return WJSON_TYPE_STRING;
+        case 'd': return WJSON_TYPE_NUMERICAL;
+        case 't': case 'f': return WJSON_TYPE_BOOLEAN;
+        case 'n': return WJSON_TYPE_NULL;
+        default: return WJSON_TYPE_EMPTY;
+    }
+}
+
+/**
+ * @brief Returns the index of the value after the one at an index, skipping containers in constant time.
+ *
+ * To iterate a container at index c, start at c + 1 and stop at wjson_tape_end(tape, c). In an object the key
+ * is at the member's index and the value at the index after it.
+ *
+ * @param tape Tape.
+ * @param index Index of a value.
+ * @return Index of the following value or closing entry.
+ */
+size_t wjson_tape_next(const struct wjson_tape* tape, size_t index)
+{
+    uint64_t entry = tape->entries[index];
+    char tag = WJSON_TAPE_TAG(entry);
+
+    if (tag == '{' || tag == '[') return (size_t)WJSON_TAPE_PAYLOAD(entry) + 1;
+    if (tag == 'd') return index + 2;
+    return index + 1;
+}
+
+/**
+ * @brief Returns the index of the closing entry of the container at an index.
+ *
+ * @param tape Tape.
+ * @param index Index of an object or list.
+ * @return Index of its closing entry.
+ */
+size_t wjson_tape_end(const struct wjson_tape* tape, size_t index)
+{
+    return (size_t)WJSON_TAPE_PAYLOAD(tape->entries[index]);
+}
+
+/**
+ * @brief Returns the UTF-8 text of the string or key at an index of a tape.
+ *
+ * @param tape Tape.
+ * @param index Index of a string or key.
+ * @param length Receives the length of the text in bytes, or NULL.
+ * @return Null terminated text, valid for the lifetime of the tape.
+ */
+const char* wjson_tape_get_string(const struct wjson_tape* tape, size_t index, size_t* length)
+{
+    const char* text = tape->strings + WJSON_TAPE_PAYLOAD(tape->entries[index]);
+    uint32_t prefix;
+
+    memcpy(&prefix, text, sizeof(uint32_t));
+    if (length != NULL) *length = prefix;
+    return text + sizeof(uint32_t);
+}
+
+/**
+ * @brief Returns the number at an index of a tape.
+ *
+ * @param tape Tape.
+ * @param index Index of a number.
+ * @return The number.
+ */
+double wjson_tape_get_number(const struct wjson_tape* tape, size_t index)
+{
+    double value;
+
+    memcpy(&value, &tape->entries[index + 1], sizeof(value));
+    return value;
+}
+
+/**
+ * @brief Returns the boolean at an index of a tape.
+ *
+ * @param tape Tape.
+ * @param index Index of a boolean.
+ * @return The boolean.
+ */
+bool wjson_tape_get_bool(const struct wjson_tape* tape, size_t index)
+{
+    return WJSON_TAPE_TAG(tape->entries[index]) == 't';
+}
+
+/**
+ * @brief Finds the value of an object member on a tape by key.
+ *
+ * The members' values are skipped without being visited, so the search touches one entry and one key per member.
+ *
+ * @param tape Tape.
+ * @param object Index of an object.
+ * @param key Null terminated UTF-8 key to find.
+ * @return Index of the value of the first member with the key, or 0 if there is none.
+ */
+size_t wjson_tape_get(const struct wjson_tape* tape, size_t object, const char* key)
+{
+    size_t end = wjson_tape_end(tape, object);
+    size_t key_length = strlen(key);
+    size_t index;
+
+    for (index = object + 1; index < end; index = wjson_tape_next(tape, index + 1))
+    {
+        size_t length;
+        const char* text = wjson_tape_get_string(tape, index, &length);
+
+        if (length == key_length && memcmp(text, key, length) == 0) return index + 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Reports the values of a tape to a set of callbacks, as wjson_parse_events would report the document.
+ *
+ * The tape is replayed with a single forward scan, without recursion.
+ *
+ * @param tape Tape.
+ * @param events Callbacks to report values to.
+ * @param context Pointer passed through to every callback.
+ * @return WJSON_PARSE_COMPLETE, or WJSON_PARSE_ABORTED if a callback stopped the replay.
+ */
+int wjson_tape_replay(const struct wjson_tape* tape, const struct wjson_events* events, void* context)
+{
+    size_t index = 0;
+    size_t depth = 0;
+    char initial[64];
+    char* objects = initial;
+    size_t capacity = sizeof(initial);
+    int key_due = 0;
+    int proceed = 1;
+
+    /* Track whether each open container is an object, and so whether a string is a key */
+    while (index < tape->count && proceed)
+    {
+        uint64_t entry = tape->entries[index];
+        char tag = WJSON_TAPE_TAG(entry);
+        size_t length;
+        const char* text;
+
+        switch (tag)
+        {
+            case '{':
+            case '[':
+                if (depth == capacity)
+                {
+                    char* grown = (char*)malloc(capacity * 2);
+                    if (grown == NULL)
+                    {
+                        fprintf(stderr, "wJson: Failed to allocate memory for nesting stack.");
+                        proceed = 0;
+                        break;
+                    }
+                    memcpy(grown, objects, depth);
+                    if (objects != initial) free(objects);
+                    objects = grown;
+                    capacity *= 2;
+                }
+                objects[depth++] = (tag == '{');
+                key_due = (tag == '{');
+                if (tag == '{' && events->on_object_start != NULL) proceed = events->on_object_start(context);
+                if (tag == '[' && events->on_array_start != NULL) proceed = events->on_array_start(context);
+                break;
+            case '}':
+            case ']':
+                depth--;
+                if (tag == '}' && events->on_object_end != NULL) proceed = events->on_object_end(context);
+                if (tag == ']' && events->on_array_end != NULL) proceed = events->on_array_end(context);
+                break;
+            case '"':
+                text = wjson_tape_get_string(tape, index, &length);
+                if (key_due)
+                {
+                    if (events->on_key != NULL) proceed = events->on_key(context, text, length);
+                    key_due = 0;
+                    index++;
+                    continue;
+                }
+                if (events->on_string != NULL) proceed = events->on_string(context, text, length);
+                break;
+            case 'd':
+                if (events->on_number != NULL) proceed = events->on_number(context, wjson_tape_get_number(tape, index));
+                index++;
+                break;
+            case 't':
+            case 'f':
+                if (events->on_bool != NULL) proceed = events->on_bool(context, tag == 't');
+                break;
+            default:
+                if (events->on_null != NULL) proceed = events->on_null(context);
+                break;
+        }
+
+        /* After a value inside an object, a key is due */
+        if (tag != '{' && tag != '[') key_due = (depth > 0 && objects[depth - 1]);
+        index++;
+    }
+
+    if (objects != initial) free(objects);
+    return proceed ? WJSON_PARSE_COMPLETE : WJSON_PARSE_ABORTED;
+}
+
+/**
+ * @brief Converts a tape into a wjson tree.
+ *
+ * @param tape Tape.
+ * @param arena Arena to allocate the tree from, or NULL to allocate from the heap.
+ * @return wjson pointer to the tree, or NULL on memory allocation failure.
+ */
+struct wjson* wjson_tape_to_tree(const struct wjson_tape* tape, struct wjson_arena* arena)
+{
+    struct wjson_builder builder;
+    int status;
+
+    builder.arena = arena;
+    builder.open = NULL;
+    builder.depth = 0;
+    builder.capacity = 0;
+    builder.key = NULL;
+    builder.text = NULL;
+    builder.text_capacity = 0;
+    builder.pending = 0;
+    builder.root = NULL;
+
+    status = wjson_tape_replay(tape, &wjson_builder_events, &builder);
+
+    free(builder.open);
+    free(builder.text);
+    if (status == WJSON_PARSE_COMPLETE) return builder.root;
+
+    wjson_free(builder.root);
+    return NULL;
+}
+
+/**
+ * @brief Appends a key or string of a wjson tree to a tape, as UTF-8.
+ *
+ * @param tape Tape being built.
+ * @param string Key or string in storage form.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_tape_stored_string(struct wjson_tape* tape, const wjson_char* string)
+{
+#ifdef WJSON_UTF8_STORAGE
+    return wjson_tape_string(tape, string, wjson_string_length(string));
+#else
+    char buffer[256];
+    size_t length = wjson_encode_utf8(string, NULL);
+    char* encoded = (length < sizeof(buffer)) ? buffer : (char*)malloc(length + 1);
+    int result;
+
+    if (encoded == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for tape strings.");
+        return 0;
+    }
+    wjson_encode_utf8(string, encoded);
+    result = wjson_tape_string(tape, encoded, length);
+
+    if (encoded != buffer) free(encoded);
+    return result;
+#endif
+}
+
+/**
+ * @brief Container being walked iteratively, with the next of its members to visit.
+ */
+struct wjson_walk_frame
+{
+    struct wjson* head;
+    struct wjson* current;
+};
+
+#define WJSON_WALK_STACK 32
+
+/**
+ * @brief Pushes a container onto the stack of an iterative tree walk, positioned at its first member.
+ *
+ * The stack starts out in a caller supplied array and moves to the heap, doubling, once that is full.
+ *
+ * @param stack Pointer to the stack, updated if it moves.
+ * @param capacity Pointer to the number of frames the stack can hold, updated if it grows.
+ * @param depth Pointer to the number of frames in use, incremented.
+ * @param initial Caller supplied array the stack starts out in.
+ * @param head Head of the container to push.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_walk_push(struct wjson_walk_frame** stack, size_t* capacity, size_t* depth,
+                    struct wjson_walk_frame* initial, struct wjson* head)
+{
+    if (*depth == *capacity)
+    {
+        struct wjson_walk_frame* grown = (struct wjson_walk_frame*)malloc(*capacity * 2 * sizeof(**stack));
+
+        if (grown == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for nesting stack.");
+            return 0;
+        }
+        memcpy(grown, *stack, *depth * sizeof(**stack));
+        if (*stack != initial) free(*stack);
+        *stack = grown;
+        *capacity *= 2;
+    }
+
+    /* Empty containers have a single member of type WJSON_TYPE_EMPTY, which is skipped */
+    (*stack)[*depth].head = head;
+    (*stack)[*depth].current = (head->type == WJSON_TYPE_EMPTY && head->next == NULL) ? NULL : head;
+    (*depth)++;
+    return 1;
+}
+
+/**
+ * @brief Appends a wjson object or list, and everything in it, to a tape.
+ *
+ * The tree is walked with an explicit stack rather than by recursion, so nesting depth costs no C stack; each
+ * container's end entry is appended, and its start entry patched, when its frame is popped.
+ *
+ * @param tape Tape being built.
+ * @param head Head of the object or list.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_tape_container(struct wjson_tape* tape, struct wjson* head)
+{
+    struct wjson_walk_frame initial[WJSON_WALK_STACK];
+    struct wjson_walk_frame* stack = initial;
+    size_t capacity = WJSON_WALK_STACK;
+    size_t depth = 0;
+    struct wjson* child = head;
+    int result = 1;
+
+    while (result)
+    {
+        struct wjson_walk_frame* frame;
+        struct wjson* current;
+        double number;
+        int list;
+
+        /* Open the container just reached */
+        if (child != NULL)
+        {
+            result = wjson_walk_push(&stack, &capacity, &depth, initial, child)
+                     && wjson_tape_open(tape, (child->flags & WJSON_FLAG_LIST) ? '[' : '{');
+            child = NULL;
+            continue;
+        }
+
+        frame = &stack[depth - 1];
+        current = frame->current;
+        list = (frame->head->flags & WJSON_FLAG_LIST) != 0;
+
+        /* Close the container once its last member has been appended */
+        if (current == NULL)
+        {
+            result = wjson_tape_close(tape, list ? ']' : '}');
+            if (--depth == 0) break;
+            continue;
+        }
+        frame->current = current->next;
+
+        if (!list && !wjson_tape_stored_string(tape, current->key))
+        {
+            result = 0;
+            break;
+        }
+
+        switch (current->type)
+        {
+            case WJSON_TYPE_NUMERICAL:
+                result = wjson_tape_number(tape, current->data_numerical);
+                break;
+            case WJSON_TYPE_INTEGER:
+            case WJSON_TYPE_RAW_NUMBER:
+                result = wjson_get_double(current, &number) && wjson_tape_number(tape, number);
+                break;
+            case WJSON_TYPE_STRING:
+                result = wjson_tape_stored_string(tape, current->data_string);
+                break;
+            case WJSON_TYPE_BOOLEAN:
+                result = wjson_tape_bool(tape, current->data_bool);
+                break;
+            case WJSON_TYPE_OBJECT:
+                child = current->data_object;
+                break;
+            case WJSON_TYPE_LIST:
+                child = current->data_list;
+                break;
+            default:
+                result = wjson_tape_null(tape);
+                break;
+        }
+    }
+
+    if (stack != initial) free(stack);
+    return result;
+}
+
+/**
+ * @brief Converts a wjson tree into a tape.
+ *
+ * The tape holds every number as a double, so integers and raw numbers are converted on the way in.
+ *
+ * @param document Head of the wjson object or list to convert.
+ * @return Pointer to the tape, or NULL on memory allocation failure.
+ * @note The caller is responsible for releasing the tape with wjson_tape_free.
+ */
+struct wjson_tape* wjson_tape_from_tree(struct wjson* document)
+{
+    struct wjson_tape* tape = wjson_tape_create();
+
+    if (!wjson_tape_container(tape, document))
+    {
+        wjson_tape_free(tape);
+        return NULL;
+    }
+    return tape;
+}
+
+
+
+
+
+/**
+ * @brief Output sink for the serializer.
+ *
+ * Bytes are staged in buffer and handed on in large blocks, so a document costs a handful of write or fwrite
+ * calls rather than one formatted stdio call per token. Depending on how it is set up, the writer fills a fixed
+ * caller supplied buffer (dropping, but still counting, bytes that do not fit), grows its buffer as needed, or
+ * flushes to a file descriptor or FILE stream whenever the buffer fills.
+ */
+struct wjson_writer
+{
+    char* buffer;
+    size_t length;
+    size_t capacity;
+    size_t total;
+    int growable;
+    int fd;
+    FILE* file;
+    int failed;
+};
+
+#define WJSON_WRITER_BLOCK_SIZE 65536
+
+/**
+ * @brief Returns the length of the longest prefix of a UTF-8 run that does not end part way through a sequence.
+ *
+ * @param data UTF-8 bytes.
+ * @param length Number of bytes in data.
+ * @return Length of the prefix.
+ */
+size_t wjson_utf8_boundary(const char* data, size_t length)
+{
+    size_t lead = length;
+    size_t needed;
+    unsigned char byte;
+
+    /* Step back over at most three continuation bytes to the lead byte of the final sequence */
+    while (lead > 0 && length - lead < 3 && ((unsigned char)data[lead - 1] & 0xC0) == 0x80) lead--;
+    if (lead == 0) return length;
+
+    byte = (unsigned char)data[lead - 1];
+    if ((byte & 0xE0) == 0xC0) needed = 2;
+    else if ((byte & 0xF0) == 0xE0) needed = 3;
+    else if ((byte & 0xF8) == 0xF0) needed = 4;
+    else needed = 1;
+
+    return (length - (lead - 1) < needed) ? lead - 1 : length;
+}
+
+/**
+ * @brief Writes a block of UTF-8 to a wide oriented stream.
+ *
+ * A stream that has already been used with wprintf and friends rejects byte output, so the block is decoded and
+ * written with fputws instead. Unless final is set, a partial UTF-8 sequence at the end of the block is left
+ * unwritten; the number of bytes consumed is returned so the remainder can be carried over to the next block.
+ *
+ * @param file Wide oriented stream to write to.
+ * @param data UTF-8 bytes to write.
+ * @param length Number of bytes in data.
+ * @param final Whether to write a trailing partial sequence rather than leave it.
+ * @return Number of bytes consumed, or (size_t)-1 on a write failure.
+ */
+size_t wjson_write_wide_stream(FILE* file, const char* data, size_t length, int final)
+{
+    wchar_t decoded[1024];
+    size_t consumed = 0;
+
+    while (consumed < length)
+    {
+        size_t chunk = (length - consumed < 1023) ? length - consumed : 1023;
+        size_t whole = wjson_utf8_boundary(data + consumed, chunk);
+
+        /* Split at a sequence boundary unless this is the very end of the document */
+        if (whole < chunk && (consumed + chunk < length || !final)) chunk = whole;
+        if (chunk == 0) break;
+
+        wjson_decode_utf8(data + consumed, chunk, decoded, chunk + 1);
+        if (fputws(decoded, file) < 0) return (size_t)-1;
+        consumed += chunk;
+    }
+    return consumed;
+}
+
+/**
+ * @brief Hands the writer's staged bytes on to its file descriptor or stream.
+ *
+ * @param writer Writer to flush.
+ * @param final Whether this is the last flush of the document.
+ * @return 1 on success, 0 on a write failure.
+ */
+int wjson_writer_flush(struct wjson_writer* writer, int final)
+{
+    size_t written = 0;
+
+    if (writer->failed) return 0;
+
+    if (writer->fd >= 0)
+    {
+#ifdef WJSON_HAVE_UNISTD
+        while (written < writer->length)
+        {
+            ssize_t result = write(writer->fd, writer->buffer + written, writer->length - written);
+            if (result < 0)
+            {
+                if (errno == EINTR) continue;
+                writer->failed = 1;
+                return 0;
+            }
+            written += (size_t)result;
+        }
+#else
+        writer->failed = 1;
+        return 0;
+#endif
+    }
+    else if (writer->file != NULL)
+    {
+        if (fwide(writer->file, 0) > 0)
+        {
+            written = wjson_write_wide_stream(writer->file, writer->buffer, writer->length, final);
+            if (written == (size_t)-1)
+            {
+                writer->failed = 1;
+                return 0;
+            }
+        }
+        else
+        {
+            written = fwrite(writer->buffer, 1, writer->length, writer->file);
+            if (written != writer->length)
+            {
+                writer->failed = 1;
+                return 0;
+            }
+        }
+    }
+    else
+    {
+        return 1;
+    }
+
+    /* Carry over any partial sequence left by a wide stream */
+    memmove(writer->buffer, writer->buffer + written, writer->length - written);
+    writer->length -= written;
+    return 1;
+}
+
+/**
+ * @brief Appends bytes to the writer, flushing or growing its buffer when it is full.
+ *
+ * @param writer Writer to append to.
+ * @param data Bytes to append.
+ * @param length Number of bytes to append.
+ */
+void wjson_writer_put(struct wjson_writer* writer, const char* data, size_t length)
+{
+    writer->total += length;
+
+    while (writer->length + length > writer->capacity)
+    {
+        size_t space = writer->capacity - writer->length;
+
+        if (writer->growable)
+        {
+            size_t capacity = (writer->capacity == 0) ? 256 : writer->capacity * 2;
+            char* buffer;
+
+            while (capacity < writer->length + length) capacity *= 2;
+            buffer = (char*)realloc(writer->buffer, capacity);
+            if (buffer == NULL)
+            {
+                fprintf(stderr, "wJson: Failed to allocate memory for serializer buffer.");
+                writer->failed = 1;
+                return;
+            }
+            writer->buffer = buffer;
+            writer->capacity = capacity;
+            break;
+        }
+
+        /* Fill what space there is, then flush; a fixed buffer keeps counting but drops the rest */
+        if (space > 0) memcpy(writer->buffer + writer->length, data, space);
+        writer->length += space;
+        data += space;
+        length -= space;
+
+        if (writer->fd < 0 && writer->file == NULL) return;
+        if (!wjson_writer_flush(writer, 0)) return;
+    }
+
+    if (length > 0) memcpy(writer->buffer + writer->length, data, length);
+    writer->length += length;
+}
+
+/**
+ * @brief Appends a single byte to the writer.
+ *
+ * @param writer Writer to append to.
+ * @param c Byte to append.
+ */
+void wjson_writer_put_char(struct wjson_writer* writer, char c)
+{
+    if (writer->length < writer->capacity)
+    {
+        writer->buffer[writer->length++] = c;
+        writer->total++;
+    }
+    else
+    {
+        wjson_writer_put(writer, &c, 1);
+    }
+}
+
+/**
+ * @brief Writes tabs for the given indentation level.
+ *
+ * @param writer Writer to append to.
+ * @param indentation Number of indentation levels.
+ */
+void wjson_write_indentation(struct wjson_writer* writer, int indentation)
+{
+    static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+    while (indentation > 0)
+    {
+        int count = (indentation < 16) ? indentation : 16;
+        wjson_writer_put(writer, tabs, (size_t)count);
+        indentation -= count;
+    }
+}
+
+/**
+ * @brief Writes the JSON escape sequence for a double quote, backslash or control character.
+ *
+ * @param writer Writer to append to.
+ * @param c Character to escape.
+ */
+void wjson_write_escape(struct wjson_writer* writer, unsigned long c)
+{
+    static const char hex[] = "0123456789abcdef";
+    char escape[6];
+
+    switch (c)
+    {
+        case '"': wjson_writer_put(writer, "\\\"", 2); return;
+        case '\\': wjson_writer_put(writer, "\\\\", 2); return;
+        case '\b': wjson_writer_put(writer, "\\b", 2); return;
+        case '\f': wjson_writer_put(writer, "\\f", 2); return;
+        case '\n': wjson_writer_put(writer, "\\n", 2); return;
+        case '\r': wjson_writer_put(writer, "\\r", 2); return;
+        case '\t': wjson_writer_put(writer, "\\t", 2); return;
+    }
+
+    escape[0] = '\\';
+    escape[1] = 'u';
+    escape[2] = '0';
+    escape[3] = '0';
+    escape[4] = hex[(c >> 4) & 0xF];
+    escape[5] = hex[c & 0xF];
+    wjson_writer_put(writer, escape, 6);
+}
+
+/**
+ * @brief Writes a key or string as a quoted, escaped JSON string encoded as UTF-8.
+ *
+ * Double quotes, backslashes and control characters are escaped; everything else is copied through. With
+ * WJSON_UTF8_STORAGE runs of ordinary bytes are found with wjson_scan_string and copied in one go; wide strings
+ * are encoded into a small chunk that is appended whenever it fills.
+ *
+ * @param writer Writer to append to.
+ * @param string String to write; NULL is written as an empty string.
+ */
+void wjson_write_string(struct wjson_writer* writer, const wjson_char* string)
+{
+    wjson_writer_put_char(writer, '"');
+
+    if (string != NULL)
+    {
+#ifdef WJSON_UTF8_STORAGE
+        const char* end = string + wjson_string_length(string);
+
+        while (string < end)
+        {
+            const char* special = wjson_scan_string(string, end);
+
+            wjson_writer_put(writer, string, (size_t)(special - string));
+            if (special == end) break;
+
+            wjson_write_escape(writer, (unsigned char)*special);
+            string = special + 1;
+        }
+#else
+        char chunk[256];
+        size_t used = 0;
+
+        for (; *string != L'\0'; string++)
+        {
+            unsigned long c = (unsigned long)*string;
+
+            /* Leave room for the longest UTF-8 sequence */
+            if (used > sizeof(chunk) - 4)
+            {
+                wjson_writer_put(writer, chunk, used);
+                used = 0;
+            }
+
+            if (c == '"' || c == '\\' || c < 0x20)
+            {
+                wjson_writer_put(writer, chunk, used);
+                used = 0;
+                wjson_write_escape(writer, c);
+            }
+            else if (c < 0x80)
+            {
+                chunk[used++] = (char)c;
+            }
+            else
+            {
+                wchar_t code_point[2];
+
+                code_point[0] = *string;
+                code_point[1] = L'\0';
+                used += wjson_encode_utf8(code_point, chunk + used);
+            }
+        }
+        wjson_writer_put(writer, chunk, used);
+#endif
+    }
+
+    wjson_writer_put_char(writer, '"');
+}
+
+/**
+ * @brief Floating point number with a 64-bit significand and a binary exponent, representing f * 2^e.
+ */
+struct wjson_diy_fp
+{
+    uint64_t f;
+    int e;
+};
+
+/**
+ * @brief Multiplies two diy_fps, rounding the 128-bit product of the significands to its high 64 bits.
+ *
+ * @param x First factor.
+ * @param y Second factor.
+ * @return Product of x and y.
+ */
+struct wjson_diy_fp wjson_diy_fp_multiply(struct wjson_diy_fp x, struct wjson_diy_fp y)
+{
+    struct wjson_diy_fp product;
+    uint64_t high;
+    uint64_t low = wjson_multiply_64(x.f, y.f, &high);
+
+    product.f = high + (low >> 63);
+    product.e = x.e + y.e + 64;
+    return product;
+}
+
+/**
+ * @brief Shifts a diy_fp left until the top bit of its significand is set.
+ *
+ * @param x Non-zero diy_fp to normalise.
+ * @return Normalised diy_fp with the same value.
+ */
+struct wjson_diy_fp wjson_diy_fp_normalize(struct wjson_diy_fp x)
+{
+    int shift = wjson_leading_zeros_64(x.f);
+
+    x.f <<= shift;
+    x.e -= shift;
+    return x;
+}
+
+/**
+ * @brief Returns a power of ten that scales a diy_fp with the given binary exponent into Grisu's target range.
+ *
+ * The power is taken from wjson_pow5_table, since 10^k = 5^k * 2^k, and rounded to 64 bits. It is chosen so
+ * that multiplying a normalised diy_fp with binary exponent e by it yields a binary exponent in [-60, -32].
+ *
+ * @param e Binary exponent of the normalised diy_fp to scale.
+ * @param k Receives the decimal exponent of the returned power of ten.
+ * @return 10^k as a normalised diy_fp.
+ */
+struct wjson_diy_fp wjson_cached_power(int e, int* k)
+{
+    struct wjson_diy_fp power;
+    const uint64_t* entry;
+
+    /* Smallest k with floor(k * log2(10)) + e + 1 >= -60 */
+    *k = (int)((-61 - e) * 0.30102999566398114);
+    while (((217706L * *k) >> 16) < -61 - e) (*k)++;
+    while (((217706L * (*k - 1)) >> 16) >= -61 - e) (*k)--;
+
+    entry = &wjson_pow5_table[2 * (*k - WJSON_POW5_SMALLEST)];
+    power.f = entry[0] + (entry[1] >> 63);
+    power.e = (int)((217706L * *k) >> 16) - 63;
+
+    /* Rounding up carried out of the significand */
+    if (power.f == 0)
+    {
+        power.f = (uint64_t)1 << 63;
+        power.e++;
+    }
+    return power;
+}
+
+/**
+ * @brief Generates the shortest digits Grisu2 can find between the scaled boundaries of a double.
+ *
+ * @param buffer Receives the digits.
+ * @param decimal_exponent Holds the decimal exponent of the scaling on entry, and of the digits on return.
+ * @param low Scaled lower boundary, rounded inwards.
+ * @param w Scaled value.
+ * @param high Scaled upper boundary, rounded inwards.
+ * @return Number of digits generated.
+ */
+int wjson_grisu2_digits(char* buffer, int* decimal_exponent, struct wjson_diy_fp low, struct wjson_diy_fp w,
+                        struct wjson_diy_fp high)
+{
+    uint64_t delta = high.f - low.f;
+    uint64_t distance = high.f - w.f;
+    int shift = -high.e;
+    uint64_t one = (uint64_t)1 << shift;
+    unsigned long integral = (unsigned long)(high.f >> shift);
+    uint64_t fractional = high.f & (one - 1);
+    unsigned long divisor = 1000000000UL;
+    uint64_t rest, unit;
+    int digits = 10;
+    int length = 0;
+
+    /* Find the number of digits in the integral part */
+    while (digits > 1 && integral < divisor)
+    {
+        divisor /= 10;
+        digits--;
+    }
+
+    /* Integral digits, stopping as soon as what remains lies within the boundaries */
+    while (digits > 0)
+    {
+        buffer[length++] = (char)('0' + integral / divisor);
+        integral %= divisor;
+        digits--;
+
+        rest = ((uint64_t)integral << shift) + fractional;
+        if (rest <= delta)
+        {
+            *decimal_exponent += digits;
+            unit = (uint64_t)divisor << shift;
+            goto round;
+        }
+        divisor /= 10;
+    }
+
+    /* Fractional digits */
+    for (;;)
+    {
+        fractional *= 10;
+        buffer[length++] = (char)('0' + (fractional >> shift));
+        fractional &= one - 1;
+        delta *= 10;
+        distance *= 10;
+        (*decimal_exponent)--;
+        if (fractional <= delta) break;
+    }
+    rest = fractional;
+    unit = one;
+
+round:
+    /* Nudge the last digit towards the value while that keeps it within the boundaries and gets closer */
+    while (rest < distance && delta - rest >= unit
+           && (rest + unit < distance || distance - rest > rest + unit - distance))
+    {
+        buffer[length - 1]--;
+        rest += unit;
+    }
+    return length;
+}
+
+/**
+ * @brief Formats a finite double as the shortest decimal that parses back to it.
+ *
+ * Integers below 2^53 are formatted directly. Other values use Grisu2, which finds the shortest digits within
+ * the rounding boundaries of the double for nearly every input, and always digits that round trip. The digits
+ * are laid out in plain notation for decimal exponents from -5 to 15 and in exponential notation otherwise.
+ *
+ * @param value Finite double to format.
+ * @param buffer Receives the formatted number; 32 bytes is always enough. It is not null terminated.
+ * @return Number of characters written.
+ */
+int wjson_format_double(double value, char* buffer)
+{
+    char digits[20];
+    int length = 0, count, point, i;
+    int decimal_exponent;
+    uint64_t bits, fraction;
+    int exponent;
+    struct wjson_diy_fp v, w, high, low, power;
+
+    memcpy(&bits, &value, sizeof(double));
+    if (bits >> 63)
+    {
+        buffer[length++] = '-';
+        value = -value;
+    }
+    if (value == 0)
+    {
+        buffer[length++] = '0';
+        return length;
+    }
+
+    /* Integer fast path */
+    if (value < 9007199254740992.0 && value == (double)(uint64_t)value)
+    {
+        uint64_t integer = (uint64_t)value;
+
+        count = 0;
+        while (integer > 0)
+        {
+            digits[count++] = (char)('0' + integer % 10);
+            integer /= 10;
+        }
+        while (count > 0) buffer[length++] = digits[--count];
+        return length;
+    }
+
+    /* Decompose into v = f * 2^e and the boundaries halfway to the neighbouring doubles */
+    fraction = bits & (((uint64_t)1 << 52) - 1);
+    exponent = (int)((bits >> 52) & 0x7FF);
+    if (exponent == 0)
+    {
+        v.f = fraction;
+        v.e = 1 - 1075;
+    }
+    else
+    {
+        v.f = fraction | ((uint64_t)1 << 52);
+        v.e = exponent - 1075;
+    }
+
+    high.f = (v.f << 1) + 1;
+    high.e = v.e - 1;
+    high = wjson_diy_fp_normalize(high);
+
+    /* The lower boundary is closer when v is the smallest significand of its binade */
+    if (fraction == 0 && exponent > 1)
+    {
+        low.f = (v.f << 2) - 1;
+        low.e = v.e - 2;
+    }
+    else
+    {
+        low.f = (v.f << 1) - 1;
+        low.e = v.e - 1;
+    }
+    low.f <<= low.e - high.e;
+    low.e = high.e;
+    w = wjson_diy_fp_normalize(v);
+
+    /* Scale everything by a power of ten, then shrink the boundaries by an ulp for the rounding error */
+    power = wjson_cached_power(high.e, &decimal_exponent);
+    decimal_exponent = -decimal_exponent;
+    w = wjson_diy_fp_multiply(w, power);
+    low = wjson_diy_fp_multiply(low, power);
+    high = wjson_diy_fp_multiply(high, power);
+    low.f++;
+    high.f--;
+
+    count = wjson_grisu2_digits(digits, &decimal_exponent, low, w, high);
+    point = count + decimal_exponent;
+
+    if (point > 0 && point <= 15 && decimal_exponent >= 0)
+    {
+        /* Integer: digits followed by zeros */
+        for (i = 0; i < count; i++) buffer[length++] = digits[i];
+        for (i = count; i < point; i++) buffer[length++] = '0';
+    }
+    else if (point > 0 && point <= 15)
+    {
+        /* Decimal point within the digits */
+        for (i = 0; i < count; i++)
+        {
+            if (i == point) buffer[length++] = '.';
+            buffer[length++] = digits[i];
+        }
+    }
+    else if (point > -5 && point <= 0)
+    {
+        /* Leading zeros after the decimal point */
+        buffer[length++] = '0';
+        buffer[length++] = '.';
+        for (i = point; i < 0; i++) buffer[length++] = '0';
+        for (i = 0; i < count; i++) buffer[length++] = digits[i];
+    }
+    else
+    {
+        /* Exponential notation: d[.ddd]e[-]x */
+        int scientific = point - 1;
+        char exponent_digits[4];
+        int exponent_length = 0;
+
+        buffer[length++] = digits[0];
+        if (count > 1)
+        {
+            buffer[length++] = '.';
+            for (i = 1; i < count; i++) buffer[length++] = digits[i];
+        }
+        buffer[length++] = 'e';
+        if (scientific < 0)
+        {
+            buffer[length++] = '-';
+            scientific = -scientific;
+        }
+        do
+        {
+            exponent_digits[exponent_length++] = (char)('0' + scientific % 10);
+            scientific /= 10;
+        } while (scientific > 0);
+        while (exponent_length > 0) buffer[length++] = exponent_digits[--exponent_length];
+    }
+    return length;
+}
+
+/**
+ * @brief Writes a number. JSON has no representation for infinities and NaN, so they are written as null.
+ *
+ * @param writer Writer to append to.
+ * @param value Number to write.
+ */
+void wjson_write_number(struct wjson_writer* writer, double value)
+{
+    char buffer[32];
+
+    if (value != value || value - value != 0)
+    {
+        wjson_writer_put(writer, "null", 4);
+        return;
+    }
+    wjson_writer_put(writer, buffer, (size_t)wjson_format_double(value, buffer));
+}
+
+/**
+ * @brief Writes an integer node exactly, in decimal.
+ *
+ * @param writer Writer to append to.
+ * @param node Node of type WJSON_TYPE_INTEGER.
+ */
+void wjson_write_integer(struct wjson_writer* writer, const struct wjson* node)
+{
+    char buffer[24];
+    size_t length = sizeof(buffer);
+    int negative = !(node->flags & WJSON_FLAG_UNSIGNED) && node->data_integer < 0;
+    uint64_t magnitude = negative ? (uint64_t)0 - (uint64_t)node->data_integer : node->data_unsigned;
+
+    do
+    {
+        buffer[--length] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude > 0);
+    if (negative) buffer[--length] = '-';
+
+    wjson_writer_put(writer, buffer + length, sizeof(buffer) - length);
+}
+
+/**
+ * @brief Writes the source text of a raw number back out verbatim.
+ *
+ * @param writer Writer to append to.
+ * @param text Text of a WJSON_TYPE_RAW_NUMBER node.
+ */
+void wjson_write_raw_number(struct wjson_writer* writer, const wjson_char* text)
+{
+#ifdef WJSON_UTF8_STORAGE
+    wjson_writer_put(writer, text, wjson_string_length(text));
+#else
+    while (*text != 0) wjson_writer_put_char(writer, (char)*text++);
+#endif
+}
+
+/**
+ * @brief Writes a wjson object or list, along with every container nested in it.
+ *
+ * With a non-negative indentation the output is laid out one member per line, indented with tabs; with a
+ * negative indentation it is written compactly, without any whitespace. The open containers are kept on an
+ * explicit stack rather than the C call stack, so any document the parser accepts can be written back out
+ * however deeply it nests.
+ *
+ * @param writer Writer to append to.
+ * @param head Head of the object or list to write.
+ * @param indentation Indentation level of the container, or -1 for compact output.
+ * @note If the stack cannot grow, the writer is marked as failed and the output stops short.
+ */
+void wjson_write_container(struct wjson_writer* writer, struct wjson* head, int indentation)
+{
+    struct wjson_walk_frame initial[WJSON_WALK_STACK];
+    struct wjson_walk_frame* stack = initial;
+    size_t capacity = WJSON_WALK_STACK;
+    size_t depth = 0;
+    int pretty = indentation >= 0;
+
+    /* Empty containers have a single member of type WJSON_TYPE_EMPTY */
+    if (head->type == WJSON_TYPE_EMPTY && head->next == NULL)
+    {
+        wjson_writer_put(writer, (head->flags & WJSON_FLAG_LIST) ? "[]" : "{}", 2);
+        return;
+    }
+
+    wjson_walk_push(&stack, &capacity, &depth, initial, head);
+    wjson_writer_put_char(writer, (head->flags & WJSON_FLAG_LIST) ? '[' : '{');
+    if (pretty) wjson_writer_put_char(writer, '\n');
+
+    while (depth > 0)
+    {
+        struct wjson_walk_frame* frame = &stack[depth - 1];
+        struct wjson* current = frame->current;
+        struct wjson* child = NULL;
+
+        /* Close the container once its last member has been written */
+        if (current == NULL)
+        {
+            if (pretty) wjson_write_indentation(writer, indentation + (int)depth - 1);
+            wjson_writer_put_char(writer, (frame->head->flags & WJSON_FLAG_LIST) ? ']' : '}');
+            if (--depth == 0) break;
+            frame = &stack[depth - 1];
+        }
+        else
+        {
+            if (pretty) wjson_write_indentation(writer, indentation + (int)depth);
+
+            /* Write the key */
+            if (!(frame->head->flags & WJSON_FLAG_LIST))
+            {
+                wjson_write_string(writer, current->key);
+                if (pretty)
+                    wjson_writer_put(writer, " : ", 3);
+                else
+                    wjson_writer_put_char(writer, ':');
+            }
+
+            switch (current->type)
+            {
+                case WJSON_TYPE_NUMERICAL:
+                    wjson_write_number(writer, current->data_numerical);
+                    break;
+                case WJSON_TYPE_INTEGER:
+                    wjson_write_integer(writer, current);
+                    break;
+                case WJSON_TYPE_RAW_NUMBER:
+                    wjson_write_raw_number(writer, current->data_string);
+                    break;
+                case WJSON_TYPE_STRING:
+                    wjson_write_string(writer, current->data_string);
+                    break;
+                case WJSON_TYPE_BOOLEAN:
+                    if (current->data_bool) wjson_writer_put(writer, "true", 4);
+                    else wjson_writer_put(writer, "false", 5);
+                    break;
+                case WJSON_TYPE_OBJECT:
+                    child = current->data_object;
+                    break;
+                case WJSON_TYPE_LIST:
+                    child = current->data_list;
+                    break;
+                default:
+                    wjson_writer_put(writer, "null", 4);
+                    break;
+            }
+            frame->current = current->next;
+
+            if (child != NULL && child->type == WJSON_TYPE_EMPTY && child->next == NULL)
+            {
+                wjson_writer_put(writer, (child->flags & WJSON_FLAG_LIST) ? "[]" : "{}", 2);
+            }
+            else if (child != NULL)
+            {
+                /* Open a nested container; the separator after it is written when it closes */
+                if (!wjson_walk_push(&stack, &capacity, &depth, initial, child))
+                {
+                    writer->failed = 1;
+                    break;
+                }
+                wjson_writer_put_char(writer, (child->flags & WJSON_FLAG_LIST) ? '[' : '{');
+                if (pretty) wjson_writer_put_char(writer, '\n');
+                continue;
+            }
+        }
+
+        /* If not the last entry, write a comma */
+        if (frame->current != NULL) wjson_writer_put_char(writer, ',');
+        if (pretty) wjson_writer_put_char(writer, '\n');
+    }
+
+    if (stack != initial) free(stack);
+}
+
+/**
+ * @brief Serializes a wjson object or list to a sink writer and flushes it.
+ *
+ * @param node Head of the object or list to serialize.
+ * @param fd File descriptor to write to, or -1.
+ * @param file Stream to write to, or NULL.
+ * @param indentation Indentation level, or -1 for compact output.
+ * @return 1 on success, 0 on a write or memory allocation failure.
+ */
+int wjson_serialize_to_sink(struct wjson* node, int fd, FILE* file, int indentation)
+{
+    struct wjson_writer writer;
+    int result;
+
+    writer.buffer = (char*)malloc(WJSON_WRITER_BLOCK_SIZE);
+    if (writer.buffer == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for serializer buffer.");
+        return 0;
+    }
+    writer.length = 0;
+    writer.capacity = WJSON_WRITER_BLOCK_SIZE;
+    writer.total = 0;
+    writer.growable = 0;
+    writer.fd = fd;
+    writer.file = file;
+    writer.failed = 0;
+
+    wjson_write_container(&writer, node, indentation);
+    result = wjson_writer_flush(&writer, 1);
+
+    free(writer.buffer);
+    return result;
+}
+
+/**
+ * @brief Serializes a wjson object or list as compact JSON into a caller supplied buffer.
+ *
+ * The output is UTF-8 and null terminated. Like snprintf, at most capacity - 1 bytes are written, and the
+ * return value is the length of the whole serialization, so a return value of capacity or more means the
+ * output was truncated. Calling with a NULL buffer and a capacity of 0 measures the serialization.
+ *
+ * @param node Head of the object or list to serialize.
+ * @param buffer Destination buffer; may be NULL if capacity is 0.
+ * @param capacity Size of buffer in bytes.
+ * @return Length of the whole serialization in bytes, excluding the null terminator.
+ */
+size_t wjson_serialize(struct wjson* node, char* buffer, size_t capacity)
+{
+    struct wjson_writer writer;
+
+    writer.buffer = buffer;
+    writer.length = 0;
+    writer.capacity = (capacity > 0) ? capacity - 1 : 0;
+    writer.total = 0;
+    writer.growable = 0;
+    writer.fd = -1;
+    writer.file = NULL;
+    writer.failed = 0;
+
+    wjson_write_container(&writer, node, -1);
+
+    if (capacity > 0) buffer[writer.length] = '\0';
+    return writer.total;
+}
+
+/**
+ * @brief Serializes a wjson object or list as compact JSON into a newly allocated buffer.
+ *
+ * @param node Head of the object or list to serialize.
+ * @param length Receives the length of the serialization in bytes, excluding the null terminator; may be NULL.
+ * @return Null terminated UTF-8 serialization, or NULL on memory allocation failure.
+ * @note The caller is responsible for freeing the returned buffer.
+ */
+char* wjson_serialize_alloc(struct wjson* node, size_t* length)
+{
+    struct wjson_writer writer;
+
+    writer.buffer = NULL;
+    writer.length = 0;
+    writer.capacity = 0;
+    writer.total = 0;
+    writer.growable = 1;
+    writer.fd = -1;
+    writer.file = NULL;
+    writer.failed = 0;
+
+    wjson_write_container(&writer, node, -1);
+    wjson_writer_put_char(&writer, '\0');
+
+    if (writer.failed)
+    {
+        free(writer.buffer);
+        return NULL;
+    }
+    if (length != NULL) *length = writer.length - 1;
+    return writer.buffer;
+}
+
+/**
+ * @brief Serializes a wjson object or list as compact JSON to a file descriptor.
+ *
+ * Output is staged in a 64 KiB buffer and written in whole blocks, retrying interrupted and partial writes.
+ *
+ * @param node Head of the object or list to serialize.
+ * @param fd File descriptor to write to.
+ * @return 1 on success, 0 on a write or memory allocation failure.
+ * @note Only available where write(2) is; elsewhere this always fails.
+ */
+int wjson_serialize_to_fd(struct wjson* node, int fd)
+{
+    return wjson_serialize_to_sink(node, fd, NULL, -1);
+}
+
+/**
+ * @brief Serializes a wjson object or list as compact JSON to a FILE stream.
+ *
+ * Output is staged in a 64 KiB buffer and handed to fwrite in whole blocks. Wide oriented streams, such as
+ * stdout after a call to wprintf, are written with fputws instead.
+ *
+ * @param node Head of the object or list to serialize.
+ * @param file Stream to write to.
+ * @return 1 on success, 0 on a write or memory allocation failure.
+ */
+int wjson_serialize_to_FILE(struct wjson* node, FILE* file)
+{
+    return wjson_serialize_to_sink(node, -1, file, -1);
+}
+
+/**
+ * @brief Prints a JSON object or list to the standard output with specified indentation.
+ *
+ * This function prints the key-value pairs of a JSON object, or the elements of a list, one per line with tabs
+ * for indentation. The output goes through the same buffered writer as wjson_serialize_to_FILE.
+ *
+ * @param head Pointer to the head of the wjson object or list.
+ * @param indentation Number of indentation levels for proper formatting.
+ */
+void wjson_print(struct wjson* head, int indentation)
+{
+    wjson_serialize_to_sink(head, -1, stdout, indentation);
+}
+
+
+
+
+
+/**
+ * @brief A block of arena memory. Allocations are carved from the bytes following this header.
+ */
+struct wjson_arena_block
+{
+    struct wjson_arena_block* next;
+    size_t capacity;
+};
+
+/**
+ * @brief Bump pointer allocator owning every node, key and string of the documents built in it.
+ *
+ * Blocks are kept in a singly linked chain. Resetting the arena rewinds to the first block without returning
+ * anything to the heap, so a parse/respond loop settles into reusing the same blocks for every document.
+ * Keys of containers built in the arena are interned in intern, if set (see wjson_arena_set_intern).
+ */
+struct wjson_arena
+{
+    struct wjson_arena_block* first;
+    struct wjson_arena_block* current;
+    size_t used;
+    size_t block_size;
+    struct wjson_intern* intern;
+};
+
+#define WJSON_ARENA_ALIGNMENT 16
+#define WJSON_ARENA_ALIGN(size) (((size) + (WJSON_ARENA_ALIGNMENT - 1)) & ~(size_t)(WJSON_ARENA_ALIGNMENT - 1))
+#define WJSON_ARENA_BLOCK_DATA(block) ((char*)(block) + WJSON_ARENA_ALIGN(sizeof(struct wjson_arena_block)))
+#define WJSON_ARENA_DEFAULT_BLOCK_SIZE 65536
+
+/**
+ * @brief Allocates a new arena block with room for at least capacity bytes.
+ *
+ * @param capacity Number of usable bytes in the block.
+ * @return Pointer to the new block, or NULL on memory allocation failure.
+ */
+struct wjson_arena_block* wjson_arena_new_block(size_t capacity)
+{
+    struct wjson_arena_block* block;
+
+    block = (struct wjson_arena_block*)malloc(WJSON_ARENA_ALIGN(sizeof(struct wjson_arena_block)) + capacity);
+    if (block == NULL) return NULL;
+
+    block->next = NULL;
+    block->capacity = capacity;
+    return block;
+}
+
+/**
+ * @brief Creates a new, empty arena.
+ *
+ * @param block_size Size in bytes of each block requested from the heap, or 0 for the default of 64 KiB.
+ * @return Pointer to the new arena.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson_arena* wjson_arena_create(size_t block_size)
+{
+    struct wjson_arena* arena = (struct wjson_arena*)malloc(sizeof(struct wjson_arena));
+    if (block_size == 0) block_size = WJSON_ARENA_DEFAULT_BLOCK_SIZE;
+
+    if (arena == NULL || (arena->first = wjson_arena_new_block(block_size)) == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson arena.");
+        exit(EXIT_FAILURE);
+    }
+
+    arena->current = arena->first;
+    arena->used = 0;
+    arena->block_size = block_size;
+    arena->intern = NULL;
+    return arena;
+}
+
+/**
+ * @brief Allocates memory from an arena.
+ *
+ * Allocation bumps a pointer within the current block. When the block is exhausted the arena moves on to the
+ * next retained block, or chains a new one from the heap. Every allocation is aligned to 16 bytes.
+ *
+ * @param arena Arena to allocate from.
+ * @param size Number of bytes to allocate.
+ * @return Pointer to the allocated memory, or NULL on memory allocation failure.
+ * @note Memory is released all at once by wjson_arena_reset or wjson_arena_destroy.
+ */
+void* wjson_arena_alloc(struct wjson_arena* arena, size_t size)
+{
+    void* memory;
+
+    size = WJSON_ARENA_ALIGN(size);
+
+    if (arena->current->capacity - arena->used < size)
+    {
+        struct wjson_arena_block* block = arena->current->next;
+
+        /* Reuse the next retained block if it is big enough, otherwise splice in a new one */
+        if (block == NULL || block->capacity < size)
+        {
+            block = wjson_arena_new_block(size > arena->block_size ? size : arena->block_size);
+            if (block == NULL) return NULL;
+            block->next = arena->current->next;
+            arena->current->next = block;
+        }
+
+        arena->current = block;
+        arena->used = 0;
+    }
+
+    memory = WJSON_ARENA_BLOCK_DATA(arena->current) + arena->used;
+    arena->used += size;
+    return memory;
+}
+
+/**
+ * @brief Releases every document built in an arena in one step.
+ *
+ * The arena is rewound to its first block. Blocks are retained for reuse, so nothing is returned to the heap
+ * and the cost does not depend on the number of nodes that were allocated.
+ *
+ * @param arena Arena to reset.
+ * @note Every node, key and string allocated from the arena becomes invalid.
+ */
+void wjson_arena_reset(struct wjson_arena* arena)
+{
+    arena->current = arena->first;
+    arena->used = 0;
+}
+
+/**
+ * @brief Destroys an arena, returning all of its blocks to the heap.
+ *
+ * @param arena Arena to destroy.
+ * @note Every node, key and string allocated from the arena becomes invalid.
+ */
+void wjson_arena_destroy(struct wjson_arena* arena)
+{
+    struct wjson_arena_block* block = arena->first;
+
+    while (block != NULL)
+    {
+        struct wjson_arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+
+
+
+
+/**
+ * @brief Slot of an intern pool's table. Empty slots have a NULL key.
+ */
+struct wjson_intern_slot
+{
+    size_t hash;
+    size_t length;
+    wjson_char* key;
+};
+
+/**
+ * @brief Pool of interned keys, shared by every container that uses it.
+ *
+ * Each distinct key is stored once, in storage form, in the pool's own arena, where it stays unchanged until the
+ * pool is destroyed. Members whose keys come from a pool are marked with WJSON_FLAG_INTERNED and do not own
+ * them. The stored keys are found through an open addressing table that is grown to keep its load factor at or
+ * below one half. Shared pools (WJSON_INTERN_SHARED) guard the table with a mutex.
+ */
+struct wjson_intern
+{
+    struct wjson_arena* arena;
+    struct wjson_intern_slot* slots;
+    size_t count;
+    size_t capacity;
+    int shared;
+#ifdef WJSON_HAVE_PTHREAD
+    pthread_mutex_t lock;
+#endif
+};
+
+/**
+ * @brief Pool used by containers whose arena has no pool of its own. See wjson_intern_set_default.
+ */
+struct wjson_intern* wjson_default_intern = NULL;
+
+struct wjson_arena* wjson_arena_of(const struct wjson* wjson_node);
+wjson_char* wjson_allocate_string_from(struct wjson_arena* arena, size_t length);
+
+/**
+ * @brief Creates a new, empty intern pool.
+ *
+ * @param flags WJSON_INTERN_SHARED if the pool will be used from more than one thread at a time, otherwise 0.
+ * @return Pointer to the new pool.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson_intern* wjson_intern_create(int flags)
+{
+    struct wjson_intern* pool = (struct wjson_intern*)malloc(sizeof(struct wjson_intern));
+
+    if (pool == NULL || (pool->slots = (struct wjson_intern_slot*)calloc(64, sizeof(struct wjson_intern_slot))) == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson intern pool.");
+        exit(EXIT_FAILURE);
+    }
+
+    pool->arena = wjson_arena_create(0);
+    pool->count = 0;
+    pool->capacity = 64;
+    pool->shared = (flags & WJSON_INTERN_SHARED) != 0;
+#ifdef WJSON_HAVE_PTHREAD
+    if (pool->shared && pthread_mutex_init(&pool->lock, NULL) != 0)
+    {
+        fprintf(stderr, "wJson: Failed to initialize wJson intern pool lock.");
+        exit(EXIT_FAILURE);
+    }
+#endif
+    return pool;
+}
+
+/**
+ * @brief Destroys an intern pool along with every key stored in it.
+ *
+ * @param pool Pool to destroy. If it is the default pool, there is no default pool afterwards.
+ * @note Every container using the pool's keys must be released or reset first.
+ */
+void wjson_intern_destroy(struct wjson_intern* pool)
+{
+    if (wjson_default_intern == pool) wjson_default_intern = NULL;
+#ifdef WJSON_HAVE_PTHREAD
+    if (pool->shared) pthread_mutex_destroy(&pool->lock);
+#endif
+    wjson_arena_destroy(pool->arena);
+    free(pool->slots);
+    free(pool);
+}
+
+/**
+ * @brief Attaches an intern pool to an arena, so the keys of containers built in the arena are interned in it.
+ *
+ * One pool per arena scopes the sharing to the documents of that arena; the pool's keys live in the pool rather
+ * than the arena, so they survive wjson_arena_reset and are reused by the next document.
+ *
+ * @param arena Arena to attach the pool to.
+ * @param pool Pool to use, or NULL to fall back to the default pool.
+ */
+void wjson_arena_set_intern(struct wjson_arena* arena, struct wjson_intern* pool)
+{
+    arena->intern = pool;
+}
+
+/**
+ * @brief Sets the pool used by heap allocated containers, and by arenas without a pool of their own.
+ *
+ * The default pool is process wide and is used from every thread that builds containers, including the workers
+ * of wjson_parse_ndjson, so it should be created with WJSON_INTERN_SHARED. It should be set before any
+ * container is built and left in place until every container using it is released.
+ *
+ * @param pool Pool to use, or NULL to stop interning keys by default.
+ */
+void wjson_intern_set_default(struct wjson_intern* pool)
+{
+    wjson_default_intern = pool;
+}
+
+/**
+ * @brief Returns the intern pool a container's keys are interned in, if any.
+ *
+ * @param wjson_node Head of a wjson object or list.
+ * @return The pool of the container's arena, or the default pool, or NULL if keys are not interned.
+ */
+struct wjson_intern* wjson_intern_of(const struct wjson* wjson_node)
+{
+    struct wjson_arena* arena = wjson_arena_of(wjson_node);
+
+    if (arena != NULL && arena->intern != NULL) return arena->intern;
+    return wjson_default_intern;
+}
+
+void wjson_intern_lock(struct wjson_intern* pool)
+{
+#ifdef WJSON_HAVE_PTHREAD
+    if (pool->shared) pthread_mutex_lock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+void wjson_intern_unlock(struct wjson_intern* pool)
+{
+#ifdef WJSON_HAVE_PTHREAD
+    if (pool->shared) pthread_mutex_unlock(&pool->lock);
+#else
+    (void)pool;
+#endif
+}
+
+/**
+ * @brief Doubles the size of an intern pool's table.
+ *
+ * @param pool Pool to grow; the caller holds its lock.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_intern_grow(struct wjson_intern* pool)
+{
+    size_t capacity = pool->capacity * 2;
+    struct wjson_intern_slot* slots = (struct wjson_intern_slot*)calloc(capacity, sizeof(struct wjson_intern_slot));
+    size_t i;
+
+    if (slots == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for wJson intern pool.");
+        return 0;
+    }
+
+    for (i = 0; i < pool->capacity; i++)
+    {
+        size_t slot;
+
+        if (pool->slots[i].key == NULL) continue;
+        slot = pool->slots[i].hash & (capacity - 1);
+        while (slots[slot].key != NULL) slot = (slot + 1) & (capacity - 1);
+        slots[slot] = pool->slots[i];
+    }
+
+    free(pool->slots);
+    pool->slots = slots;
+    pool->capacity = capacity;
+    return 1;
+}
+
+/**
+ * @brief Returns the pooled copy of a key in storage form, adding it to the pool if it is not there yet.
+ *
+ * @param pool Pool to intern the key in.
+ * @param key Key in storage form; it does not need to be null terminated.
+ * @param length Number of code units in key.
+ * @return Pointer to the pooled key, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_intern_stored(struct wjson_intern* pool, const wjson_char* key, size_t length)
+{
+    size_t hash = (size_t)14695981039346656037ULL;
+    wjson_char* stored = NULL;
+    size_t i, slot;
+
+    /* The same FNV-1a as wjson_hash_key, over an explicit length */
+    for (i = 0; i < length; i++)
+    {
+        hash ^= (size_t)key[i];
+        hash *= (size_t)1099511628211ULL;
+    }
+
+    wjson_intern_lock(pool);
+
+    if (pool->count * 2 < pool->capacity || wjson_intern_grow(pool))
+    {
+        for (slot = hash & (pool->capacity - 1); pool->slots[slot].key != NULL;
+             slot = (slot + 1) & (pool->capacity - 1))
+        {
+            if (pool->slots[slot].hash == hash && pool->slots[slot].length == length
+                && memcmp(pool->slots[slot].key, key, length * sizeof(wjson_char)) == 0)
+            {
+                stored = pool->slots[slot].key;
+                break;
+            }
+        }
+
+        /* First sighting of this key; store it */
+        if (stored == NULL && (stored = wjson_allocate_string_from(pool->arena, length)) != NULL)
+        {
+            memcpy(stored, key, length * sizeof(wjson_char));
+            stored[length] = 0;
+            pool->slots[slot].hash = hash;
+            pool->slots[slot].length = length;
+            pool->slots[slot].key = stored;
+            pool->count++;
+        }
+    }
+
+    wjson_intern_unlock(pool);
+    return stored;
+}
+
+/**
+ * @brief Interns a run of UTF-8 bytes, as parsed, as a key.
+ *
+ * @param pool Pool to intern the key in.
+ * @param source UTF-8 bytes of the key.
+ * @param length Number of bytes in source.
+ * @return Pointer to the pooled key, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_intern_utf8(struct wjson_intern* pool, const char* source, size_t length)
+{
+#ifdef WJSON_UTF8_STORAGE
+    return wjson_intern_stored(pool, source, length);
+#else
+    wchar_t buffer[256];
+    wchar_t* decoded = (length < 256) ? buffer : (wchar_t*)malloc((length + 1) * sizeof(wchar_t));
+    wjson_char* stored;
+
+    if (decoded == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
+        return NULL;
+    }
+    stored = wjson_intern_stored(pool, decoded, wjson_decode_utf8(source, length, decoded, length + 1));
+
+    if (decoded != buffer) free(decoded);
+    return stored;
+#endif
+}
+
+/**
+ * @brief Interns a key in a pool.
+ *
+ * Every call with an equal key returns the same pointer, so interned keys may be compared by address. Members
+ * whose keys were interned in the pool point at the same storage.
+ *
+ * @param pool Pool to intern the key in.
+ * @param key Key to intern.
+ * @return Pointer to the pooled key, in storage form, or NULL on memory allocation failure.
+ * @note The pooled key stays valid until the pool is destroyed and must not be modified.
+ */
+const wjson_char* wjson_intern_key(struct wjson_intern* pool, const wchar_t* key)
+{
+#ifdef WJSON_UTF8_STORAGE
+    char buffer[256];
+    size_t length = wjson_encode_utf8(key, NULL);
+    char* encoded = (length < sizeof(buffer)) ? buffer : (char*)malloc(length + 1);
+    wjson_char* stored;
+
+    if (encoded == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
+        return NULL;
+    }
+    wjson_encode_utf8(key, encoded);
+    stored = wjson_intern_stored(pool, encoded, length);
+
+    if (encoded != buffer) free(encoded);
+    return stored;
+#else
+    return wjson_intern_stored(pool, key, wcslen(key));
+#endif
+}
+
+/**
+ * @brief Returns the number of distinct keys stored in a pool.
+ *
+ * @param pool Pool to query.
+ * @return Number of keys.
+ */
+size_t wjson_intern_count(struct wjson_intern* pool)
+{
+    size_t count;
+
+    wjson_intern_lock(pool);
+    count = pool->count;
+    wjson_intern_unlock(pool);
+    return count;
+}
+
+
+
+
+
+/*
+ * Heap allocated heads and member nodes are recycled through a free list per thread, so a service that builds
+ * and frees documents in a loop settles into reusing the same nodes instead of going back to malloc. Pooling
+ * needs thread local storage; without it every node comes from malloc and goes back to free.
+ */
+#if defined(__GNUC__)
+#define WJSON_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define WJSON_THREAD_LOCAL __declspec(thread)
+#endif
+
+#define WJSON_POOL_HEAD 0
+#define WJSON_POOL_NODE 1
+#define WJSON_POOL_INLINE 2
+#define WJSON_POOL_CLASSES 3
+#define WJSON_POOL_LIMIT 4096
+
+/**
+ * @brief A pooled block, linked through its first word while it is free.
+ */
+struct wjson_pool_block
+{
+    struct wjson_pool_block* next;
+};
+
+/**
+ * @brief Free lists of a thread, one per block size: heads, plain nodes and nodes with inline strings.
+ *
+ * Each list keeps at most WJSON_POOL_LIMIT blocks; blocks freed past that go straight back to the heap.
+ */
+struct wjson_pool
+{
+    struct wjson_pool_block* blocks[WJSON_POOL_CLASSES];
+    size_t count[WJSON_POOL_CLASSES];
+};
+
+#ifdef WJSON_THREAD_LOCAL
+WJSON_THREAD_LOCAL struct wjson_pool wjson_thread_pool;
+#endif
+
+/**
+ * @brief Returns the size in bytes of the blocks of a pool class.
+ *
+ * @param class WJSON_POOL_HEAD, WJSON_POOL_NODE or WJSON_POOL_INLINE.
+ * @return Size of the class's blocks.
+ */
+size_t wjson_pool_size(int class)
+{
+    if (class == WJSON_POOL_HEAD) return sizeof(struct wjson_head);
+    if (class == WJSON_POOL_NODE) return sizeof(struct wjson);
+    return sizeof(struct wjson) + WJSON_INLINE_CAPACITY;
+}
+
+/**
+ * @brief Takes a block from the calling thread's pool, or from the heap if the pool has none.
+ *
+ * @param class Class of the block.
+ * @return Pointer to the block, or NULL on memory allocation failure.
+ */
+void* wjson_pool_take(int class)
+{
+#ifdef WJSON_THREAD_LOCAL
+    struct wjson_pool_block* block = wjson_thread_pool.blocks[class];
+
+    if (block != NULL)
+    {
+        wjson_thread_pool.blocks[class] = block->next;
+        wjson_thread_pool.count[class]--;
+        return block;
+    }
+#endif
+    return malloc(wjson_pool_size(class));
+}
+
+/**
+ * @brief Returns a block to the calling thread's pool, or to the heap if the pool is full.
+ *
+ * @param memory Block to return, taken from any thread's pool or the heap with at least the class's size.
+ * @param class Class of the block.
+ */
+void wjson_pool_give(void* memory, int class)
+{
+#ifdef WJSON_THREAD_LOCAL
+    if (wjson_thread_pool.count[class] < WJSON_POOL_LIMIT)
+    {
+        struct wjson_pool_block* block = (struct wjson_pool_block*)memory;
+
+        block->next = wjson_thread_pool.blocks[class];
+        wjson_thread_pool.blocks[class] = block;
+        wjson_thread_pool.count[class]++;
+        return;
+    }
+#endif
+    free(memory);
+}
+
+/**
+ * @brief Returns every node pooled by the calling thread to the heap.
+ *
+ * Threads that free documents should call this before they exit, as their pooled nodes are not released
+ * otherwise.
+ */
+void wjson_pool_trim(void)
+{
+#ifdef WJSON_THREAD_LOCAL
+    int class;
+
+    for (class = 0; class < WJSON_POOL_CLASSES; class++)
+    {
+        while (wjson_thread_pool.blocks[class] != NULL)
+        {
+            struct wjson_pool_block* block = wjson_thread_pool.blocks[class];
+
+            wjson_thread_pool.blocks[class] = block->next;
+            free(block);
+        }
+        wjson_thread_pool.count[class] = 0;
+    }
+#endif
+}
+
+
+
+
+
+/**
+ * @brief Returns the arena a container was built in, if any.
+ *
+ * @param wjson_node Head of a wjson object or list.
+ * @return The container's arena, or NULL for heap allocated containers.
+ */
+struct wjson_arena* wjson_arena_of(const struct wjson* wjson_node)
+{
+    if (!(wjson_node->flags & WJSON_FLAG_HEAD)) return NULL;
+    return ((const struct wjson_head*)wjson_node)->arena;
+}
+
+/**
+ * @brief Initializes the members of a node to default values (NULL, 0, false).
+ *
+ * @param new_node Node to initialize.
+ * @param flags Allocation flags for the node (WJSON_FLAG_*).
+ */
+void wjson_clear_node(struct wjson* new_node, unsigned short int flags)
+{
+    /* Initialize Members to NULL */
+    new_node->type = 0;
+    new_node->flags = flags;
+#ifdef WJSON_NODE_PREV
+    new_node->prev = NULL;
+#endif
+    new_node->next = NULL;
+    new_node->key = NULL;
 
     /* Initialize Union to NULL */
     new_node->data_string = NULL;
     new_node->data_numerical = 0.0;
     new_node->data_object = NULL;
     new_node->data_bool = false;
+}
+
+/**
+ * @brief Initializes a container head as an empty object or list.
+ *
+ * @param head Head to initialize.
+ * @param arena Arena the container allocates its members from, or NULL for the heap.
+ * @param flags Additional flags for the head; WJSON_FLAG_LIST for lists, 0 for objects.
+ * @return Pointer to the head's node.
+ */
+struct wjson* wjson_initialize_head(struct wjson_head* head, struct wjson_arena* arena, unsigned short int flags)
+{
+    flags |= WJSON_FLAG_HEAD;
+    if (arena != NULL) flags |= WJSON_FLAG_ARENA;
+
+    wjson_clear_node(&head->node, flags);
+    head->arena = arena;
+    head->tail = &head->node;
+    head->count = 0;
+    head->elements = NULL;
+    head->capacity = 0;
+    return &head->node;
+}
+
+/**
+ * @brief Allocates a new member node for a container, from its arena if it has one.
+ *
+ * @param wjson_node Head of the container the node will be appended to.
+ * @param extra Number of bytes to allocate straight after the node, for inline strings.
+ * @return Pointer to the newly initialized node.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson* wjson_allocate_node(struct wjson* wjson_node, size_t extra)
+{
+    struct wjson_arena* arena = wjson_arena_of(wjson_node);
+    struct wjson* new_node;
+
+    if (arena == NULL)
+        new_node = (struct wjson*)wjson_pool_take(extra > 0 ? WJSON_POOL_INLINE : WJSON_POOL_NODE);
+    else
+        new_node = (struct wjson*)wjson_arena_alloc(arena, sizeof(struct wjson) + extra);
+
+    if (new_node == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
+        exit(EXIT_FAILURE);
+    }
+
+    wjson_clear_node(new_node, arena ? WJSON_FLAG_ARENA : 0);
+    return new_node;
+}
+
+#ifdef WJSON_UTF8_STORAGE
+/**
+ * @brief Length prefix stored immediately before every UTF-8 key and string.
+ */
+typedef unsigned int wjson_length;
+#define WJSON_STRING_PREFIX(string) (((wjson_length*)(string)) - 1)
+#endif
+
+/**
+ * @brief Allocates storage for a key or string of the given length in a container, from its arena if it has one.
+ *
+ * With WJSON_UTF8_STORAGE the storage is preceded by its length, so wjson_string_length takes constant time.
+ *
+ * @param wjson_node Head of the container the string will belong to.
+ * @param length Number of code units in the string, excluding the null terminator.
+ * @return Pointer to storage for length + 1 code units, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_allocate_string(struct wjson* wjson_node, size_t length)
+{
+    return wjson_allocate_string_from(wjson_arena_of(wjson_node), length);
+}
+
+/**
+ * @brief Allocates storage for a key or string of the given length from an arena, or from the heap.
+ *
+ * @param arena Arena to allocate from, or NULL for the heap.
+ * @param length Number of code units in the string, excluding the null terminator.
+ * @return Pointer to storage for length + 1 code units, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_allocate_string_from(struct wjson_arena* arena, size_t length)
+{
+    size_t size = (length + 1) * sizeof(wjson_char);
+    void* memory;
+
+#ifdef WJSON_UTF8_STORAGE
+    size += sizeof(wjson_length);
+#endif
+    memory = (arena == NULL) ? malloc(size) : wjson_arena_alloc(arena, size);
+    if (memory == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson String.");
+        return NULL;
+    }
+
+#ifdef WJSON_UTF8_STORAGE
+    *(wjson_length*)memory = (wjson_length)length;
+    return (wjson_char*)((wjson_length*)memory + 1);
+#else
+    return (wjson_char*)memory;
+#endif
+}
+
+/**
+ * @brief Returns the number of bytes a key or string of the given length takes when stored inline.
+ *
+ * @param length Number of code units in the string, excluding the null terminator, or WJSON_NOT_INLINE.
+ * @return Number of bytes, rounded up to keep the next string aligned, or WJSON_NOT_INLINE if the string is too
+ *         long to be stored inline at all.
+ */
+size_t wjson_inline_size(size_t length)
+{
+    if (length >= WJSON_INLINE_CAPACITY) return WJSON_NOT_INLINE;
+#ifdef WJSON_UTF8_STORAGE
+    return (sizeof(wjson_length) + length + 1 + sizeof(wjson_length) - 1) & ~(sizeof(wjson_length) - 1);
+#else
+    return (length + 1) * sizeof(wjson_char);
+#endif
+}
+
+/**
+ * @brief Lays out storage for a key or string of the given length at the start of an inline area.
+ *
+ * @param storage Start of the area, which has room for wjson_inline_size(length) bytes.
+ * @param length Number of code units in the string, excluding the null terminator.
+ * @return Pointer to storage for length + 1 code units.
+ */
+wjson_char* wjson_inline_string(char* storage, size_t length)
+{
+#ifdef WJSON_UTF8_STORAGE
+    *(wjson_length*)storage = (wjson_length)length;
+    return (wjson_char*)((wjson_length*)storage + 1);
+#else
+    (void)length;
+    return (wjson_char*)storage;
+#endif
+}
+
+/**
+ * @brief Returns the number of code units a wide string takes in storage.
+ *
+ * @param string Null terminated wide string.
+ * @return Length of the string once stored (its UTF-8 encoding with WJSON_UTF8_STORAGE), excluding the terminator.
+ */
+size_t wjson_storage_length(const wchar_t* string)
+{
+#ifdef WJSON_UTF8_STORAGE
+    return wjson_encode_utf8(string, NULL);
+#else
+    return wcslen(string);
+#endif
+}
+
+/**
+ * @brief Copies a wide string into storage allocated for it.
+ *
+ * @param copy Storage for length + 1 code units.
+ * @param string String to copy.
+ * @param length Storage length of the string, from wjson_storage_length.
+ * @return copy.
+ */
+wjson_char* wjson_place_wide(wjson_char* copy, const wchar_t* string, size_t length)
+{
+#ifdef WJSON_UTF8_STORAGE
+    (void)length;
+    wjson_encode_utf8(string, copy);
+#else
+    memcpy(copy, string, (length + 1) * sizeof(wchar_t));
+#endif
+    return copy;
+}
+
+/**
+ * @brief Copies a run of UTF-8 bytes into storage allocated for them, decoding them unless WJSON_UTF8_STORAGE.
+ *
+ * @param copy Storage for length + 1 code units.
+ * @param source UTF-8 bytes to store.
+ * @param length Number of bytes in source.
+ * @return copy.
+ */
+wjson_char* wjson_place_utf8(wjson_char* copy, const char* source, size_t length)
+{
+#ifdef WJSON_UTF8_STORAGE
+    memcpy(copy, source, length);
+    copy[length] = '\0';
+#else
+    wjson_decode_utf8(source, length, copy, length + 1);
+#endif
+    return copy;
+}
+
+/**
+ * @brief Duplicates a key or string value for a container, into its arena if it has one.
+ *
+ * With WJSON_UTF8_STORAGE the wide string is encoded to UTF-8 on the way in.
+ *
+ * @param wjson_node Head of the container the string will belong to.
+ * @param string String to duplicate.
+ * @return Pointer to the copy, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_duplicate_string(struct wjson* wjson_node, const wchar_t* string)
+{
+    size_t length = wjson_storage_length(string);
+    wjson_char* copy = wjson_allocate_string(wjson_node, length);
+
+    return (copy != NULL) ? wjson_place_wide(copy, string, length) : NULL;
+}
+
+/**
+ * @brief Stores a run of UTF-8 bytes as a key or string value of a container, into its arena if it has one.
+ *
+ * Parsed keys and strings go straight from the source buffer into storage. With WJSON_UTF8_STORAGE this is a
+ * plain copy; otherwise the bytes are decoded to wide characters as they are copied.
+ *
+ * @param wjson_node Head of the container the string will belong to.
+ * @param source UTF-8 bytes to store.
+ * @param length Number of bytes in source.
+ * @return Pointer to the stored string, or NULL on memory allocation failure.
+ */
+wjson_char* wjson_store_utf8(struct wjson* wjson_node, const char* source, size_t length)
+{
+    wjson_char* copy = wjson_allocate_string(wjson_node, length);
+
+    return (copy != NULL) ? wjson_place_utf8(copy, source, length) : NULL;
+}
+
+/**
+ * @brief Releases a string obtained from wjson_duplicate_string. Arena strings are left to the arena.
+ *
+ * @param wjson_node Head of the container the string belongs to.
+ * @param string String to release.
+ */
+void wjson_release_string(struct wjson* wjson_node, wjson_char* string)
+{
+    if (string == NULL || wjson_arena_of(wjson_node) != NULL) return;
+#ifdef WJSON_UTF8_STORAGE
+    free(WJSON_STRING_PREFIX(string));
+#else
+    free(string);
+#endif
+}
+
+/**
+ * @brief Gives a new member of a container its key, interned in the container's intern pool if it has one.
+ *
+ * @param wjson_node Head of the container the member belongs to.
+ * @param member Member to give the key to.
+ * @param key Key of the member.
+ * @return 1 on success, 0 on memory allocation failure.
+ */
+int wjson_duplicate_key(struct wjson* wjson_node, struct wjson* member, const wchar_t* key)
+{
+    struct wjson_intern* pool = wjson_intern_of(wjson_node);
+
+    if (pool == NULL)
+    {
+        member->key = wjson_duplicate_string(wjson_node, key);
+    }
+    else if ((member->key = (wjson_char*)wjson_intern_key(pool, key)) != NULL)
+    {
+        member->flags |= WJSON_FLAG_INTERNED;
+    }
+    return member->key != NULL;
+}
+
+/**
+ * @brief Releases the key of a member, unless it belongs to an intern pool or an arena or is stored inline.
+ *
+ * @param wjson_node Head of the container the member belongs to.
+ * @param member Member whose key is released.
+ */
+void wjson_release_key(struct wjson* wjson_node, struct wjson* member)
+{
+    if (!(member->flags & (WJSON_FLAG_INTERNED | WJSON_FLAG_INLINE_KEY))) wjson_release_string(wjson_node, member->key);
+    member->key = NULL;
+}
+
+/**
+ * @brief Records a new element at the end of a list head's element vector.
+ *
+ * The vector grows geometrically. Arena lists grow into a fresh arena allocation; the old vector stays in the
+ * arena until it is reset, which bounds the waste to the size of the final vector.
+ *
+ * @param head Head of the wjson list.
+ * @param element Element to record; it becomes element head->count - 1.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+void wjson_list_push(struct wjson_head* head, struct wjson* element)
+{
+    if (head->count > head->capacity)
+    {
+        size_t capacity = head->capacity ? head->capacity * 2 : 8;
+        struct wjson** elements;
+
+        if (head->arena == NULL)
+            elements = (struct wjson**)realloc(head->elements, capacity * sizeof(struct wjson*));
+        else
+        {
+            elements = (struct wjson**)wjson_arena_alloc(head->arena, capacity * sizeof(struct wjson*));
+            if (elements != NULL && head->capacity > 0)
+                memcpy(elements, head->elements, head->capacity * sizeof(struct wjson*));
+        }
+
+        if (elements == NULL)
+        {
+            fprintf(stderr, "wJson: Failed to allocate memory for wJson list elements.");
+            exit(EXIT_FAILURE);
+        }
+        head->elements = elements;
+        head->capacity = capacity;
+    }
+
+    head->elements[head->count - 1] = element;
+}
+
+/**
+ * @brief Hashes a key for an object's hash index (FNV-1a over its code units).
+ *
+ * @param key Null terminated key to hash.
+ * @return Hash of the key.
+ */
+size_t wjson_hash_key(const wjson_char* key)
+{
+    size_t hash = (size_t)14695981039346656037ULL;
+
+    while (*key != 0)
+    {
+        hash ^= (size_t)*key++;
+        hash *= (size_t)1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @brief Inserts a member into a hash index by linear probing.
+ *
+ * If a member with the same key is already indexed it is kept, so lookups find the first of any duplicate keys
+ * just as a walk of the chain would.
+ *
+ * @param index Slots of the index; capacity must be a power of two with at least one empty slot.
+ * @param capacity Number of slots.
+ * @param hash Hash of the member's key.
+ * @param member Member to insert.
+ */
+void wjson_index_insert(struct wjson_index_slot* index, size_t capacity, size_t hash, struct wjson* member)
+{
+    size_t slot = hash & (capacity - 1);
+
+    while (index[slot].member != NULL)
+    {
+        if (index[slot].hash == hash
+            && (index[slot].member->key == member->key || WJSON_STRCMP(index[slot].member->key, member->key) == 0))
+            return;
+        slot = (slot + 1) & (capacity - 1);
+    }
+
+    index[slot].hash = hash;
+    index[slot].member = member;
+}
+
+/**
+ * @brief Rebuilds an object's hash index with the given number of slots.
+ *
+ * If memory for the index cannot be allocated the object simply goes without one, and lookups fall back to
+ * walking the chain.
+ *
+ * @param head Head of the wjson object.
+ * @param capacity Number of slots, a power of two greater than the member count.
+ */
+void wjson_index_rebuild(struct wjson_head* head, size_t capacity)
+{
+    struct wjson_index_slot* index;
+    struct wjson* member;
+
+    if (head->arena == NULL)
+    {
+        free(head->index);
+        index = (struct wjson_index_slot*)calloc(capacity, sizeof(struct wjson_index_slot));
+    }
+    else
+    {
+        index = (struct wjson_index_slot*)wjson_arena_alloc(head->arena, capacity * sizeof(struct wjson_index_slot));
+        if (index != NULL) memset(index, 0, capacity * sizeof(struct wjson_index_slot));
+    }
+
+    head->index = index;
+    head->capacity = (index != NULL) ? capacity : 0;
+    if (index == NULL) return;
+
+    for (member = &head->node; member != NULL; member = member->next)
+    {
+        if (member->key != NULL) wjson_index_insert(index, capacity, wjson_hash_key(member->key), member);
+    }
+}
+
+/**
+ * @brief Makes a newly appended object member visible to the object's hash index.
+ *
+ * Small objects are not indexed. The index is built once the object reaches WJSON_INDEX_THRESHOLD members, and
+ * is grown to keep its load factor at or below one half.
+ *
+ * @param wjson_node Head of the wjson object.
+ * @param member Member that has just been appended and given its key.
+ */
+void wjson_index_member(struct wjson* wjson_node, struct wjson* member)
+{
+    struct wjson_head* head;
+    size_t capacity;
+
+    if ((wjson_node->flags & (WJSON_FLAG_HEAD | WJSON_FLAG_LIST)) != WJSON_FLAG_HEAD) return;
+    head = (struct wjson_head*)wjson_node;
+    if (head->count < WJSON_INDEX_THRESHOLD) return;
+
+    if (head->index != NULL && head->count * 2 <= head->capacity)
+    {
+        wjson_index_insert(head->index, head->capacity, wjson_hash_key(member->key), member);
+        return;
+    }
+
+    /* Build or grow the index; the new member is already on the chain */
+    for (capacity = 16; capacity < head->count * 4; capacity *= 2) continue;
+    wjson_index_rebuild(head, capacity);
+}
+
+/**
+ * @brief Links a new member node onto the end of a container and returns it.
+ *
+ * Container heads track their tail and member count, so appending takes constant time. An empty head is
+ * itself used as the first member. A node that is not a head, such as a member in the middle of a chain,
+ * falls back to walking to the end of the chain.
+ *
+ * @param wjson_node Head of the wjson object or list.
+ * @return Pointer to the member node, still of type WJSON_TYPE_EMPTY.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson* wjson_append_node(struct wjson* wjson_node)
+{
+    wjson_char* key;
+    wjson_char* value;
+
+    return wjson_append_node_inline(wjson_node, WJSON_NOT_INLINE, WJSON_NOT_INLINE, &key, &value);
+}
+
+/**
+ * @brief Links a new member node onto the end of a container, with room after the node for short strings.
+ *
+ * A key and a string value that fit in WJSON_INLINE_CAPACITY bytes between them are stored in the same
+ * allocation as the node, straight after it, and the node is marked with WJSON_FLAG_INLINE_KEY and
+ * WJSON_FLAG_INLINE_STRING respectively. That saves an allocation per string and keeps the strings on the
+ * node's cache line. The key is placed first; if both do not fit, only the key is. An empty head used as the
+ * first member has no room after it, so nothing is stored inline there.
+ *
+ * @param wjson_node Head of the wjson object or list.
+ * @param key_length Storage length of the key, or WJSON_NOT_INLINE if it is not to be stored inline.
+ * @param value_length Storage length of the string value, or WJSON_NOT_INLINE.
+ * @param key Receives storage for the key, or NULL if it has to be allocated separately.
+ * @param value Receives storage for the string value, or NULL if it has to be allocated separately.
+ * @return Pointer to the member node, still of type WJSON_TYPE_EMPTY.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson* wjson_append_node_inline(struct wjson* wjson_node, size_t key_length, size_t value_length,
+                                       wjson_char** key, wjson_char** value)
+{
+    struct wjson_head* head = NULL;
+    struct wjson* tail = wjson_node;
+    struct wjson* new_node;
+    size_t key_size = wjson_inline_size(key_length);
+    size_t value_size = wjson_inline_size(value_length);
+
+    if (key_size > WJSON_INLINE_CAPACITY) key_size = 0;
+    if (value_size > WJSON_INLINE_CAPACITY - key_size) value_size = 0;
+    *key = NULL;
+    *value = NULL;
+
+    if (wjson_node->flags & WJSON_FLAG_HEAD)
+    {
+        head = (struct wjson_head*)wjson_node;
+        tail = head->tail;
+    }
+    else
+    {
+        /* Go to the end of the list */
+        while (tail->next != NULL) tail = tail->next;
+    }
+
+    /* Node is empty (first element in the list) */
+    if (tail->type == WJSON_TYPE_EMPTY)
+    {
+        new_node = tail;
+        new_node->flags &= ~(WJSON_FLAG_INTERNED | WJSON_FLAG_INLINE_KEY | WJSON_FLAG_INLINE_STRING);
+    }
+    else
+    {
+        new_node = wjson_allocate_node(wjson_node, key_size + value_size);
+        tail->next = new_node;
+#ifdef WJSON_NODE_PREV
+        new_node->prev = tail;
+#endif
+
+        /* Lay out the short strings after the node */
+        if (key_size > 0)
+        {
+            *key = wjson_inline_string((char*)(new_node + 1), key_length);
+            new_node->flags |= WJSON_FLAG_INLINE_KEY;
+        }
+        if (value_size > 0)
+        {
+            *value = wjson_inline_string((char*)(new_node + 1) + key_size, value_length);
+            new_node->flags |= WJSON_FLAG_INLINE_STRING;
+        }
+    }
+
+    if (head != NULL)
+    {
+        head->tail = new_node;
+        head->count++;
+        if (head->node.flags & WJSON_FLAG_LIST) wjson_list_push(head, new_node);
+    }
+
+    return new_node;
+}
+
+/**
+ * @brief Appends a member to a container and gives it its key and string value, storing short ones inline.
+ *
+ * @param wjson_node Head of the wjson object or list.
+ * @param key Key of the member, or NULL for list elements.
+ * @param value String value of the member, or NULL if it is not a string.
+ * @return Pointer to the member node, still of type WJSON_TYPE_EMPTY, or NULL on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns NULL.
+ */
+struct wjson* wjson_append_wide(struct wjson* wjson_node, const wchar_t* key, const wchar_t* value)
+{
+    size_t key_length = WJSON_NOT_INLINE;
+    size_t value_length = WJSON_NOT_INLINE;
+    wjson_char* key_storage;
+    wjson_char* value_storage;
+    struct wjson* new_node;
+
+    /* Pooled keys are shared, so only keys of containers without a pool can go inline */
+    if (key != NULL && wjson_intern_of(wjson_node) == NULL) key_length = wjson_storage_length(key);
+    if (value != NULL) value_length = wjson_storage_length(value);
+    new_node = wjson_append_node_inline(wjson_node, key_length, value_length, &key_storage, &value_storage);
+
+    if (key_storage != NULL)
+    {
+        new_node->key = wjson_place_wide(key_storage, key, key_length);
+    }
+    else if (key != NULL && !wjson_duplicate_key(wjson_node, new_node, key))
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
+        return NULL;
+    }
+
+    if (value_storage != NULL)
+    {
+        new_node->data_string = wjson_place_wide(value_storage, value, value_length);
+    }
+    else if (value != NULL && (new_node->data_string = wjson_duplicate_string(wjson_node, value)) == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson String.");
+        wjson_release_key(wjson_node, new_node);
+        return NULL;
+    }
 
     return new_node;
 }
 
+/*
+ * @brief Initializes a new wjson instance and allocates memory for it.
+ *
+ * This function allocates memory for a new wjson instance, initializes its
+ * members to default values (NULL, 0, false), and returns a pointer to the
+ * newly created instance.
+ *
+ * @return Pointer to the newly initialized wjson instance.
+ * @note Memory allocation failure results in an error message and program exit.
+ * @author Toby Benjamin Clark
+ */
+struct wjson* wjson_initialize()
+{
+    /* Allocating Memory for new struct wjson pointer */
+    struct wjson_head* head = (struct wjson_head*)wjson_pool_take(WJSON_POOL_HEAD);
+    if (head == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
+        exit(EXIT_FAILURE);
+    }
+
+    return wjson_initialize_head(head, NULL, 0);
+}
+
+/**
+ * @brief Initializes a new wjson instance inside an arena.
+ *
+ * The returned head remembers its arena, so members appended to it with the wjson_append_* functions, together
+ * with their keys and strings, are allocated from the same arena.
+ *
+ * @param arena Arena to allocate from.
+ * @return Pointer to the newly initialized wjson instance.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson* wjson_arena_initialize(struct wjson_arena* arena)
+{
+    struct wjson_head* head = (struct wjson_head*)wjson_arena_alloc(arena, sizeof(struct wjson_head));
+    if (head == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
+        exit(EXIT_FAILURE);
+    }
+
+    return wjson_initialize_head(head, arena, 0);
+}
+
 /* @
  * @brief Appends a new string element to the wjson structure.
  *
@@ -537,40 +6945,14 @@ struct wjson* wjson_initialize()
  */
 int wjson_append_string(struct wjson* wjson_node, wchar_t* key, wchar_t* value)
 {
-    /* Go to the end of the list */
-    while (wjson_node->next != NULL) wjson_node = wjson_node->next;
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list, with copies of the key and string value */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, value);
+    if (new_node == NULL) return 0;
 
     new_node->type = WJSON_TYPE_STRING;
 
-    /* Allocate memory for the key and copy its value */
-    new_node->key = wcsdup(key);
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
-    /* Allocate memory for the string value and copy its value */
-    new_node->data_string = wcsdup(value);
-    if (new_node->data_string == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson String.");
-        free(new_node->key);
-        free(new_node->data_string);
-        return 0;
-    }
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
 
     return 1;
 }
@@ -592,34 +6974,18 @@ int wjson_append_string(struct wjson* wjson_node, wchar_t* key, wchar_t* value)
  */
 int wjson_append_object(struct wjson* wjson_node, wchar_t* key, struct wjson* value)
 {
-    /* Go to the end of the list */
-    while (wjson_node->next != NULL) wjson_node = wjson_node->next;
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list, with a copy of the key */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, NULL);
+    if (new_node == NULL) return 0;
 
     new_node->type = WJSON_TYPE_OBJECT;
 
-    /* Allocate memory for the key and copy its value */
-    new_node->key = wcsdup(key);
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_object to point to the provided value */
     new_node->data_object = value;
 
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
+
     return 1;
 }
 
@@ -640,34 +7006,18 @@ int wjson_append_object(struct wjson* wjson_node, wchar_t* key, struct wjson* va
  */
 int wjson_append_list(struct wjson* wjson_node, wchar_t* key, struct wjson* value)
 {
-    /* Go to the end of the list */
-    while (wjson_node->next != NULL) wjson_node = wjson_node->next;
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list, with a copy of the key */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, NULL);
+    if (new_node == NULL) return 0;
 
     new_node->type = WJSON_TYPE_LIST;
 
-    /* Allocate memory for the key and copy its value */
-    new_node->key = wcsdup(key);
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_object to point to the provided value */
     new_node->data_object = value;
 
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
+
     return 1;
 }
 
@@ -676,8 +7026,8 @@ int wjson_append_list(struct wjson* wjson_node, wchar_t* key, struct wjson* valu
  *
  * This function appends a new wjson node with numerical data to the end of the
  * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_numerical field
- * is updated to the provided value.
+ * fields, and updates the list pointers accordingly. The data_numerical field is updated to the
+ * provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param key The key for the new element.
@@ -688,34 +7038,42 @@ int wjson_append_list(struct wjson* wjson_node, wchar_t* key, struct wjson* valu
  */
 int wjson_append_numerical(struct wjson* wjson_node, wchar_t* key, double value)
 {
-    /* Go to the end of the list */
-    while (wjson_node->next != NULL) wjson_node = wjson_node->next;
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list, with a copy of the key */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, NULL);
+    if (new_node == NULL) return 0;
 
     new_node->type = WJSON_TYPE_NUMERICAL;
 
-    /* Allocate memory for the key and copy its value */
-    new_node->key = wcsdup(key);
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_numerical to the provided value */
     new_node->data_numerical = value;
 
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
+
+    return 1;
+}
+
+/**
+ * @brief Appends a new integer member to a wjson object, stored exactly as WJSON_TYPE_INTEGER.
+ *
+ * @param wjson_node The head of the wjson object to which the new member will be appended.
+ * @param key The key for the new member.
+ * @param value The integer value for the new member.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ */
+int wjson_append_integer(struct wjson* wjson_node, wchar_t* key, int64_t value)
+{
+    /* Take a new node at the end of the list, with a copy of the key */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, NULL);
+    if (new_node == NULL) return 0;
+
+    new_node->type = WJSON_TYPE_INTEGER;
+    new_node->data_integer = value;
+
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
+
     return 1;
 }
 
@@ -736,47 +7094,325 @@ int wjson_append_numerical(struct wjson* wjson_node, wchar_t* key, double value)
  */
 int wjson_append_boolean(struct wjson* wjson_node, wchar_t* key, bool value)
 {
-    /* Go to the end of the list */
-    while (wjson_node->next != NULL) wjson_node = wjson_node->next;
+    /* Take a new node at the end of the list, with a copy of the key */
+    struct wjson* new_node = wjson_append_wide(wjson_node, key, NULL);
+    if (new_node == NULL) return 0;
 
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
+    new_node->type = WJSON_TYPE_BOOLEAN;
+
+    /* Update data_bool to the provided value */
+    new_node->data_bool = value;
+
+    /* Make the member visible to wjson_get */
+    wjson_index_member(wjson_node, new_node);
+
+    return 1;
+}
+
+/**
+ * @brief Looks up the member of a wjson object whose key matches a key in storage form.
+ *
+ * @param wjson_node The head of the wjson object to search.
+ * @param key The key to look up, as stored (UTF-8 with WJSON_UTF8_STORAGE, wide otherwise).
+ * @return Pointer to the first member with the key, or NULL if there is none.
+ */
+struct wjson* wjson_find_member(struct wjson* wjson_node, const wjson_char* key)
+{
+    if ((wjson_node->flags & (WJSON_FLAG_HEAD | WJSON_FLAG_LIST)) == WJSON_FLAG_HEAD)
     {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
+        struct wjson_head* head = (struct wjson_head*)wjson_node;
+
+        if (head->index != NULL)
+        {
+            size_t hash = wjson_hash_key(key);
+            size_t slot = hash & (head->capacity - 1);
+
+            while (head->index[slot].member != NULL)
+            {
+                if (head->index[slot].hash == hash
+                    && (head->index[slot].member->key == key || WJSON_STRCMP(head->index[slot].member->key, key) == 0))
+                    return head->index[slot].member;
+                slot = (slot + 1) & (head->capacity - 1);
+            }
+            return NULL;
+        }
     }
 
-    new_node->type = WJSON_TYPE_BOOLEAN;
+    /* Walk the chain */
+    while (wjson_node != NULL)
+    {
+        if (wjson_node->key == key || (wjson_node->key != NULL && WJSON_STRCMP(wjson_node->key, key) == 0))
+            return wjson_node;
+        wjson_node = wjson_node->next;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Looks up the member of a wjson object with the given key.
+ *
+ * Objects with more than a handful of members keep a hash index over their keys, so the lookup takes amortised
+ * constant time. Smaller objects, and nodes that are not object heads, are searched by walking the chain.
+ * With WJSON_UTF8_STORAGE the key is encoded to UTF-8 before the search.
+ *
+ * @param wjson_node The head of the wjson object to search.
+ * @param key The key to look up.
+ * @return Pointer to the first member with the key, or NULL if there is none.
+ */
+struct wjson* wjson_get(struct wjson* wjson_node, const wchar_t* key)
+{
+#ifdef WJSON_UTF8_STORAGE
+    char buffer[256];
+    size_t length = wjson_encode_utf8(key, NULL);
+    char* encoded = (length < sizeof(buffer)) ? buffer : (char*)malloc(length + 1);
+    struct wjson* member;
+
+    if (encoded == NULL) return NULL;
+    wjson_encode_utf8(key, encoded);
+    member = wjson_find_member(wjson_node, encoded);
+
+    if (encoded != buffer) free(encoded);
+    return member;
+#else
+    return wjson_find_member(wjson_node, key);
+#endif
+}
+
+/**
+ * @brief Releases the current value of a member that is about to be overwritten by a wjson_set_* function.
+ *
+ * @param wjson_node The head of the wjson object the member belongs to.
+ * @param member Member whose value is released.
+ * @note A nested object or list is owned by the member, as it is by wjson_free, and is freed with it.
+ */
+void wjson_release_value(struct wjson* wjson_node, struct wjson* member)
+{
+    if ((member->type == WJSON_TYPE_STRING || member->type == WJSON_TYPE_RAW_NUMBER)
+        && !(member->flags & WJSON_FLAG_INLINE_STRING))
+        wjson_release_string(wjson_node, member->data_string);
+    if (member->type == WJSON_TYPE_OBJECT) wjson_free(member->data_object);
+    if (member->type == WJSON_TYPE_LIST) wjson_free(member->data_list);
+    member->flags &= ~WJSON_FLAG_INLINE_STRING;
+    member->data_string = NULL;
+}
+
+/**
+ * @brief Frees a heap allocated object or list along with everything in it.
+ *
+ * Members are released one by one, with their keys, strings and index, and nested heap containers are freed in
+ * the same pass: each one's chain of members is spliced in ahead of the rest of the work, so the walk is
+ * iterative and nesting depth costs no stack. The nodes go back to the calling thread's pool for reuse.
+ * Containers built in an arena are left to it, whether they are the one passed or nested inside it.
+ *
+ * @param wjson_node Head of the object or list to free, such as a whole document or a subtree that has been
+ *                   detached from its parent. NULL is ignored.
+ * @note No container may be reachable twice from the tree, and none of it may be used afterwards.
+ */
+void wjson_free(struct wjson* wjson_node)
+{
+    struct wjson* current = wjson_node;
+
+    if (wjson_node == NULL || (wjson_node->flags & (WJSON_FLAG_HEAD | WJSON_FLAG_ARENA)) != WJSON_FLAG_HEAD) return;
 
-    /* Allocate memory for the key and copy its value */
-    new_node->key = wcsdup(key);
-    if (new_node->key == NULL)
+    while (current != NULL)
     {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
+        struct wjson* next = current->next;
+        struct wjson* child = NULL;
+        /* Nodes allocated with room for inline strings keep a flag for at least one of them */
+        int class = (current->flags & (WJSON_FLAG_INLINE_KEY | WJSON_FLAG_INLINE_STRING))
+                        ? WJSON_POOL_INLINE : WJSON_POOL_NODE;
+
+        if (current->type == WJSON_TYPE_OBJECT) child = current->data_object;
+        if (current->type == WJSON_TYPE_LIST) child = current->data_list;
+
+        /* Queue a nested heap container by splicing its chain in ahead of the rest; the member lets go of it */
+        if (child != NULL && (child->flags & (WJSON_FLAG_HEAD | WJSON_FLAG_ARENA)) == WJSON_FLAG_HEAD)
+        {
+            ((struct wjson_head*)child)->tail->next = next;
+            next = child;
+            current->data_object = NULL;
+        }
+
+        /* Every node walked is on the heap; the root may already be back in the pool, so it is not consulted */
+        wjson_release_key(current, current);
+        wjson_release_value(current, current);
+
+        if (current->flags & WJSON_FLAG_HEAD)
+        {
+            free(((struct wjson_head*)current)->elements);
+            wjson_pool_give(current, WJSON_POOL_HEAD);
+        }
+        else
+        {
+            wjson_pool_give(current, class);
+        }
+        current = next;
+    }
+}
+
+/**
+ * @brief Sets a string member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The string value for the member.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ */
+int wjson_set_string(struct wjson* wjson_node, wchar_t* key, wchar_t* value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
+    wjson_char* copy;
+
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_string(wjson_node, key, value);
+
+    copy = wjson_duplicate_string(wjson_node, value);
+    if (copy == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson String.");
         return 0;
     }
 
-    /* Update data_bool to the provided value */
-    new_node->data_bool = value;
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_STRING;
+    member->data_string = copy;
+    return 1;
+}
+
+/**
+ * @brief Sets an object member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The wjson node representing the object value.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ * @note An object or list the member held before is freed with wjson_free, unless it is value itself, so value
+ *       must not be nested inside it.
+ */
+int wjson_set_object(struct wjson* wjson_node, wchar_t* key, struct wjson* value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
+
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_object(wjson_node, key, value);
+
+    /* Setting the value the member already holds leaves it in place */
+    if (member->type == WJSON_TYPE_OBJECT && member->data_object == value) return 1;
 
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_OBJECT;
+    member->data_object = value;
     return 1;
 }
 
+/**
+ * @brief Sets a list member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The wjson node representing the list value.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ * @note An object or list the member held before is freed with wjson_free, unless it is value itself, so value
+ *       must not be nested inside it.
+ */
+int wjson_set_list(struct wjson* wjson_node, wchar_t* key, struct wjson* value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
 
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_list(wjson_node, key, value);
 
+    /* Setting the value the member already holds leaves it in place */
+    if (member->type == WJSON_TYPE_LIST && member->data_list == value) return 1;
 
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_LIST;
+    member->data_list = value;
+    return 1;
+}
 
-/*
+/**
+ * @brief Sets a numerical member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The numerical value for the member.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ */
+int wjson_set_numerical(struct wjson* wjson_node, wchar_t* key, double value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
+
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_numerical(wjson_node, key, value);
+
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_NUMERICAL;
+    member->data_numerical = value;
+    return 1;
+}
+
+/**
+ * @brief Sets an integer member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The integer value for the member, stored exactly as WJSON_TYPE_INTEGER.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ */
+int wjson_set_integer(struct wjson* wjson_node, wchar_t* key, int64_t value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
+
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_integer(wjson_node, key, value);
+
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_INTEGER;
+    member->flags &= ~WJSON_FLAG_UNSIGNED;
+    member->data_integer = value;
+    return 1;
+}
+
+/**
+ * @brief Sets a boolean member of a wjson object, replacing the value of any existing member with the key.
+ *
+ * @param wjson_node The head of the wjson object.
+ * @param key The key of the member.
+ * @param value The boolean value for the member.
+ * @return 1 on success, 0 on memory allocation failure.
+ * @note Memory allocation failure results in an error message and returns 0.
+ */
+int wjson_set_boolean(struct wjson* wjson_node, wchar_t* key, bool value)
+{
+    struct wjson* member = wjson_get(wjson_node, key);
+
+    /* No member with this key yet, append one */
+    if (member == NULL) return wjson_append_boolean(wjson_node, key, value);
+
+    wjson_release_value(wjson_node, member);
+    member->type = WJSON_TYPE_BOOLEAN;
+    member->data_bool = value;
+    return 1;
+}
+
+
+
+
+
+
+/**
  * @brief Initializes a new wjson list instance and allocates memory for it.
  *
  * This function allocates memory for a new wjson instance, initializes its
  * members to default values (NULL, 0, false), and returns a pointer to the
- * newly created instance.
+ * newly created instance. List elements carry no key; an element's index is
+ * implied by its position.
  *
  * @return Pointer to the newly initialized wjson list instance.
  * @note Memory allocation failure results in an error message and program exit.
@@ -785,35 +7421,41 @@ int wjson_append_boolean(struct wjson* wjson_node, wchar_t* key, bool value)
 struct wjson* wjson_initialize_list()
 {
     /* Allocating Memory for new struct wjson pointer */
-    struct wjson* new_node = (struct wjson*)malloc(sizeof(struct wjson));
-    if (new_node == NULL)
+    struct wjson_head* head = (struct wjson_head*)wjson_pool_take(WJSON_POOL_HEAD);
+    if (head == NULL)
     {
         fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
         exit(EXIT_FAILURE);
     }
 
-    /* Initialize Members to NULL */
-    new_node->type = 0;
-    new_node->prev = NULL;
-    new_node->next = NULL;
-    new_node->key = NULL;
+    return wjson_initialize_head(head, NULL, WJSON_FLAG_LIST);
+}
 
-    /* Initialize Union to NULL */
-    new_node->data_string = NULL;
-    new_node->data_numerical = 0.0;
-    new_node->data_object = NULL;
-    new_node->data_bool = false;
+/**
+ * @brief Initializes a new wjson list instance inside an arena.
+ *
+ * @param arena Arena to allocate from.
+ * @return Pointer to the newly initialized wjson list instance.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+struct wjson* wjson_arena_initialize_list(struct wjson_arena* arena)
+{
+    struct wjson_head* head = (struct wjson_head*)wjson_arena_alloc(arena, sizeof(struct wjson_head));
+    if (head == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for new wJson instance.");
+        exit(EXIT_FAILURE);
+    }
 
-    return new_node;
+    return wjson_initialize_head(head, arena, WJSON_FLAG_LIST);
 }
 
-/*
+/**
  * @brief Appends a new string element to the wjson list.
  *
  * This function appends a new wjson node with string data to the end of the
- * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_string field is
- * updated to the provided value.
+ * provided wjson_node list, sets the necessary fields, and updates the list
+ * pointers accordingly. The data_string field is updated to the provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param value The string value for the new element.
@@ -823,277 +7465,421 @@ struct wjson* wjson_initialize_list()
  */
 int wjson_list_append_string(struct wjson* wjson_node, wchar_t* value)
 {
-    /* Go to the end of the list */
-    int index = 0;
-    while (wjson_node->next != NULL)
-    {
-        index++;
-        wjson_node = wjson_node->next;
-    }
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list, with a copy of the string value */
+    struct wjson* new_node = wjson_append_wide(wjson_node, NULL, value);
+    if (new_node == NULL) return 0;
 
     new_node->type = WJSON_TYPE_STRING;
 
-    /* Converting index to string */
-    int bufferSize = snprintf(NULL, 0, L"%d", index);
-    wchar_t *buffer = (wchar_t *)malloc((bufferSize + 1) * sizeof(wchar_t));
-    swprintf(buffer, bufferSize + 1, L"%d", index);
-    new_node->key = wcsdup(buffer);
-
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
-    /* Update data_string to the provided value */
-    new_node->data_string = wcsdup(value);
-    if (new_node->data_string == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson String.");
-        free(new_node->key);
-        free(new_node->data_string);
-        return 0;
-    }
-
     return 1;
 }
 
-/*
+/**
  * @brief Appends a new object element to the wjson list.
  *
  * This function appends a new wjson node with object data to the end of the
- * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_object field is
- * updated to point to the provided value.
+ * provided wjson_node list, sets the necessary fields, and updates the list
+ * pointers accordingly. The data_object field is updated to point to the
+ * provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param value The wjson node representing the object value.
- * @return 1 on success, 0 on memory allocation failure.
- * @note Memory allocation failure results in an error message and returns 0.
+ * @return 1, as the element is always appended.
+ * @note Memory allocation failure results in an error message and program exit.
  * @author Toby Benjamin Clark
  */
 int wjson_list_append_object(struct wjson* wjson_node, struct wjson* value)
 {
-    /* Go to the end of the list */
-    int index = 0;
-    while (wjson_node->next != NULL)
-    {
-        index++;
-        wjson_node = wjson_node->next;
-    }
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list */
+    struct wjson* new_node = wjson_append_node(wjson_node);
 
     new_node->type = WJSON_TYPE_OBJECT;
 
-    /* Converting index to string */
-    int bufferSize = snprintf(NULL, 0, L"%d", index);
-    wchar_t *buffer = (wchar_t *)malloc((bufferSize + 1) * sizeof(wchar_t));
-    swprintf(buffer, bufferSize + 1, L"%d", index);
-    new_node->key = wcsdup(buffer);
-
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_object to point to the provided value */
     new_node->data_object = value;
 
     return 1;
 }
 
-/*
+/**
  * @brief Appends a new numerical element to the wjson list.
  *
- * This function appends a new wjson node with numerical data to the end of the
- * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_numerical field
- * is updated to the provided value.
+ * This function appends a new wjson node with numerical data to the end of
+ * the provided wjson_node list, sets the necessary fields, and updates the
+ * list pointers accordingly. The data_numerical field is updated to the
+ * provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param value The numerical value for the new element.
- * @return 1 on success, 0 on memory allocation failure.
- * @note Memory allocation failure results in an error message and returns 0.
+ * @return 1, as the element is always appended.
+ * @note Memory allocation failure results in an error message and program exit.
  * @author Toby Benjamin Clark
  */
 int wjson_list_append_numerical(struct wjson* wjson_node, double value)
 {
-    /* Go to the end of the list */
-    int index = 0;
-    while (wjson_node->next != NULL)
-    {
-        index++;
-        wjson_node = wjson_node->next;
-    }
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list */
+    struct wjson* new_node = wjson_append_node(wjson_node);
 
     new_node->type = WJSON_TYPE_NUMERICAL;
 
-    /* Converting index to string */
-    int bufferSize = snprintf(NULL, 0, L"%d", index);
-    wchar_t *buffer = (wchar_t *)malloc((bufferSize + 1) * sizeof(wchar_t));
-    swprintf(buffer, bufferSize + 1, L"%d", index);
-    new_node->key = wcsdup(buffer);
-
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_numerical to the provided value */
     new_node->data_numerical = value;
 
     return 1;
 }
 
-/* t
+/**
+ * @brief Appends a new integer element to a wjson list, stored exactly as WJSON_TYPE_INTEGER.
+ *
+ * @param wjson_node The head of the wjson list to which the new element will be appended.
+ * @param value The integer value for the new element.
+ * @return 1, as the element is always appended.
+ * @note Memory allocation failure results in an error message and program exit.
+ */
+int wjson_list_append_integer(struct wjson* wjson_node, int64_t value)
+{
+    /* Take a new node at the end of the list */
+    struct wjson* new_node = wjson_append_node(wjson_node);
+
+    new_node->type = WJSON_TYPE_INTEGER;
+    new_node->data_integer = value;
+
+    return 1;
+}
+
+/**
  * @brief Appends a new list element to the wjson list.
  *
  * This function appends a new wjson node with list data to the end of the
- * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_list field is
- * updated to point to the provided value.
+ * provided wjson_node list, sets the necessary fields, and updates the list
+ * pointers accordingly. The data_list field is updated to point to the
+ * provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param value The wjson node representing the list value.
- * @return 1 on success, 0 on memory allocation failure.
- * @note Memory allocation failure results in an error message and returns 0.
+ * @return 1, as the element is always appended.
+ * @note Memory allocation failure results in an error message and program exit.
  * @author Toby Benjamin Clark
  */
 int wjson_list_append_list(struct wjson* wjson_node, struct wjson* value)
 {
-    /* Go to the end of the list */
-    int index = 0;
-    while (wjson_node->next != NULL)
-    {
-        index++;
-        wjson_node = wjson_node->next;
-    }
-
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
-    {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
-    }
+    /* Take a new node at the end of the list */
+    struct wjson* new_node = wjson_append_node(wjson_node);
 
     new_node->type = WJSON_TYPE_LIST;
 
-    /* Converting index to string */
-    int bufferSize = snprintf(NULL, 0, L"%d", index);
-    wchar_t *buffer = (wchar_t *)malloc((bufferSize + 1) * sizeof(wchar_t));
-    swprintf(buffer, bufferSize + 1, L"%d", index);
-    new_node->key = wcsdup(buffer);
-
-    if (new_node->key == NULL)
-    {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
-        return 0;
-    }
-
     /* Update data_list to point to the provided value */
     new_node->data_list = value;
 
     return 1;
 }
 
-/*
+/**
  * @brief Appends a new boolean element to the wjson list.
  *
  * This function appends a new wjson node with boolean data to the end of the
- * provided wjson_node list. It allocates memory for the key, sets the necessary
- * fields, and updates the list pointers accordingly. The data_bool field is
- * updated to the provided value.
+ * provided wjson_node list, sets the necessary fields, and updates the list
+ * pointers accordingly. The data_bool field is updated to the provided value.
  *
  * @param wjson_node The head of the wjson list to which the new element will be appended.
  * @param value The boolean value for the new element.
- * @return 1 on success, 0 on memory allocation failure.
- * @note Memory allocation failure results in an error message and returns 0.
+ * @return 1, as the element is always appended.
+ * @note Memory allocation failure results in an error message and program exit.
  * @author Toby Benjamin Clark
  */
 int wjson_list_append_boolean(struct wjson* wjson_node, bool value)
 {
-    /* Go to the end of the list */
-    int index = 0;
-    while (wjson_node->next != NULL)
+    /* Take a new node at the end of the list */
+    struct wjson* new_node = wjson_append_node(wjson_node);
+
+    new_node->type = WJSON_TYPE_BOOLEAN;
+
+    /* Update data_bool to the provided value */
+    new_node->data_bool = value;
+
+    return 1;
+}
+
+
+
+/**
+ * @brief Returns the number of elements in a wjson list.
+ *
+ * List heads track their element count, so this takes constant time. For any other node the chain is walked.
+ *
+ * @param list Head of the wjson list.
+ * @return Number of elements in the list.
+ */
+size_t wjson_list_size(const struct wjson* list)
+{
+    size_t size = 0;
+
+    if (list->flags & WJSON_FLAG_HEAD) return ((const struct wjson_head*)list)->count;
+
+    while (list != NULL)
     {
-        index++;
-        wjson_node = wjson_node->next;
+        if (list->type != WJSON_TYPE_EMPTY) size++;
+        list = list->next;
     }
+    return size;
+}
 
-    /* Node is empty (first element in the list) */
-    struct wjson* new_node;
-    if (wjson_node->type == WJSON_TYPE_EMPTY)
-        new_node = wjson_node;
-    else
+/**
+ * @brief Returns the element at a given index of a wjson list.
+ *
+ * Lists created with wjson_initialize_list or wjson_arena_initialize_list keep their elements in a contiguous
+ * vector, so this takes constant time. For any other node the chain is walked.
+ *
+ * @param list Head of the wjson list.
+ * @param index Zero-based index of the element.
+ * @return Pointer to the element, or NULL if index is out of range.
+ */
+struct wjson* wjson_list_get(struct wjson* list, size_t index)
+{
+    if (list->flags & WJSON_FLAG_LIST)
     {
-        new_node = wjson_initialize();
-        wjson_node->next = new_node;
-        new_node->prev = wjson_node;
+        struct wjson_head* head = (struct wjson_head*)list;
+        return (index < head->count) ? head->elements[index] : NULL;
     }
 
-    new_node->type = WJSON_TYPE_BOOLEAN;
+    while (list != NULL && list->type != WJSON_TYPE_EMPTY)
+    {
+        if (index-- == 0) return list;
+        list = list->next;
+    }
+    return NULL;
+}
 
-    /* Converting index to string */
-    int bufferSize = snprintf(NULL, 0, L"%d", index);
-    wchar_t *buffer = (wchar_t *)malloc((bufferSize + 1) * sizeof(wchar_t));
-    swprintf(buffer, bufferSize + 1, L"%d", index);
-    new_node->key = wcsdup(buffer);
 
-    if (new_node->key == NULL)
+
+/**
+ * @brief Returns the length of a key or string held by a wjson node, in code units.
+ *
+ * With WJSON_UTF8_STORAGE strings carry their length in a prefix, so this takes constant time and counts bytes.
+ * Otherwise it counts wide characters with wcslen.
+ *
+ * @param string Key or data_string of a wjson node.
+ * @return Length of the string, excluding the null terminator.
+ */
+size_t wjson_string_length(const wjson_char* string)
+{
+#ifdef WJSON_UTF8_STORAGE
+    return *WJSON_STRING_PREFIX(string);
+#else
+    return wcslen(string);
+#endif
+}
+
+/**
+ * @brief Copies a stored key or string into a caller supplied wide character buffer.
+ *
+ * @param string Stored key or string to copy; NULL is treated as empty.
+ * @param buffer Destination buffer; may be NULL if capacity is 0.
+ * @param capacity Number of wide characters buffer has room for, including the null terminator.
+ * @return Length of the whole string in wide characters, excluding the null terminator.
+ */
+size_t wjson_copy_wide(const wjson_char* string, wchar_t* buffer, size_t capacity)
+{
+    size_t length;
+
+    if (string == NULL)
     {
-        fprintf(stderr, "wJson: Failed to allocate memory for new wJson Key.");
-        free(new_node->key);
+        if (capacity > 0) buffer[0] = L'\0';
         return 0;
     }
 
-    /* Update data_bool to the provided value */
-    new_node->data_bool = value;
+#ifdef WJSON_UTF8_STORAGE
+    length = wjson_decode_utf8(string, wjson_string_length(string), buffer, capacity);
+#else
+    length = wcslen(string);
+    if (capacity > 0)
+    {
+        size_t copied = (length < capacity) ? length : capacity - 1;
+        memcpy(buffer, string, copied * sizeof(wchar_t));
+        buffer[copied] = L'\0';
+    }
+#endif
+    return length;
+}
+
+/**
+ * @brief Copies the key of a wjson node into a caller supplied wide character buffer.
+ *
+ * The key is converted to wide characters only here, when it is asked for. At most capacity - 1 characters are
+ * copied, followed by a null terminator, in the manner of swprintf; a NULL buffer with capacity 0 measures.
+ *
+ * @param wjson_node Node whose key to copy. List elements have no key and yield an empty string.
+ * @param buffer Destination buffer; may be NULL if capacity is 0.
+ * @param capacity Number of wide characters buffer has room for, including the null terminator.
+ * @return Length of the whole key in wide characters, excluding the null terminator.
+ */
+size_t wjson_get_key_wide(const struct wjson* wjson_node, wchar_t* buffer, size_t capacity)
+{
+    return wjson_copy_wide(wjson_node->key, buffer, capacity);
+}
+
+/**
+ * @brief Copies the string value of a wjson node into a caller supplied wide character buffer.
+ *
+ * Behaves like wjson_get_key_wide. Nodes that are not strings yield an empty string.
+ *
+ * @param wjson_node Node whose string value to copy.
+ * @param buffer Destination buffer; may be NULL if capacity is 0.
+ * @param capacity Number of wide characters buffer has room for, including the null terminator.
+ * @return Length of the whole string in wide characters, excluding the null terminator.
+ */
+size_t wjson_get_string_wide(const struct wjson* wjson_node, wchar_t* buffer, size_t capacity)
+{
+    return wjson_copy_wide(wjson_node->type == WJSON_TYPE_STRING ? wjson_node->data_string : NULL, buffer, capacity);
+}
+
+/**
+ * @brief Converts the source text of a raw number.
+ *
+ * @param text Text of a WJSON_TYPE_RAW_NUMBER node.
+ * @param real Receives the nearest double.
+ * @param integer Receives the exact value of integers, as for wjson_number_integer.
+ * @return The classification of wjson_number_integer, or -1 if the text could not be converted.
+ */
+int wjson_read_raw_number(const wjson_char* text, double* real, uint64_t* integer)
+{
+    size_t length = wjson_string_length(text);
+    struct wjson_scanner scanner;
+    struct wjson_number number;
+    int kind = -1;
+#ifdef WJSON_UTF8_STORAGE
+    const char* source = text;
+#else
+    char buffer[128];
+    char* source = (length < sizeof(buffer)) ? buffer : (char*)malloc(length + 1);
+    size_t i;
+
+    if (source == NULL)
+    {
+        fprintf(stderr, "wJson: Failed to allocate memory for number conversion.");
+        return -1;
+    }
+    for (i = 0; i < length; i++) source[i] = (char)text[i];
+#endif
+
+    scanner.start = source;
+    scanner.cursor = source;
+    scanner.end = source + length;
+    scanner.base = 0;
+    scanner.partial = 0;
+    scanner.scratch = NULL;
+    scanner.scratch_capacity = 0;
+
+    if (wjson_scan_number(&scanner, &number) == 1 && scanner.cursor == scanner.end
+        && wjson_number_double(&number, real))
+        kind = wjson_number_integer(&number, integer);
+
+#ifndef WJSON_UTF8_STORAGE
+    if (source != buffer) free(source);
+#endif
+    return kind;
+}
+
+/**
+ * @brief Reads a numerical node, whichever representation it has.
+ *
+ * @param wjson_node Node to read.
+ * @param real Receives the value as the nearest double.
+ * @param integer Receives the exact value if it is an integer that fits in 64 bits, as for wjson_number_integer.
+ * @return WJSON_INTEGER_SIGNED or WJSON_INTEGER_UNSIGNED for such integers, 0 for other numbers, or -1 if the
+ *         node is not a number.
+ */
+int wjson_read_number(const struct wjson* wjson_node, double* real, uint64_t* integer)
+{
+    switch (wjson_node->type)
+    {
+        case WJSON_TYPE_NUMERICAL:
+            *real = wjson_node->data_numerical;
+
+            /* Whole doubles in range convert exactly; the range checks come first to keep the casts defined */
+            if (*real >= -9223372036854775808.0 && *real < 9223372036854775808.0
+                && *real == (double)(int64_t)*real)
+            {
+                *integer = (uint64_t)(int64_t)*real;
+                return WJSON_INTEGER_SIGNED;
+            }
+            if (*real >= 0 && *real < 18446744073709551616.0 && *real == (double)(uint64_t)*real)
+            {
+                *integer = (uint64_t)*real;
+                return WJSON_INTEGER_UNSIGNED;
+            }
+            return 0;
+        case WJSON_TYPE_INTEGER:
+            if (wjson_node->flags & WJSON_FLAG_UNSIGNED)
+            {
+                *integer = wjson_node->data_unsigned;
+                *real = (double)wjson_node->data_unsigned;
+                return WJSON_INTEGER_UNSIGNED;
+            }
+            *integer = (uint64_t)wjson_node->data_integer;
+            *real = (double)wjson_node->data_integer;
+            return WJSON_INTEGER_SIGNED;
+        case WJSON_TYPE_RAW_NUMBER:
+            return wjson_read_raw_number(wjson_node->data_string, real, integer);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Reads a numerical node as a double.
+ *
+ * Works for every numerical representation: doubles, integers and raw numbers, which are converted on each call.
+ *
+ * @param wjson_node Node to read.
+ * @param result Receives the number, rounded to the nearest double.
+ * @return 1 on success, 0 if the node is not a number.
+ */
+int wjson_get_double(const struct wjson* wjson_node, double* result)
+{
+    uint64_t integer;
+
+    return wjson_read_number(wjson_node, result, &integer) >= 0;
+}
+
+/**
+ * @brief Reads a numerical node as a signed 64-bit integer.
+ *
+ * @param wjson_node Node to read.
+ * @param result Receives the number.
+ * @return 1 on success, 0 if the node is not a number or not an integer in the range of int64_t.
+ */
+int wjson_get_int64(const struct wjson* wjson_node, int64_t* result)
+{
+    uint64_t integer;
+    double real;
 
+    if (wjson_read_number(wjson_node, &real, &integer) != WJSON_INTEGER_SIGNED) return 0;
+    *result = (int64_t)integer;
     return 1;
 }
 
+/**
+ * @brief Reads a numerical node as an unsigned 64-bit integer.
+ *
+ * @param wjson_node Node to read.
+ * @param result Receives the number.
+ * @return 1 on success, 0 if the node is not a number or not an integer in the range of uint64_t.
+ */
+int wjson_get_uint64(const struct wjson* wjson_node, uint64_t* result)
+{
+    uint64_t integer;
+    double real;
+    int kind = wjson_read_number(wjson_node, &real, &integer);
+
+    if (kind == WJSON_INTEGER_UNSIGNED || (kind == WJSON_INTEGER_SIGNED && (int64_t)integer >= 0))
+    {
+        *result = integer;
+        return 1;
+    }
+    return 0;
+}
+
 
 
 /**
@@ -9,6 +9,7 @@
 
 #include <wchar.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -19,47 +20,271 @@
 #define WJSON_TYPE_BOOLEAN 4
 #define WJSON_TYPE_LIST 5
 #define WJSON_TYPE_NULL 6
+#define WJSON_TYPE_INTEGER 7
+#define WJSON_TYPE_RAW_NUMBER 8
+
+#define WJSON_FLAG_HEAD 0x1
+#define WJSON_FLAG_ARENA 0x2
+#define WJSON_FLAG_LIST 0x4
+#define WJSON_FLAG_INTERNED 0x8
+#define WJSON_FLAG_INLINE_KEY 0x10
+#define WJSON_FLAG_INLINE_STRING 0x20
+#define WJSON_FLAG_UNSIGNED 0x40
+
+#define WJSON_PARSE_ERROR 0
+#define WJSON_PARSE_COMPLETE 1
+#define WJSON_PARSE_ABORTED 2
+#define WJSON_PARSE_INCOMPLETE 3
+
+#define WJSON_NDJSON_ORDERED 0x1
+
+#define WJSON_NUMBER_INTEGERS 0x1
+#define WJSON_NUMBER_RAW 0x2
+
+#define WJSON_INTERN_SHARED 0x1
+
+/*
+ * @brief Code unit of stored keys and strings.
+ *
+ * By default keys and strings are stored as wide character strings. Defining WJSON_UTF8_STORAGE (the
+ * WJSON_UTF8_STORAGE CMake option) stores them as length-prefixed UTF-8 instead, which takes a quarter of the
+ * memory for ASCII text and lets the parser copy strings without decoding them. The same definition must be
+ * used for the library and everything that includes this header. The wjson_get_*_wide accessors convert to
+ * wide characters when asked in either mode.
+ */
+#ifdef WJSON_UTF8_STORAGE
+typedef char wjson_char;
+#else
+typedef wchar_t wjson_char;
+#endif
 
 /*
  * @brief Represents a node in a wJSON structure.
  *
  * This struct is used to create a tree-like structure to represent JSON data,
  * with support for wide characters. It includes fields for type information,
- * previous and next pointers for navigating the tree, a key for object members,
+ * a next pointer for navigating the tree, a key for object members,
  * and a union for different data types (string, numerical, object, list, boolean).
+ * The flags record how the node was allocated (WJSON_FLAG_*) and are managed by the library.
+ *
+ * The type and flags share the first word and numbers are stored as double, so a node takes 32 bytes on 64-bit
+ * targets, two to a cache line. Defining WJSON_NODE_PREV (the WJSON_NODE_PREV CMake option) adds a back-link to
+ * the previous member, for 40 bytes a node; like WJSON_UTF8_STORAGE it must be used consistently. Short keys
+ * and strings are stored in the same allocation as their node, straight after it (WJSON_FLAG_INLINE_KEY and
+ * WJSON_FLAG_INLINE_STRING); key and data_string point at them just the same.
+ *
+ * Numbers are WJSON_TYPE_NUMERICAL (data_numerical) unless parsed with WJSON_NUMBER_INTEGERS, which keeps
+ * integers as WJSON_TYPE_INTEGER: data_integer, or data_unsigned when WJSON_FLAG_UNSIGNED is set. With
+ * WJSON_NUMBER_RAW they are WJSON_TYPE_RAW_NUMBER, holding the source text in data_string. wjson_get_double,
+ * wjson_get_int64 and wjson_get_uint64 read any of them.
  */
 struct wjson
 {
     unsigned short int type;
+    unsigned short int flags;
+#ifdef WJSON_NODE_PREV
     struct wjson* prev;
+#endif
     struct wjson* next;
 
-    wchar_t* key;
+    wjson_char* key;
     union {
-        wchar_t* data_string;
-        long double data_numerical;
+        wjson_char* data_string;
+        double data_numerical;
+        int64_t data_integer;
+        uint64_t data_unsigned;
         struct wjson* data_object;
         struct wjson* data_list;
         bool data_bool;
     };
 };
 
+/*
+ * @brief Bump pointer allocator for whole documents. Opaque; see wjson_arena_create.
+ */
+struct wjson_arena;
+
+/*
+ * @brief Callbacks for the event parser (wjson_parse_events).
+ *
+ * Each callback receives the context pointer given to the parser and returns non-zero to continue or 0 to stop
+ * the parse. Keys and strings are passed as unescaped UTF-8 with an explicit length; they are not null
+ * terminated and are only valid for the duration of the call. Callbacks may be left NULL.
+ *
+ * Numbers are passed to on_number as doubles. A client that sets on_integer and on_unsigned receives integers
+ * that fit in 64 bits through those instead, and one that sets on_raw_number receives the text of every number,
+ * unconverted.
+ */
+struct wjson_events
+{
+    int (*on_object_start)(void* context);
+    int (*on_object_end)(void* context);
+    int (*on_array_start)(void* context);
+    int (*on_array_end)(void* context);
+    int (*on_key)(void* context, const char* key, size_t length);
+    int (*on_string)(void* context, const char* value, size_t length);
+    int (*on_number)(void* context, double value);
+    int (*on_bool)(void* context, bool value);
+    int (*on_null)(void* context);
+    int (*on_integer)(void* context, int64_t value);
+    int (*on_unsigned)(void* context, uint64_t value);
+    int (*on_raw_number)(void* context, const char* text, size_t length);
+};
+
+int wjson_parse_events(const char* data, size_t length, const struct wjson_events* events, void* context);
+int wjson_parse_file_events(const char* filename, const struct wjson_events* events, void* context);
+struct wjson* wjson_parse_indexed(const char* data, size_t length, unsigned int threads, struct wjson_arena* arena);
+int wjson_parse_ndjson(const char* data, size_t length, unsigned int threads, int flags,
+                       int (*callback)(void* context, size_t offset, struct wjson* document), void* context);
+int wjson_parse_ndjson_file(const char* filename, unsigned int threads, int flags,
+                            int (*callback)(void* context, size_t offset, struct wjson* document), void* context);
+
+/*
+ * @brief Handle on a value inside a JSON document that is parsed lazily, on demand.
+ *
+ * A lazy handle is a position in the source buffer: data and end delimit the document, start is the first byte
+ * of the value and key the opening quote of its key when it is an object member, or NULL. Handles are plain
+ * values that may be copied freely; they stay valid as long as the source buffer does. See wjson_lazy_open.
+ */
+struct wjson_lazy
+{
+    const char* data;
+    const char* end;
+    const char* start;
+    const char* key;
+};
+
+int wjson_lazy_open(struct wjson_lazy* value, const char* data, size_t length);
+int wjson_lazy_type(const struct wjson_lazy* value);
+int wjson_lazy_get(const struct wjson_lazy* object, const char* key, struct wjson_lazy* member);
+int wjson_lazy_at(const struct wjson_lazy* container, size_t index, struct wjson_lazy* member);
+int wjson_lazy_next(const struct wjson_lazy* member, struct wjson_lazy* next);
+size_t wjson_lazy_key(const struct wjson_lazy* member, char* buffer, size_t capacity);
+size_t wjson_lazy_string(const struct wjson_lazy* value, char* buffer, size_t capacity);
+int wjson_lazy_number(const struct wjson_lazy* value, double* result);
+int wjson_lazy_bool(const struct wjson_lazy* value, bool* result);
+struct wjson* wjson_lazy_materialize(const struct wjson_lazy* value, struct wjson_arena* arena);
+
+/*
+ * @brief A compiled JSON Pointer. Opaque; see wjson_path_compile.
+ */
+struct wjson_path;
+
+struct wjson_path* wjson_path_compile(const char* pointer);
+void wjson_path_free(struct wjson_path* path);
+struct wjson* wjson_path_eval(struct wjson* document, const struct wjson_path* path);
+size_t wjson_path_eval_all(struct wjson* document, const struct wjson_path* path, struct wjson** matches,
+                           size_t capacity);
+int wjson_path_stream(const char* data, size_t length, const struct wjson_path* path,
+                      int (*callback)(void* context, const struct wjson_lazy* match), void* context);
+
+/*
+ * @brief Read-only document stored as a flat array of tagged 64-bit entries. Opaque; see wjson_tape_parse.
+ */
+struct wjson_tape;
+
+struct wjson_tape* wjson_tape_parse(const char* data, size_t length);
+void wjson_tape_free(struct wjson_tape* tape);
+int wjson_tape_type(const struct wjson_tape* tape, size_t index);
+size_t wjson_tape_next(const struct wjson_tape* tape, size_t index);
+size_t wjson_tape_end(const struct wjson_tape* tape, size_t index);
+size_t wjson_tape_get(const struct wjson_tape* tape, size_t object, const char* key);
+const char* wjson_tape_get_string(const struct wjson_tape* tape, size_t index, size_t* length);
+double wjson_tape_get_number(const struct wjson_tape* tape, size_t index);
+bool wjson_tape_get_bool(const struct wjson_tape* tape, size_t index);
+int wjson_tape_replay(const struct wjson_tape* tape, const struct wjson_events* events, void* context);
+struct wjson* wjson_tape_to_tree(const struct wjson_tape* tape, struct wjson_arena* arena);
+struct wjson_tape* wjson_tape_from_tree(struct wjson* document);
+
+/*
+ * @brief Resumable parser for documents that arrive in chunks. Opaque; see wjson_push_parser_create.
+ */
+struct wjson_push_parser;
+
+struct wjson_push_parser* wjson_push_parser_create(const struct wjson_events* events, void* context);
+struct wjson_push_parser* wjson_push_parser_create_tree(struct wjson_arena* arena);
+void wjson_push_parser_set_limits(struct wjson_push_parser* parser, size_t max_depth, size_t max_length);
+int wjson_push_parser_feed(struct wjson_push_parser* parser, const char* chunk, size_t length);
+int wjson_push_parser_finish(struct wjson_push_parser* parser);
+struct wjson* wjson_push_parser_root(struct wjson_push_parser* parser);
+void wjson_push_parser_destroy(struct wjson_push_parser* parser);
+
+/*
+ * @brief Reusable parser for in-memory documents. Opaque; see wjson_parser_create.
+ */
+struct wjson_parser;
+
+struct wjson_parser* wjson_parser_create(void);
+void wjson_parser_set_limits(struct wjson_parser* parser, size_t max_depth, size_t max_length);
+struct wjson* wjson_parser_parse(struct wjson_parser* parser, const char* data, size_t length,
+                                 struct wjson_arena* arena, int flags);
+int wjson_parser_parse_events(struct wjson_parser* parser, const char* data, size_t length,
+                              const struct wjson_events* events, void* context);
+void wjson_parser_destroy(struct wjson_parser* parser);
+
+struct wjson_arena* wjson_arena_create(size_t block_size);
+void* wjson_arena_alloc(struct wjson_arena* arena, size_t size);
+void wjson_arena_reset(struct wjson_arena* arena);
+void wjson_arena_destroy(struct wjson_arena* arena);
+struct wjson* wjson_arena_initialize(struct wjson_arena* arena);
+struct wjson* wjson_arena_initialize_list(struct wjson_arena* arena);
+
+/*
+ * @brief Pool of keys stored once and shared by every member with an equal key. Opaque; see wjson_intern_create.
+ */
+struct wjson_intern;
+
+struct wjson_intern* wjson_intern_create(int flags);
+void wjson_intern_destroy(struct wjson_intern* pool);
+const wjson_char* wjson_intern_key(struct wjson_intern* pool, const wchar_t* key);
+size_t wjson_intern_count(struct wjson_intern* pool);
+void wjson_intern_set_default(struct wjson_intern* pool);
+void wjson_arena_set_intern(struct wjson_arena* arena, struct wjson_intern* pool);
+
 struct wjson* wjson_initialize_list();
 int wjson_list_append_string(struct wjson* wjson_node, wchar_t* value);
 int wjson_list_append_object(struct wjson* wjson_node, struct wjson* value);
 int wjson_list_append_numerical(struct wjson* wjson_node, double value);
+int wjson_list_append_integer(struct wjson* wjson_node, int64_t value);
 int wjson_list_append_list(struct wjson* wjson_node, struct wjson* value);
 int wjson_list_append_boolean(struct wjson* wjson_node, bool value);
+size_t wjson_list_size(const struct wjson* list);
+struct wjson* wjson_list_get(struct wjson* list, size_t index);
 
 struct wjson* wjson_initialize();
+void wjson_free(struct wjson* wjson_node);
+void wjson_pool_trim(void);
+struct wjson* wjson_parse(const char* filename);
+struct wjson* wjson_parse_buffer(const char* data, size_t length);
+struct wjson* wjson_parse_buffer_arena(const char* data, size_t length, struct wjson_arena* arena);
+struct wjson* wjson_parse_buffer_flags(const char* data, size_t length, struct wjson_arena* arena, int flags);
 struct wjson* wjson_parse_subobj(FILE* file);
 int wjson_append_string(struct wjson* wjson_node, wchar_t* key, wchar_t* value);
 int wjson_append_object(struct wjson* wjson_node, wchar_t* key, struct wjson* value);
 int wjson_append_list(struct wjson* wjson_node, wchar_t* key, struct wjson* value);
 int wjson_append_numerical(struct wjson* wjson_node, wchar_t* key, double value);
+int wjson_append_integer(struct wjson* wjson_node, wchar_t* key, int64_t value);
 int wjson_append_boolean(struct wjson* wjson_node, wchar_t* key, bool value);
+struct wjson* wjson_get(struct wjson* wjson_node, const wchar_t* key);
+int wjson_set_string(struct wjson* wjson_node, wchar_t* key, wchar_t* value);
+int wjson_set_object(struct wjson* wjson_node, wchar_t* key, struct wjson* value);
+int wjson_set_list(struct wjson* wjson_node, wchar_t* key, struct wjson* value);
+int wjson_set_numerical(struct wjson* wjson_node, wchar_t* key, double value);
+int wjson_set_integer(struct wjson* wjson_node, wchar_t* key, int64_t value);
+int wjson_set_boolean(struct wjson* wjson_node, wchar_t* key, bool value);
+
+size_t wjson_string_length(const wjson_char* string);
+size_t wjson_get_key_wide(const struct wjson* wjson_node, wchar_t* buffer, size_t capacity);
+size_t wjson_get_string_wide(const struct wjson* wjson_node, wchar_t* buffer, size_t capacity);
+int wjson_get_double(const struct wjson* wjson_node, double* result);
+int wjson_get_int64(const struct wjson* wjson_node, int64_t* result);
+int wjson_get_uint64(const struct wjson* wjson_node, uint64_t* result);
 
 void wjson_print(struct wjson* head, int indentation);
+size_t wjson_serialize(struct wjson* node, char* buffer, size_t capacity);
+char* wjson_serialize_alloc(struct wjson* node, size_t* length);
+int wjson_serialize_to_fd(struct wjson* node, int fd);
+int wjson_serialize_to_FILE(struct wjson* node, FILE* file);
 void wjson_test();
 
 #endif